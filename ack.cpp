@@ -0,0 +1,191 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "public_errors.h"
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "ack.h"
+
+#define ACK_BUFSIZE 256
+
+AckChannel::AckChannel(void) :
+#ifdef _WIN32
+	hSlot(INVALID_HANDLE_VALUE),
+#else
+	fd(-1),
+#endif
+	next(0)
+{
+	for(int i=0; i<ACK_PENDING_SLOTS; i++)
+		pending[i].active = false;
+}
+
+AckChannel::~AckChannel(void)
+{
+	Close();
+}
+
+bool AckChannel::Open(const char* path)
+{
+#ifdef _WIN32
+	HANDLE hFile = CreateFile(path, GENERIC_WRITE, FILE_SHARE_READ, (LPSECURITY_ATTRIBUTES)NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, (HANDLE)NULL);
+
+	lock.Lock();
+	if(hSlot != INVALID_HANDLE_VALUE) CloseHandle(hSlot);
+	hSlot = hFile;
+	lock.Unlock();
+
+	return hFile != INVALID_HANDLE_VALUE;
+#else
+	struct sockaddr_un addr;
+	if(strlen(path) >= sizeof(addr.sun_path)) return false;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	// Connect so the writes fail once the sender removes its socket
+	int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if(sock != -1 && connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+	{
+		close(sock);
+		sock = -1;
+	}
+
+	lock.Lock();
+	if(fd != -1) close(fd);
+	fd = sock;
+	lock.Unlock();
+
+	return sock != -1;
+#endif
+}
+
+void AckChannel::Close()
+{
+	lock.Lock();
+#ifdef _WIN32
+	if(hSlot != INVALID_HANDLE_VALUE) CloseHandle(hSlot);
+	hSlot = INVALID_HANDLE_VALUE;
+#else
+	if(fd != -1) close(fd);
+	fd = -1;
+#endif
+
+	// Requests still waiting for the server will not be acknowledged anymore
+	for(int i=0; i<ACK_PENDING_SLOTS; i++)
+		pending[i].active = false;
+	lock.Unlock();
+}
+
+void AckChannel::Write(const char* id, const char* command, const char* result, uint64 dispatch, uint64 rtt, bool remote)
+{
+	// Called with the lock held
+	if(!IsOpen()) return;
+
+	char buffer[ACK_BUFSIZE];
+	int length;
+	if(remote) length = snprintf(buffer, ACK_BUFSIZE, "ACK %s %s %s %llu %llu", id, command, result, (unsigned long long)dispatch, (unsigned long long)rtt);
+	else length = snprintf(buffer, ACK_BUFSIZE, "ACK %s %s %s %llu -", id, command, result, (unsigned long long)dispatch);
+	if(length <= 0) return;
+	if(length >= ACK_BUFSIZE) length = ACK_BUFSIZE-1;
+
+#ifdef _WIN32
+	DWORD written;
+	if(!WriteFile(hSlot, buffer, (DWORD)length, &written, NULL))
+	{
+		// The sender went away, stop acknowledging until a new endpoint is set
+		CloseHandle(hSlot);
+		hSlot = INVALID_HANDLE_VALUE;
+	}
+#else
+	// Never block the caller, an acknowledgement is dropped if the sender is not reading
+	if(send(fd, buffer, length, MSG_DONTWAIT | MSG_NOSIGNAL) == -1 && errno != EAGAIN)
+	{
+		close(fd);
+		fd = -1;
+	}
+#endif
+}
+
+void AckChannel::Expire(uint64 now)
+{
+	// Called with the lock held
+	for(int i=0; i<ACK_PENDING_SLOTS; i++)
+	{
+		PendingAck& ack = pending[i];
+		if(ack.active && now - ack.sent > ACK_TIMEOUT)
+		{
+			Write(ack.id, ack.command, "timeout", ack.dispatch, now - ack.sent, true);
+			ack.active = false;
+		}
+	}
+}
+
+void AckChannel::Send(const char* id, const char* command, bool ok, uint64 dispatch)
+{
+	lock.Lock();
+	Write(id, command, ok ? "ok" : "failed", dispatch, 0, false);
+	lock.Unlock();
+}
+
+void AckChannel::Expect(const char* returnCode, const char* id, const char* command, uint64 sent, uint64 dispatch)
+{
+	lock.Lock();
+	Expire(sent);
+
+	// Reuse the slots in turn, a request that is still waiting in the slot is given up on
+	PendingAck& ack = pending[next];
+	next = (next + 1) % ACK_PENDING_SLOTS;
+	if(ack.active) Write(ack.id, ack.command, "timeout", ack.dispatch, sent - ack.sent, true);
+
+	ack.active = true;
+	_strcpy(ack.returnCode, RETURNCODE_BUFSIZE, returnCode);
+	_strcpy(ack.id, ACK_ID_BUFSIZE, id);
+	ack.command = command;
+	ack.sent = sent;
+	ack.dispatch = dispatch;
+	lock.Unlock();
+}
+
+bool AckChannel::Complete(const char* returnCode, unsigned int error, uint64 now)
+{
+	bool found = false;
+
+	lock.Lock();
+	for(int i=0; i<ACK_PENDING_SLOTS; i++)
+	{
+		PendingAck& ack = pending[i];
+		if(ack.active && !strcmp(ack.returnCode, returnCode))
+		{
+			char result[32] = "ok";
+			if(error != ERROR_ok) snprintf(result, sizeof(result), "error:%u", error);
+
+			Write(ack.id, ack.command, result, ack.dispatch, now - ack.sent, true);
+			ack.active = false;
+			found = true;
+			break;
+		}
+	}
+	Expire(now);
+	lock.Unlock();
+
+	return found;
+}
@@ -0,0 +1,99 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef ACK_H
+#define ACK_H
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "public_definitions.h"
+#include "platform.h"
+
+#include <stddef.h>
+
+#define RETURNCODE_BUFSIZE 128
+#define ACK_ID_BUFSIZE 32
+#define ACK_PENDING_SLOTS 16
+#define ACK_TIMEOUT 5000000 // Microseconds to wait for the server before a request is reported as timed out
+
+// Return code for the server request of a command, with what is needed to acknowledge it
+typedef struct
+{
+	char code[RETURNCODE_BUFSIZE];
+	const char* id;      // Identifier given by the sender
+	const char* command;
+	uint64 received;     // Time the message was received, in microseconds
+	bool used;           // Set once a request was sent with the return code
+} ReturnCode;
+
+// A server request waiting for the server to respond
+typedef struct
+{
+	bool active;
+	char returnCode[RETURNCODE_BUFSIZE];
+	char id[ACK_ID_BUFSIZE];
+	const char* command;
+	uint64 sent;     // Time the request was sent, in microseconds
+	uint64 dispatch; // Local dispatch time in microseconds
+} PendingAck;
+
+/*
+ * Reports the result of every command back to the sender through an endpoint the sender created,
+ * a mailslot on Windows or a Unix-domain datagram socket elsewhere.
+ * Local commands are acknowledged as soon as they ran. Server requests are acknowledged once
+ * the server responds to their return code, with the local dispatch time and the server round-trip
+ * time reported separately.
+ *
+ * An acknowledgement is a single message:
+ *     ACK <Id> <Command> <Result> <Dispatch> <Round-trip>
+ * The result is "ok", "failed" if the command was rejected locally, "timeout" if the server did not
+ * respond, or "error:<Code>" with the TeamSpeak error code. Times are in microseconds, the round-trip
+ * time is "-" for local commands.
+ *
+ * Thread-safe, commands are acknowledged on the executor and the background thread. The responses of
+ * the server are handed to the executor by the TeamSpeak event thread.
+ */
+class AckChannel
+{
+private:
+	Mutex lock;
+#ifdef _WIN32
+	HANDLE hSlot;
+#else
+	int fd;
+#endif
+	PendingAck pending[ACK_PENDING_SLOTS];
+	unsigned int next;
+
+	void Write(const char* id, const char* command, const char* result, uint64 dispatch, uint64 rtt, bool remote);
+	void Expire(uint64 now);
+public:
+	AckChannel(void);
+	~AckChannel(void);
+
+	bool Open(const char* path);
+	void Close();
+#ifdef _WIN32
+	inline bool IsOpen() const { return hSlot != INVALID_HANDLE_VALUE; }
+#else
+	inline bool IsOpen() const { return fd != -1; }
+#endif
+
+	// Acknowledges a local command
+	void Send(const char* id, const char* command, bool ok, uint64 dispatch);
+
+	// Holds the acknowledgement of a server request back until the server responds
+	void Expect(const char* returnCode, const char* id, const char* command, uint64 sent, uint64 dispatch);
+
+	// Returns false if the return code does not belong to a pending request
+	bool Complete(const char* returnCode, unsigned int error, uint64 now);
+};
+
+#endif
@@ -1,4 +1,6 @@
-#include "Channel.h"
+#include <stddef.h>
+
+#include "channel.h"
 #include "public_definitions.h"
 #include "public_errors.h"
 #include "ts3_functions.h"
@@ -84,14 +86,14 @@ int Channel::GetChannelHierarchy(uint64 scHandlerID, Channel* root)
 
 	// Get channel list
 	uint64* channels;
-	if((error = ts3Functions.getChannelList(scHandlerID, &channels)) != ERROR_ok)
+	if((error = clientFunctions->getChannelList(scHandlerID, &channels)) != ERROR_ok)
 	{
 		char* errorMsg;
-		if(ts3Functions.getErrorMessage(error, &errorMsg) == ERROR_ok)
+		if(clientFunctions->getErrorMessage(error, &errorMsg) == ERROR_ok)
 		{
-			ts3Functions.logMessage("Error retrieving list of channels:", LogLevel_WARNING, "NiftyKb Plugin", 0);
-			ts3Functions.logMessage(errorMsg, LogLevel_WARNING, "NiftyKb Plugin", 0);
-			ts3Functions.freeMemory(errorMsg);
+			clientFunctions->logMessage("Error retrieving list of channels:", LogLevel_WARNING, "NiftyKb Plugin", 0);
+			clientFunctions->logMessage(errorMsg, LogLevel_WARNING, "NiftyKb Plugin", 0);
+			clientFunctions->freeMemory(errorMsg);
 		}
 		return 1;
 	}
@@ -107,7 +109,7 @@ int Channel::GetChannelHierarchy(uint64 scHandlerID, Channel* root)
 		while(id != 0)
 		{
 			hierachy.push(id);
-			ts3Functions.getParentChannelOfChannel(scHandlerID, id, &id);
+			clientFunctions->getParentChannelOfChannel(scHandlerID, id, &id);
 		}
 
 		while(!hierachy.empty())
@@ -125,16 +127,16 @@ int Channel::GetChannelHierarchy(uint64 scHandlerID, Channel* root)
 			{
 				// Get the channel order
 				int order;
-				if((error = ts3Functions.getChannelVariableAsInt(scHandlerID, id, CHANNEL_ORDER, &order)) != ERROR_ok)
+				if((error = clientFunctions->getChannelVariableAsInt(scHandlerID, id, CHANNEL_ORDER, &order)) != ERROR_ok)
 				{
 					char* errorMsg;
-					if(ts3Functions.getErrorMessage(error, &errorMsg) == ERROR_ok)
+					if(clientFunctions->getErrorMessage(error, &errorMsg) == ERROR_ok)
 					{
-						ts3Functions.logMessage("Error getting channel info:", LogLevel_WARNING, "NiftyKb Plugin", 0);
-						ts3Functions.logMessage(errorMsg, LogLevel_WARNING, "NiftyKb Plugin", 0);
-						ts3Functions.freeMemory(errorMsg);
+						clientFunctions->logMessage("Error getting channel info:", LogLevel_WARNING, "NiftyKb Plugin", 0);
+						clientFunctions->logMessage(errorMsg, LogLevel_WARNING, "NiftyKb Plugin", 0);
+						clientFunctions->freeMemory(errorMsg);
 					}
-					ts3Functions.freeMemory(channels);
+					clientFunctions->freeMemory(channels);
 					return 1;
 				}
 
@@ -166,6 +168,6 @@ int Channel::GetChannelHierarchy(uint64 scHandlerID, Channel* root)
 		}
 	}
 
-	ts3Functions.freeMemory(channels);
+	clientFunctions->freeMemory(channels);
 	return 0;
 }
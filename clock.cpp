@@ -0,0 +1,61 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "clock.h"
+#include "stats.h"
+
+static inline uint64 ClockLoad(const volatile uint64* value)
+{
+#ifdef _WIN32
+	return (uint64)InterlockedCompareExchange64((volatile LONGLONG*)value, 0, 0);
+#else
+	return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void ClockStore(volatile uint64* value, uint64 newValue)
+{
+#ifdef _WIN32
+	InterlockedExchange64((volatile LONGLONG*)value, (LONGLONG)newValue);
+#else
+	__atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+#endif
+}
+
+/*********************************** SystemClock ************************************/
+
+uint64 SystemClock::Now()
+{
+	return StatsNow();
+}
+
+/*********************************** VirtualClock ************************************/
+
+VirtualClock::VirtualClock(uint64 start) :
+	now(start)
+{
+}
+
+uint64 VirtualClock::Now()
+{
+	return ClockLoad(&now);
+}
+
+void VirtualClock::Set(uint64 time)
+{
+	if(time > ClockLoad(&now)) ClockStore(&now, time);
+}
+
+void VirtualClock::Advance(uint64 usecs)
+{
+	ClockStore(&now, ClockLoad(&now) + usecs);
+}
@@ -0,0 +1,52 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include "public_definitions.h"
+
+/*
+ * Time source of the timers, the scheduler and the rate limits, in microseconds. The plugin runs on the
+ * system clock, replays and tests drive it with a virtual one instead.
+ */
+class Clock
+{
+public:
+	virtual ~Clock(void) {}
+
+	// Never goes backwards
+	virtual uint64 Now() = 0;
+};
+
+// The monotonic clock the latency statistics use, see StatsNow
+class SystemClock : public Clock
+{
+public:
+	uint64 Now();
+};
+
+/*
+ * A clock that only moves when it is told to, so everything that depends on the time runs the same way
+ * every time. Any thread may read it, only the thread that drives it moves it.
+ */
+class VirtualClock : public Clock
+{
+private:
+	volatile uint64 now;
+public:
+	VirtualClock(uint64 start = 0);
+
+	uint64 Now();
+
+	// Moves the clock to the given time, a time before the current one is ignored
+	void Set(uint64 time);
+	void Advance(uint64 usecs);
+};
+
+#endif
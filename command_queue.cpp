@@ -0,0 +1,166 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <string.h>
+
+#include "command_queue.h"
+
+static bool IsSameText(const Message* first, const Message* second)
+{
+	// Sender names are blanked out of the text, skip the spaces they leave behind
+	const char* a = first->data;
+	const char* b = second->data;
+	while(*a == ' ') a++;
+	while(*b == ' ') b++;
+	return !strcmp(a, b);
+}
+
+CommandQueue::CommandQueue(MessagePool& pool, StepFormatter formatStep) :
+	pool(pool),
+	formatStep(formatStep),
+	head(0),
+	count(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+CommandQueue::~CommandQueue(void)
+{
+}
+
+bool CommandQueue::Collapse(const CommandQueueEntry& incoming)
+{
+	// Called with the lock held. The queued entries and the incoming one are collapsed in order,
+	// the entries that remain are moved to the front.
+	CommandQueueEntry kept[MAX_MESSAGES+1];
+	unsigned int keptCount = 0;
+	unsigned int removed = 0;
+
+	for(unsigned int i=0; i<=count; i++)
+	{
+		const CommandQueueEntry& entry = (i < count) ? entries[(head + i) % MAX_MESSAGES] : incoming;
+		CommandQueueEntry* last = (keptCount > 0) ? &kept[keptCount-1] : NULL;
+		bool sameGroup = last != NULL && last->collapse.kind == entry.collapse.kind && last->collapse.group == entry.collapse.group;
+
+		switch(entry.collapse.kind)
+		{
+		case COLLAPSE_TOGGLE:
+			if(sameGroup)
+			{
+				pool.Release(last->message);
+				pool.Release(entry.message);
+				keptCount--;
+				removed += 2;
+				continue;
+			}
+			break;
+		case COLLAPSE_STEP:
+			// A step up and a step down do not cancel out when the first one was clamped
+			if(sameGroup && (last->collapse.amount > 0.0f) == (entry.collapse.amount > 0.0f))
+			{
+				last->collapse.amount += entry.collapse.amount;
+				last->rewritten = true;
+				pool.Release(entry.message);
+				removed++;
+				continue;
+			}
+			break;
+		case COLLAPSE_DUPLICATE:
+		{
+			// Look back over the whole run of duplicates, their order does not matter
+			bool duplicate = false;
+			for(unsigned int j=keptCount; j>0 && kept[j-1].collapse.kind == COLLAPSE_DUPLICATE && !duplicate; j--)
+				duplicate = kept[j-1].collapse.group == entry.collapse.group && IsSameText(kept[j-1].message, entry.message);
+			if(duplicate)
+			{
+				pool.Release(entry.message);
+				removed++;
+				continue;
+			}
+			break;
+		}
+		default:
+			break;
+		}
+		kept[keptCount++] = entry;
+	}
+
+	// Nothing could be collapsed, everything is still as it was
+	if(removed == 0) return false;
+
+	for(unsigned int i=0; i<keptCount; i++)
+	{
+		if(kept[i].rewritten) formatStep(kept[i].message, kept[i].collapse.group, kept[i].collapse.amount);
+		kept[i].rewritten = false;
+		entries[i] = kept[i];
+	}
+	head = 0;
+	count = keptCount;
+	stats.collapsed += removed;
+	return true;
+}
+
+bool CommandQueue::Push(Message* message, const CollapseInfo& collapse)
+{
+	CommandQueueEntry entry;
+	entry.message = message;
+	entry.collapse = collapse;
+	entry.rewritten = false;
+
+	lock.Lock();
+	bool ok = true;
+	if(count < MAX_MESSAGES)
+	{
+		entries[(head + count) % MAX_MESSAGES] = entry;
+		count++;
+	}
+	else ok = Collapse(entry);
+
+	if(!ok) stats.rejected++;
+	if(count > stats.peak) stats.peak = count;
+	lock.Unlock();
+	return ok;
+}
+
+Message* CommandQueue::Pop()
+{
+	Message* message = NULL;
+	lock.Lock();
+	if(count > 0)
+	{
+		message = entries[head].message;
+		head = (head + 1) % MAX_MESSAGES;
+		count--;
+	}
+	lock.Unlock();
+	return message;
+}
+
+bool CommandQueue::IsEmpty()
+{
+	lock.Lock();
+	bool empty = count == 0;
+	lock.Unlock();
+	return empty;
+}
+
+void CommandQueue::GetStats(CommandQueueStats* result)
+{
+	lock.Lock();
+	*result = stats;
+	result->depth = count;
+	lock.Unlock();
+}
+
+void CommandQueue::ResetStats()
+{
+	lock.Lock();
+	memset(&stats, 0, sizeof(stats));
+	stats.peak = count;
+	lock.Unlock();
+}
@@ -0,0 +1,91 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include "message.h"
+#include "platform.h"
+
+#include <stddef.h>
+
+typedef enum
+{
+	COLLAPSE_NONE = 0,
+	COLLAPSE_TOGGLE,   // Two in a row cancel out
+	COLLAPSE_STEP,     // Steps in a row in the same direction add up to one step
+	COLLAPSE_DUPLICATE // Repeating an identical message in a row has no effect
+} CollapseKind;
+
+// How a queued message may be collapsed with its neighbours, only messages of the same group collapse
+typedef struct
+{
+	CollapseKind kind;
+	unsigned int group;
+	float amount; // Signed size of a step
+} CollapseInfo;
+
+// Rewrites a message into a single step of its group by the given amount
+typedef void (*StepFormatter)(Message* message, unsigned int group, float amount);
+
+typedef struct
+{
+	unsigned int depth;      // Messages waiting right now
+	unsigned int peak;       // Most messages that were waiting at once
+	unsigned long collapsed; // Messages that were folded into a neighbour or cancelled out
+	unsigned long rejected;  // Messages that did not fit after collapsing
+} CommandQueueStats;
+
+typedef struct
+{
+	Message* message;
+	CollapseInfo collapse;
+	bool rewritten; // The amount of a step changed, the message must be formatted again
+} CommandQueueEntry;
+
+/*
+ * Bounded FIFO of messages waiting for the executor to run them. The queue holds at most a quarter of the
+ * pool, so the queues of both lanes and the messages waiting for their sender's tokens never starve the
+ * receive threads of buffers.
+ *
+ * When the queue is full, neighbouring messages that are redundant are collapsed first: toggles that
+ * cancel out are removed, steps in the same direction are folded into one step and repeated identical
+ * messages are removed. The outcome is the same as running them one by one, also when the steps are
+ * clamped to a range: steps in opposite directions are never folded, the clamp could make them differ. A message that still does
+ * not fit is refused and stays with the caller, collapsed messages are returned to the pool.
+ *
+ * Thread-safe.
+ */
+class CommandQueue
+{
+public:
+	static const unsigned int MAX_MESSAGES = MESSAGE_POOL_SIZE / 4;
+private:
+	Mutex lock;
+	MessagePool& pool;
+	StepFormatter formatStep;
+	CommandQueueEntry entries[MAX_MESSAGES];
+	unsigned int head;
+	unsigned int count;
+	CommandQueueStats stats;
+
+	bool Collapse(const CommandQueueEntry& incoming);
+public:
+	CommandQueue(MessagePool& pool, StepFormatter formatStep);
+	~CommandQueue(void);
+
+	// Returns false if the queue is full even after collapsing, the caller still owns the message
+	bool Push(Message* message, const CollapseInfo& collapse);
+	Message* Pop();
+	bool IsEmpty();
+
+	void GetStats(CommandQueueStats* result);
+	void ResetStats();
+};
+
+#endif
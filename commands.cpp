@@ -0,0 +1,190 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <string.h>
+
+#include "commands.h"
+
+CommandTable::CommandTable(void) :
+	commands(NULL),
+	count(0),
+	seed(0)
+{
+	memset(slots, EMPTY_SLOT, sizeof(slots));
+	memset(opcodes, EMPTY_SLOT, sizeof(opcodes));
+}
+
+CommandTable::~CommandTable(void)
+{
+}
+
+unsigned int CommandTable::Hash(const char* name, size_t length, unsigned int seed)
+{
+	// FNV-1a, the seed is mixed into the offset basis
+	unsigned int hash = 2166136261u ^ seed;
+	for(const unsigned char* c = (const unsigned char*)name; c != (const unsigned char*)name + length; c++)
+	{
+		hash ^= *c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+bool CommandTable::Fill(unsigned int seed, bool allowCollisions)
+{
+	memset(slots, EMPTY_SLOT, sizeof(slots));
+
+	for(size_t i=0; i<count; i++)
+	{
+		unsigned int slot = Hash(commands[i].name, strlen(commands[i].name), seed) & (TABLE_SIZE-1);
+		if(slots[slot] != EMPTY_SLOT)
+		{
+			if(!allowCollisions) return false;
+
+			// Linear probing, only used if no perfect seed could be found
+			while(slots[slot] != EMPTY_SLOT) slot = (slot+1) & (TABLE_SIZE-1);
+		}
+		slots[slot] = (unsigned char)i;
+	}
+
+	this->seed = seed;
+	return true;
+}
+
+bool CommandTable::Build(const CommandInfo* commands, size_t count)
+{
+	// The slot index must fit in a byte and leave room for the empty marker
+	if(count >= EMPTY_SLOT) return false;
+
+	this->commands = commands;
+	this->count = count;
+
+	// Every opcode must be unique
+	memset(opcodes, EMPTY_SLOT, sizeof(opcodes));
+	for(size_t i=0; i<count; i++)
+	{
+		unsigned int opcode = commands[i].opcode;
+		if(opcode == 0 || opcode >= MAX_OPCODES || opcodes[opcode] != EMPTY_SLOT) return false;
+		opcodes[opcode] = (unsigned char)i;
+	}
+
+	// Search for a seed that maps every command to its own slot
+	for(unsigned int seed=0; seed<MAX_SEED_ATTEMPTS; seed++)
+		if(Fill(seed, false)) return true;
+
+	// Fall back to probing, lookups stay correct but may need an extra compare
+	return Fill(0, true);
+}
+
+const CommandInfo* CommandTable::Find(const char* name, size_t length) const
+{
+	if(commands == NULL) return NULL;
+
+	for(unsigned int slot = Hash(name, length, seed) & (TABLE_SIZE-1); slots[slot] != EMPTY_SLOT; slot = (slot+1) & (TABLE_SIZE-1))
+	{
+		const CommandInfo* command = &commands[slots[slot]];
+		if(!strncmp(command->name, name, length) && command->name[length] == '\0') return command;
+	}
+
+	return NULL;
+}
+
+const CommandInfo* CommandTable::FindOpcode(unsigned int opcode) const
+{
+	if(commands == NULL || opcode >= MAX_OPCODES || opcodes[opcode] == EMPTY_SLOT) return NULL;
+	return &commands[opcodes[opcode]];
+}
+
+BindingTable::BindingTable(void)
+{
+	for(unsigned int i=0; i<MAX_BINDINGS; i++)
+	{
+		bindings[i].command = NULL;
+		bindings[i].version = 0;
+	}
+	for(int i=0; i<COMMAND_TARGET_COUNT; i++)
+		generations[i] = 0;
+}
+
+BindingTable::~BindingTable(void)
+{
+}
+
+bool BindingTable::Bind(unsigned int slot, const CommandInfo* command, const char* arg)
+{
+	if(slot >= MAX_BINDINGS || command == NULL) return false;
+
+	CommandBinding& binding = bindings[slot];
+	binding.command = command;
+	binding.version++;
+
+	// Store the argument, the scratch buffer is allocated once so triggering a binding does not allocate
+	size_t length = (arg != NULL) ? strlen(arg) : 0;
+	binding.arg.assign(arg, arg + length);
+	binding.arg.push_back('\0');
+	binding.scratch.resize(binding.arg.size());
+
+	// Nothing has been resolved yet
+	binding.scHandlerID = 0;
+	binding.generation = 0;
+	binding.target = 0;
+
+	return true;
+}
+
+void BindingTable::Unbind(unsigned int slot)
+{
+	if(slot >= MAX_BINDINGS) return;
+
+	bindings[slot].command = NULL;
+	bindings[slot].version++;
+	std::vector<char>().swap(bindings[slot].arg);
+	std::vector<char>().swap(bindings[slot].scratch);
+}
+
+void BindingTable::Clear()
+{
+	for(unsigned int i=0; i<MAX_BINDINGS; i++)
+		Unbind(i);
+}
+
+CommandBinding* BindingTable::Get(unsigned int slot)
+{
+	if(slot >= MAX_BINDINGS || bindings[slot].command == NULL) return NULL;
+	return &bindings[slot];
+}
+
+void BindingTable::Invalidate(CommandTarget target)
+{
+	// Called from the TeamSpeak event threads
+#ifdef _WIN32
+	InterlockedIncrement(&generations[target]);
+#else
+	__sync_fetch_and_add(&generations[target], 1);
+#endif
+}
+
+bool BindingTable::GetCachedTarget(const CommandBinding* binding, uint64 scHandlerID, uint64* target) const
+{
+	if(binding->target == 0 || binding->scHandlerID != scHandlerID) return false;
+	if(binding->generation != Generation(binding->command->target)) return false;
+
+	*target = binding->target;
+	return true;
+}
+
+void BindingTable::SetCachedTarget(CommandBinding* binding, uint64 scHandlerID, unsigned long generation, uint64 target)
+{
+	binding->scHandlerID = scHandlerID;
+	binding->generation = generation;
+	binding->target = target;
+}
@@ -0,0 +1,153 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include "public_definitions.h"
+#include "ack.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+typedef struct
+{
+	char* text;             // Raw argument, NULL if none was given
+	uint64 target;          // Resolved server, channel or client ID
+	bool hasNumber;         // Set if the argument arrived as a number, see GetNumberArg
+	float number;
+	ReturnCode* returnCode; // Return code for server requests, NULL if the sender does not want acknowledgements
+} CommandArgs;
+
+// Arguments that arrive already typed in a binary frame, they need no parsing or resolving
+typedef struct
+{
+	bool hasTarget;
+	uint64 target;
+	bool hasNumber;
+	float number;
+} TypedArgs;
+
+typedef void (*CommandHandler)(uint64 scHandlerID, const CommandArgs& args);
+typedef uint64 (*TargetResolver)(uint64 scHandlerID, char* arg);
+
+enum CommandFlags
+{
+	COMMAND_FLAG_NONE = 0,
+	COMMAND_FLAG_CONNECTION = 1 << 0, // Requires a connection to the active server
+	COMMAND_FLAG_ARGUMENT = 1 << 1,   // Requires a non-empty argument
+	COMMAND_FLAG_NUMBER = 1 << 2      // Requires a number, either as the argument or typed in a binary frame
+};
+
+/*
+ * How a command is scheduled on the executor. Latency critical commands run as soon as they arrive,
+ * slow lookups and navigation wait until nothing else is left to run.
+ */
+enum CommandLane
+{
+	COMMAND_LANE_HIGH = 0,
+	COMMAND_LANE_BACKGROUND,         // The target is resolved on the background thread while the high priority lane keeps running
+	COMMAND_LANE_BACKGROUND_UNLOCKED // As above, the handler does not touch plugin state and runs on the background thread too
+};
+
+// The kind of object a command argument is resolved to, cached resolutions are invalidated per kind
+enum CommandTarget
+{
+	COMMAND_TARGET_NONE = 0,
+	COMMAND_TARGET_SERVER,
+	COMMAND_TARGET_CHANNEL,
+	COMMAND_TARGET_CLIENT,
+	COMMAND_TARGET_COUNT
+};
+
+typedef struct
+{
+	unsigned int opcode;     // Identifies the command in binary frames, never reused
+	const char* name;
+	CommandHandler handler;
+	int flags;
+	CommandLane lane;
+	CommandTarget target;
+	TargetResolver resolver; // Turns the argument into a target ID, NULL if the command has no target
+} CommandInfo;
+
+typedef struct
+{
+	const CommandInfo* command;
+	unsigned long version;     // Incremented whenever the slot is rebound
+	std::vector<char> arg;     // The argument as it was bound, NULL-terminated
+	std::vector<char> scratch; // Copy of the argument handed to the command, resolvers may modify it
+
+	// Cached target resolution
+	uint64 scHandlerID;
+	unsigned long generation;
+	uint64 target;
+} CommandBinding;
+
+/*
+ * Hash table mapping command names to their handlers.
+ * The table is built once when the plugin is initialized, a seed is chosen so that no two commands
+ * share a slot. A lookup therefore costs one hash of the name and a single string compare.
+ */
+class CommandTable
+{
+private:
+	static const unsigned int TABLE_SIZE = 1024; // Must be a power of two
+	static const unsigned char EMPTY_SLOT = 0xFF;
+	static const unsigned int MAX_SEED_ATTEMPTS = 1024;
+public:
+	static const unsigned int MAX_OPCODES = 256;
+private:
+	const CommandInfo* commands;
+	size_t count;
+	unsigned int seed;
+	unsigned char slots[TABLE_SIZE];
+	unsigned char opcodes[MAX_OPCODES];
+
+	static unsigned int Hash(const char* name, size_t length, unsigned int seed);
+	bool Fill(unsigned int seed, bool allowCollisions);
+public:
+	CommandTable(void);
+	~CommandTable(void);
+
+	bool Build(const CommandInfo* commands, size_t count);
+	const CommandInfo* Find(const char* name, size_t length) const;
+	inline const CommandInfo* Find(const char* name) const { return Find(name, strlen(name)); }
+	const CommandInfo* FindOpcode(unsigned int opcode) const;
+};
+
+/*
+ * Commands bound to numbered slots. A binding is parsed once and its target is resolved on first use,
+ * the resolution is reused until an event invalidates the targets of that kind.
+ */
+class BindingTable
+{
+public:
+	static const unsigned int MAX_BINDINGS = 256;
+private:
+	CommandBinding bindings[MAX_BINDINGS];
+	volatile long generations[COMMAND_TARGET_COUNT];
+public:
+	BindingTable(void);
+	~BindingTable(void);
+
+	bool Bind(unsigned int slot, const CommandInfo* command, const char* arg);
+	void Unbind(unsigned int slot);
+	void Clear();
+	CommandBinding* Get(unsigned int slot);
+
+	// Target caching
+	void Invalidate(CommandTarget target);
+	inline unsigned long Generation(CommandTarget target) const { return (unsigned long)generations[target]; }
+	bool GetCachedTarget(const CommandBinding* binding, uint64 scHandlerID, uint64* target) const;
+	void SetCachedTarget(CommandBinding* binding, uint64 scHandlerID, unsigned long generation, uint64 target);
+};
+
+#endif
@@ -0,0 +1,310 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+#include "executor.h"
+#include "stats.h"
+
+#define EXECUTOR_MASK (EXECUTOR_CAPACITY - 1)
+
+static inline long ExecutorLoad(const volatile long* word)
+{
+#ifdef _WIN32
+	long value = *word;
+	_ReadWriteBarrier();
+	return value;
+#else
+	return __atomic_load_n(word, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void ExecutorStore(volatile long* word, long value)
+{
+#ifdef _WIN32
+	_ReadWriteBarrier();
+	*word = value;
+#else
+	__atomic_store_n(word, value, __ATOMIC_RELEASE);
+#endif
+}
+
+static inline bool ExecutorCompareExchange(volatile long* word, long expected, long value)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange(word, value, expected) == expected;
+#else
+	return __sync_bool_compare_and_swap(word, expected, value);
+#endif
+}
+
+static inline long ExecutorExchange(volatile long* word, long value)
+{
+#ifdef _WIN32
+	return InterlockedExchange(word, value);
+#else
+	long previous = __sync_lock_test_and_set(word, value);
+	__sync_synchronize();
+	return previous;
+#endif
+}
+
+static inline void ExecutorFence()
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+/*********************************** TaskQueue ************************************/
+
+TaskQueue::TaskQueue(void) :
+	tail(0),
+	head(0)
+{
+	// A slot is free for position p while its sequence is p, and holds a task for p while it is p+1
+	for(long i=0; i<EXECUTOR_CAPACITY; i++)
+	{
+		slots[i].sequence = i;
+		memset(&slots[i].task, 0, sizeof(ExecutorTask));
+	}
+}
+
+TaskQueue::~TaskQueue(void)
+{
+}
+
+bool TaskQueue::Push(const ExecutorTask& task)
+{
+	long position = ExecutorLoad(&tail);
+	Slot* slot;
+	while(true)
+	{
+		slot = &slots[position & EXECUTOR_MASK];
+		long difference = ExecutorLoad(&slot->sequence) - position;
+		if(difference == 0)
+		{
+			// The slot is free, claim it unless another producer was first
+			if(ExecutorCompareExchange(&tail, position, position + 1)) break;
+			position = ExecutorLoad(&tail);
+		}
+		else if(difference < 0) return false; // The consumer has not taken the task a lap ago yet
+		else position = ExecutorLoad(&tail);
+	}
+
+	slot->task = task;
+	ExecutorStore(&slot->sequence, position + 1);
+	return true;
+}
+
+bool TaskQueue::Pop(ExecutorTask* task)
+{
+	long position = head;
+	Slot* slot = &slots[position & EXECUTOR_MASK];
+	if(ExecutorLoad(&slot->sequence) != position + 1) return false;
+
+	*task = slot->task;
+	ExecutorStore(&slot->sequence, position + EXECUTOR_CAPACITY);
+	ExecutorStore(&head, position + 1);
+	return true;
+}
+
+bool TaskQueue::IsEmpty() const
+{
+	long position = ExecutorLoad(&head);
+	return ExecutorLoad(&slots[position & EXECUTOR_MASK].sequence) != position + 1;
+}
+
+/*********************************** Executor ************************************/
+
+Executor::Executor(void) :
+	sleeping(0),
+	droppedEvents(0),
+	wakeups(0)
+{
+#ifndef _WIN32
+	// The timer has a microsecond resolution, the event only waits in milliseconds
+	wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if(wakeFd == -1 || timerFd == -1)
+	{
+		if(wakeFd != -1) close(wakeFd);
+		if(timerFd != -1) close(timerFd);
+		wakeFd = timerFd = -1;
+	}
+#endif
+}
+
+Executor::~Executor(void)
+{
+#ifndef _WIN32
+	if(wakeFd != -1) close(wakeFd);
+	if(timerFd != -1) close(timerFd);
+#endif
+}
+
+void Executor::Signal()
+{
+#ifndef _WIN32
+	if(wakeFd != -1)
+	{
+		// The counter only overflows if the executor never reads it, the write fails then and it is awake anyway
+		uint64 one = 1;
+		if(write(wakeFd, &one, sizeof(one)) < 0) {}
+		return;
+	}
+#endif
+	event.Set();
+}
+
+bool Executor::Enqueue(TaskQueue& target, const ExecutorTask& task)
+{
+	if(!target.Push(task)) return false;
+
+	// Only wake the executor if it is going to sleep, the task must be visible before the flag is checked
+	ExecutorFence();
+	if(ExecutorLoad(&sleeping) && ExecutorExchange(&sleeping, 0)) Signal();
+	return true;
+}
+
+bool Executor::Post(const ExecutorTask& task)
+{
+	return Enqueue(queue, task);
+}
+
+bool Executor::Post(TaskProc proc, uint64 scHandlerID, unsigned int value)
+{
+	ExecutorTask task;
+	task.proc = proc;
+	task.message = NULL;
+	task.data = NULL;
+	task.scHandlerID = scHandlerID;
+	task.value = value;
+	return Enqueue(queue, task);
+}
+
+bool Executor::PostEvent(TaskProc proc, uint64 scHandlerID, unsigned int value, Message* message)
+{
+	ExecutorTask task;
+	task.proc = proc;
+	task.message = message;
+	task.data = NULL;
+	task.scHandlerID = scHandlerID;
+	task.value = value;
+	if(Enqueue(events, task)) return true;
+
+#ifdef _WIN32
+	InterlockedIncrement(&droppedEvents);
+#else
+	__sync_fetch_and_add(&droppedEvents, 1);
+#endif
+	return false;
+}
+
+unsigned long Executor::TakeDroppedEvents()
+{
+	if(ExecutorLoad(&droppedEvents) == 0) return 0;
+	return (unsigned long)ExecutorExchange(&droppedEvents, 0);
+}
+
+size_t Executor::RunPending()
+{
+	// At most a queue full of each per call, tasks that keep posting tasks cannot hold back the timers.
+	// Events go first, so a command sees the connections and reply lists as of when it runs.
+	size_t count = 0;
+	ExecutorTask task;
+	while(count < EXECUTOR_CAPACITY && events.Pop(&task))
+	{
+		task.proc(task);
+		count++;
+	}
+	while(count < 2 * EXECUTOR_CAPACITY && queue.Pop(&task))
+	{
+		task.proc(task);
+		count++;
+	}
+	return count;
+}
+
+void Executor::Wait(uint64 deadline)
+{
+	// Tell the producers we are going to sleep, then check once more so a task posted in between is not missed
+	ExecutorExchange(&sleeping, 1);
+	if(queue.IsEmpty() && events.IsEmpty())
+	{
+#ifndef _WIN32
+		if(wakeFd != -1)
+		{
+			// Arm the timer on the same clock as StatsNow, a zero value would disarm it instead
+			struct itimerspec spec;
+			memset(&spec, 0, sizeof(spec));
+			if(deadline != 0)
+			{
+				spec.it_value.tv_sec = (time_t)(deadline / 1000000);
+				spec.it_value.tv_nsec = (long)(deadline % 1000000) * 1000;
+				if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) spec.it_value.tv_nsec = 1;
+			}
+			timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, NULL);
+
+			struct pollfd fds[2];
+			fds[0].fd = wakeFd;
+			fds[0].events = POLLIN;
+			fds[1].fd = timerFd;
+			fds[1].events = POLLIN;
+			poll(fds, 2, -1);
+
+			// Both are non-blocking, reading one that did not fire does nothing
+			uint64 value;
+			if(read(wakeFd, &value, sizeof(value)) < 0) {}
+			if(read(timerFd, &value, sizeof(value)) < 0) {}
+		}
+		else
+#endif
+		{
+			unsigned long timeout = PLATFORM_INFINITE;
+			if(deadline != 0)
+			{
+				uint64 now = StatsNow();
+				timeout = (deadline > now) ? (unsigned long)((deadline - now + 999) / 1000) : 0;
+			}
+			event.Wait(timeout);
+		}
+		ExecutorStore(&wakeups, wakeups + 1);
+	}
+	ExecutorExchange(&sleeping, 0);
+}
+
+void Executor::Wake()
+{
+	Signal();
+}
+
+unsigned long Executor::Wakeups() const
+{
+	return (unsigned long)ExecutorLoad(&wakeups);
+}
+
+void Executor::Discard(MessagePool& pool)
+{
+	ExecutorTask task;
+	while(events.Pop(&task))
+		pool.Release(task.message);
+	while(queue.Pop(&task))
+		pool.Release(task.message);
+}
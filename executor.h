@@ -0,0 +1,118 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include "public_definitions.h"
+#include "message.h"
+#include "platform.h"
+
+#include <stddef.h>
+
+#define EXECUTOR_CAPACITY 256 // Tasks waiting at once, a power of two larger than the message pool
+
+typedef struct ExecutorTask ExecutorTask;
+typedef void (*TaskProc)(const ExecutorTask& task);
+
+// A unit of work for the executor thread, copied into the queue so posting never allocates
+struct ExecutorTask
+{
+	TaskProc proc;
+	Message* message;   // Owned by the task, NULL if none. Released if the task is discarded.
+	void* data;         // Not owned, must outlive the task
+	uint64 scHandlerID;
+	unsigned int value;
+};
+
+/*
+ * Bounded queue that any number of threads post to and a single thread takes from. Posting claims
+ * a slot with one compare-and-swap and never waits for the consumer or another producer, the slot
+ * sequence numbers tell the consumer when a task is complete.
+ */
+class TaskQueue
+{
+private:
+	typedef struct
+	{
+		volatile long sequence;
+		ExecutorTask task;
+	} Slot;
+
+	Slot slots[EXECUTOR_CAPACITY];
+	volatile long tail; // Claimed by the producers
+	volatile long head; // Only written by the consumer
+public:
+	TaskQueue(void);
+	~TaskQueue(void);
+
+	// Returns false if the queue is full
+	bool Push(const ExecutorTask& task);
+
+	// Consumer only
+	bool Pop(ExecutorTask* task);
+
+	// Only exact on the consumer thread
+	bool IsEmpty() const;
+};
+
+/*
+ * Runs every change to the plugin state on a single thread. Producers post tasks without blocking,
+ * the executor thread is only woken by a system call when it was sleeping.
+ *
+ * Events from the TeamSpeak callbacks have a queue of their own, a burst of them never takes the room
+ * of commands. Pending events run before the other tasks.
+ */
+class Executor
+{
+private:
+	TaskQueue queue;
+	TaskQueue events;
+	Event event;
+	volatile long sleeping;
+	volatile long droppedEvents; // Events that found their queue full since the executor last asked
+	volatile long wakeups;       // Times the executor slept and was woken
+#ifndef _WIN32
+	int wakeFd;  // eventfd the producers write to, -1 to fall back to the event
+	int timerFd; // timerfd armed with the deadline of the wait
+#endif
+
+	void Signal();
+	bool Enqueue(TaskQueue& target, const ExecutorTask& task);
+public:
+	Executor(void);
+	~Executor(void);
+
+	// Returns false if the queue is full, the caller still owns the message of the task
+	bool Post(const ExecutorTask& task);
+	bool Post(TaskProc proc, uint64 scHandlerID = 0, unsigned int value = 0);
+
+	// Called from the TeamSpeak callbacks, returns false if the event queue is full and the caller still owns the message.
+	// Dropped events are only counted, so a callback never has to wait for the log.
+	bool PostEvent(TaskProc proc, uint64 scHandlerID = 0, unsigned int value = 0, Message* message = NULL);
+
+	// Executor thread only, returns the events dropped since the last call
+	unsigned long TakeDroppedEvents();
+
+	// Executor thread only, runs the posted tasks and returns how many ran
+	size_t RunPending();
+	inline bool HasPending() const { return !queue.IsEmpty() || !events.IsEmpty(); }
+
+	// Executor thread only, sleeps until a task is posted, Wake is called or the deadline passes.
+	// The deadline is in microseconds, see StatsNow, 0 waits without one.
+	void Wait(uint64 deadline);
+	void Wake();
+
+	// Times the executor slept and was woken by a task, Wake or its deadline, from any thread
+	unsigned long Wakeups() const;
+
+	// Once the executor thread stopped, drops the tasks that were not run and releases their messages
+	void Discard(MessagePool& pool);
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <string.h>
+
+#include "frame.h"
+
+FrameReader::FrameReader(char* data, size_t length) :
+	data(data),
+	length(length),
+	offset(FRAME_HEADER_SIZE),
+	remaining(0),
+	failed(false)
+{
+	// Frames of another version are refused as a whole
+	if(!IsFrame(data, length) || (unsigned char)data[1] != FRAME_VERSION) failed = true;
+	else remaining = (unsigned char)data[2];
+}
+
+FrameReader::~FrameReader(void)
+{
+}
+
+bool FrameReader::Read(void* value, size_t size)
+{
+	if(length - offset < size)
+	{
+		failed = true;
+		return false;
+	}
+
+	// The fields are not aligned
+	memcpy(value, data + offset, size);
+	offset += size;
+	return true;
+}
+
+bool FrameReader::Next(FrameCommand* command)
+{
+	if(failed || remaining == 0) return false;
+	remaining--;
+
+	unsigned short opcode;
+	unsigned char flags, count;
+	if(!Read(&opcode, sizeof(opcode)) || !Read(&flags, sizeof(flags)) || !Read(&count, sizeof(count))) return false;
+
+	command->opcode = opcode;
+	command->hasServer = (flags & FRAME_COMMAND_SERVER) != 0;
+	command->server = (uint64)NULL;
+	command->text = NULL;
+	command->typed.hasTarget = false;
+	command->typed.target = (uint64)NULL;
+	command->typed.hasNumber = false;
+	command->typed.number = 0.0f;
+	strcpy(command->id, "-");
+
+	if(command->hasServer && !Read(&command->server, sizeof(command->server))) return false;
+
+	if(flags & FRAME_COMMAND_ACK_ID)
+	{
+		unsigned char idLength;
+		if(!Read(&idLength, sizeof(idLength))) return false;
+		if(idLength >= ACK_ID_BUFSIZE || !Read(command->id, idLength))
+		{
+			failed = true;
+			return false;
+		}
+		command->id[idLength] = '\0';
+	}
+
+	for(unsigned char i=0; i<count; i++)
+	{
+		unsigned char type;
+		if(!Read(&type, sizeof(type))) return false;
+
+		switch(type)
+		{
+		case FRAME_ARG_ID:
+			if(!Read(&command->typed.target, sizeof(command->typed.target))) return false;
+			command->typed.hasTarget = true;
+			break;
+		case FRAME_ARG_FLOAT:
+			if(!Read(&command->typed.number, sizeof(command->typed.number))) return false;
+			command->typed.hasNumber = true;
+			break;
+		case FRAME_ARG_STRING:
+		{
+			// The string is used in place, it must carry its own NULL-terminator
+			unsigned short stringLength;
+			if(!Read(&stringLength, sizeof(stringLength))) return false;
+			if(length - offset < (size_t)stringLength + 1 || data[offset + stringLength] != '\0')
+			{
+				failed = true;
+				return false;
+			}
+			command->text = data + offset;
+			offset += stringLength + 1;
+			break;
+		}
+		default:
+			failed = true;
+			return false;
+		}
+	}
+
+	return true;
+}
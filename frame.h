@@ -0,0 +1,90 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "public_definitions.h"
+#include "commands.h"
+#include "ack.h"
+
+#include <stddef.h>
+
+/*
+ * Binary command frames, accepted on every endpoint next to text messages. A frame starts with
+ * FRAME_MAGIC, a byte that never occurs in UTF-8 text. All values are little-endian.
+ *
+ * Frame:    u8 magic, u8 version, u8 command count, u8 sender (0 if anonymous)
+ * Command:  u16 opcode, u8 flags, u8 argument count,
+ *           [u64 server connection handler ID if FRAME_COMMAND_SERVER],
+ *           [u8 length, identifier if FRAME_COMMAND_ACK_ID],
+ *           arguments
+ * Argument: u8 type, then a u64 for FRAME_ARG_ID, a 32-bit float for FRAME_ARG_FLOAT, or
+ *           u16 length, the string and a NULL-terminator for FRAME_ARG_STRING
+ *
+ * The opcodes are listed in the command table, opcode 0 triggers the binding in the slot given
+ * as an ID argument. An ID argument is used as the resolved server, channel or client of the command.
+ */
+#define FRAME_MAGIC 0xFE
+#define FRAME_VERSION 1
+#define FRAME_HEADER_SIZE 4
+#define FRAME_SENDER_OFFSET 3
+
+#define FRAME_OPCODE_BINDING 0
+
+enum FrameCommandFlags
+{
+	FRAME_COMMAND_SERVER = 1 << 0, // Runs on the given server instead of the active one
+	FRAME_COMMAND_ACK_ID = 1 << 1  // Identifier for the acknowledgement
+};
+
+enum FrameArgType
+{
+	FRAME_ARG_ID = 1,
+	FRAME_ARG_FLOAT,
+	FRAME_ARG_STRING
+};
+
+typedef struct
+{
+	unsigned int opcode;
+	bool hasServer;
+	uint64 server;
+	char id[ACK_ID_BUFSIZE]; // "-" if the sender did not identify the command
+	char* text;              // Points into the frame, NULL if there was no string argument
+	TypedArgs typed;
+} FrameCommand;
+
+inline bool IsFrame(const char* data, size_t length)
+{
+	return length >= FRAME_HEADER_SIZE && (unsigned char)data[0] == FRAME_MAGIC;
+}
+
+/*
+ * Reads the commands from a frame without copying, string arguments are used in place.
+ */
+class FrameReader
+{
+private:
+	char* data;
+	size_t length;
+	size_t offset;
+	unsigned int remaining;
+	bool failed;
+
+	bool Read(void* value, size_t size);
+public:
+	FrameReader(char* data, size_t length);
+	~FrameReader(void);
+
+	// Returns false once all commands were read or the frame turned out to be malformed
+	bool Next(FrameCommand* command);
+	inline bool Failed() const { return failed; }
+};
+
+#endif
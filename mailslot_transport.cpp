@@ -0,0 +1,85 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+
+#include "mailslot_transport.h"
+
+MailslotTransport::MailslotTransport(void) :
+	hSlot(INVALID_HANDLE_VALUE)
+{
+}
+
+MailslotTransport::~MailslotTransport(void)
+{
+	Close();
+}
+
+bool MailslotTransport::Open()
+{
+	hSlot = CreateMailslot(NIFTYKB_MAILSLOT_PATH,
+		MESSAGE_BUFSIZE-1,				// leave room for the NULL-terminator
+		MAILSLOT_WAIT_FOREVER,
+		(LPSECURITY_ATTRIBUTES)NULL);	// default security
+
+	return hSlot != INVALID_HANDLE_VALUE;
+}
+
+void MailslotTransport::Close()
+{
+	if(hSlot != INVALID_HANDLE_VALUE) CloseHandle(hSlot);
+	hSlot = INVALID_HANDLE_VALUE;
+}
+
+TransportResult MailslotTransport::Receive(Message* message)
+{
+	DWORD messageBytesRead;
+
+	// Block until a message arrives
+	BOOL ok = ReadFile(hSlot,
+		message->data,
+		MESSAGE_BUFSIZE-1,
+		&messageBytesRead,
+		NULL); // not overlapped i/o
+
+	if(!ok) return TRANSPORT_ERROR;
+
+	// The sender is not required to include a NULL-terminator
+	message->length = messageBytesRead;
+	message->data[message->length] = (char)NULL;
+
+	// Mailslots do not tell who wrote a message
+	message->peer = 0;
+
+	// The wake up message is indistinguishable from a blank line, which is not a command either
+	if(messageBytesRead == 0 || (messageBytesRead == 1 && message->data[0] == '\n')) return TRANSPORT_WOKEN;
+	return TRANSPORT_MESSAGE;
+}
+
+TransportResult MailslotTransport::Poll(Message* message)
+{
+	// Only read when a message is waiting, so the read does not block
+	DWORD nextSize;
+	if(!GetMailslotInfo(hSlot, NULL, &nextSize, NULL, NULL)) return TRANSPORT_ERROR;
+	if(nextSize == MAILSLOT_NO_MESSAGE) return TRANSPORT_EMPTY;
+
+	return Receive(message);
+}
+
+void MailslotTransport::Wake()
+{
+	// Send a blank line to return the thread from its blocking read
+	HANDLE hFile = CreateFile(NIFTYKB_MAILSLOT_PATH, GENERIC_WRITE, FILE_SHARE_READ, (LPSECURITY_ATTRIBUTES)NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, (HANDLE)NULL);
+	if(hFile == INVALID_HANDLE_VALUE) return;
+
+	DWORD written;
+	WriteFile(hFile, "\n", 1, &written, NULL);
+	CloseHandle(hFile);
+}
+#endif
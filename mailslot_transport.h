@@ -0,0 +1,40 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef MAILSLOT_TRANSPORT_H
+#define MAILSLOT_TRANSPORT_H
+
+#ifdef _WIN32
+#include <Windows.h>
+
+#include "transport.h"
+
+#define NIFTYKB_MAILSLOT_PATH "\\\\.\\mailslot\\niftykb"
+
+/*
+ * Receives every mailslot message as one command message. Wake sends a blank line
+ * to our own mailslot, which is ignored.
+ */
+class MailslotTransport : public Transport
+{
+private:
+	HANDLE hSlot;
+public:
+	MailslotTransport(void);
+	~MailslotTransport(void);
+
+	bool Open();
+	void Close();
+	TransportResult Receive(Message* message);
+	TransportResult Poll(Message* message);
+	void Wake();
+	const char* Name() const { return NIFTYKB_MAILSLOT_PATH; }
+};
+#endif
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <string.h>
+
+#include "message.h"
+
+bool StringRefEquals(const StringRef& str, const char* value)
+{
+	return !strncmp(str.data, value, str.length) && value[str.length] == '\0';
+}
+
+MessagePool::MessagePool(void)
+{
+	for(int i=0; i<MESSAGE_POOL_SIZE; i++)
+		used[i] = 0;
+}
+
+MessagePool::~MessagePool(void)
+{
+}
+
+Message* MessagePool::Acquire()
+{
+	// Claim the first free buffer
+	for(int i=0; i<MESSAGE_POOL_SIZE; i++)
+	{
+#ifdef _WIN32
+		if(InterlockedCompareExchange(&used[i], 1, 0) == 0)
+#else
+		if(__sync_val_compare_and_swap(&used[i], 0, 1) == 0)
+#endif
+		{
+			messages[i].length = 0;
+			return &messages[i];
+		}
+	}
+	return NULL;
+}
+
+void MessagePool::Release(Message* message)
+{
+	if(message == NULL) return;
+
+#ifdef _WIN32
+	InterlockedExchange(&used[message - messages], 0);
+#else
+	__sync_lock_release(&used[message - messages]);
+#endif
+}
+
+Tokenizer::Tokenizer(char* str) :
+	pos((str != NULL) ? str : (char*)"")
+{
+}
+
+Tokenizer::~Tokenizer(void)
+{
+}
+
+bool Tokenizer::Next(StringRef* token)
+{
+	// Skip the separators
+	while(*pos == ' ') pos++;
+	if(*pos == '\0') return false;
+
+	if(*pos == '\"')
+	{
+		// Quoted token, runs until the closing quote
+		token->data = ++pos;
+		while(*pos != '\0' && *pos != '\"') pos++;
+		token->length = pos - token->data;
+		if(*pos == '\"') pos++;
+	}
+	else
+	{
+		token->data = pos;
+		while(*pos != '\0' && *pos != ' ') pos++;
+		token->length = pos - token->data;
+	}
+
+	return true;
+}
+
+char* Tokenizer::Rest()
+{
+	// Skip the separators
+	while(*pos == ' ') pos++;
+	if(*pos == '\0') return NULL;
+
+	// The remainder is used as a single value, remove the quotes if the whole value is quoted
+	char* rest = pos;
+	size_t length = strlen(rest);
+	pos += length;
+	if(length >= 2 && rest[0] == '\"' && rest[length-1] == '\"')
+	{
+		rest[length-1] = '\0';
+		rest++;
+	}
+
+	return rest;
+}
@@ -0,0 +1,72 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include "public_definitions.h"
+
+#include <stddef.h>
+
+#define MESSAGE_BUFSIZE 4096
+#define MESSAGE_POOL_SIZE 32
+#define MESSAGE_BATCH_SIZE 8 // Messages handled per wakeup of a thread
+#define MESSAGE_SENDER_BUFSIZE 48
+
+// Non-owning view of a string, it is not necessarily NULL-terminated
+typedef struct
+{
+	const char* data;
+	size_t length;
+} StringRef;
+
+bool StringRefEquals(const StringRef& str, const char* value);
+
+typedef struct
+{
+	char data[MESSAGE_BUFSIZE];
+	size_t length;
+	uint64 received; // Time of receipt in microseconds, see StatsNow
+	unsigned int peer; // Process ID of the sender if the endpoint knows it, 0 otherwise
+	char sender[MESSAGE_SENDER_BUFSIZE]; // Name of the sender, see IdentifySender
+} Message;
+
+/*
+ * Fixed set of message buffers that are reused for every received message, so receiving
+ * and parsing a message does not allocate. Buffers may be acquired from any thread.
+ */
+class MessagePool
+{
+private:
+	Message messages[MESSAGE_POOL_SIZE];
+	volatile long used[MESSAGE_POOL_SIZE];
+public:
+	MessagePool(void);
+	~MessagePool(void);
+
+	Message* Acquire();
+	void Release(Message* message);
+};
+
+/*
+ * Splits a command line into tokens without copying it. Tokens are separated by spaces,
+ * a token in double quotes may contain spaces.
+ */
+class Tokenizer
+{
+private:
+	char* pos;
+public:
+	Tokenizer(char* str);
+	~Tokenizer(void);
+
+	bool Next(StringRef* token);
+	char* Rest();
+};
+
+#endif
@@ -24,7 +24,6 @@
 #include "channel.h"
 
 #include <vector>
-#include <map>
 #include <string>
 #include <sstream>
 
@@ -33,11 +32,11 @@ bool NiftyKbFunctions::CheckAndLog(unsigned int returnCode, char* message)
 	if(returnCode != ERROR_ok)
 	{
 		char* errorMsg;
-		if(ts3Functions.getErrorMessage(returnCode, &errorMsg) == ERROR_ok)
+		if(clientFunctions->getErrorMessage(returnCode, &errorMsg) == ERROR_ok)
 		{
-			if(message != NULL) ts3Functions.logMessage(message, LogLevel_WARNING, "NiftyKb Plugin", 0);
-			ts3Functions.logMessage(errorMsg, LogLevel_WARNING, "NiftyKb Plugin", 0);
-			ts3Functions.freeMemory(errorMsg);
+			if(message != NULL) clientFunctions->logMessage(message, LogLevel_WARNING, "NiftyKb Plugin", 0);
+			clientFunctions->logMessage(errorMsg, LogLevel_WARNING, "NiftyKb Plugin", 0);
+			clientFunctions->freeMemory(errorMsg);
 			return true;
 		}
 	}
@@ -45,11 +44,7 @@ bool NiftyKbFunctions::CheckAndLog(unsigned int returnCode, char* message)
 }
 
 NiftyKbFunctions::NiftyKbFunctions(void) :
-	pttActive(false),
-	vadActive(false),
-	inputActive(false),
-	whisperActive(false),
-	replyActive(false)
+	batchDepth(0)
 {
 }
 
@@ -57,6 +52,73 @@ NiftyKbFunctions::~NiftyKbFunctions(void)
 {
 }
 
+void NiftyKbFunctions::ReadBaseline(ServerState* state)
+{
+	// Get the current VAD setting
+	char* vad;
+	if(!CheckAndLog(clientFunctions->getPreProcessorConfigValue(state->scHandlerID, "vad", &vad), "Error retrieving vad setting"))
+	{
+		state->vadActive = !strcmp(vad, "true");
+		clientFunctions->freeMemory(vad);
+	}
+
+	// Get the current input setting, this will indicate whether VAD is being used in combination with PTT
+	int input;
+	if(!CheckAndLog(clientFunctions->getClientSelfVariableAsInt(state->scHandlerID, CLIENT_INPUT_DEACTIVATED, &input), "Error retrieving input setting"))
+		state->inputActive = !input; // We want to know when it is active, not when it is inactive
+}
+
+ServerState* NiftyKbFunctions::GetServerState(uint64 scHandlerID)
+{
+	ServerState* state = FindServerState(scHandlerID);
+	if(state != NULL) return state;
+
+	// Commands may arrive for a connection that was established before the plugin started
+	AddServerState(scHandlerID);
+	return &servers.back();
+}
+
+ServerState* NiftyKbFunctions::FindServerState(uint64 scHandlerID)
+{
+	for(std::vector<ServerState>::iterator it=servers.begin(); it!=servers.end(); it++)
+		if(it->scHandlerID == scHandlerID) return &*it;
+	return NULL;
+}
+
+void NiftyKbFunctions::AddServerState(uint64 scHandlerID)
+{
+	if(FindServerState(scHandlerID) != NULL) return;
+
+	ServerState state;
+	state.scHandlerID = scHandlerID;
+	state.pttActive = false;
+	state.vadActive = false;
+	state.inputActive = false;
+	state.whisperActive = false;
+	state.replyActive = false;
+	ReadBaseline(&state);
+	servers.push_back(state);
+}
+
+void NiftyKbFunctions::RemoveServerState(uint64 scHandlerID)
+{
+	for(std::vector<ServerState>::iterator it=servers.begin(); it!=servers.end(); it++)
+	{
+		if(it->scHandlerID == scHandlerID)
+		{
+			servers.erase(it);
+			return;
+		}
+	}
+}
+
+void NiftyKbFunctions::RefreshServerState(uint64 scHandlerID)
+{
+	// While push-to-talk is held the client settings are ours, the baseline is read again once it is released
+	ServerState* state = GetServerState(scHandlerID);
+	if(!state->pttActive) ReadBaseline(state);
+}
+
 void NiftyKbFunctions::ErrorMessage(uint64 scHandlerID, char* message)
 {
 	// If an info icon has been found create a styled message
@@ -71,18 +133,84 @@ void NiftyKbFunctions::ErrorMessage(uint64 scHandlerID, char* message)
 		// Format and print the error message, use a transparent underscore because a double space will be collapsed
 		std::stringstream ss;
 		ss << "[img]" << infoIcon << "[/img][color=red]" << timeStr << "[color=transparent]_[/color]" << message << "[/color]";
-		ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+		clientFunctions->printMessageToCurrentTab(ss.str().c_str());
 	}
 	else
 	{
 		// Format a simplified styled error message
 		std::stringstream ss;
 		ss << "[color=red]" << message << "[/color]";
-		ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+		clientFunctions->printMessageToCurrentTab(ss.str().c_str());
 	}
 
 	// If an error sound has been found play it
-	if(!errorSound.empty()) CheckAndLog(ts3Functions.playWaveFile(scHandlerID, errorSound.c_str()), "Error playing error sound");
+	if(!errorSound.empty()) CheckAndLog(clientFunctions->playWaveFile(scHandlerID, errorSound.c_str()), "Error playing error sound");
+}
+
+bool NiftyKbFunctions::SetSelfVariableAsInt(uint64 scHandlerID, size_t flag, int value, char* message)
+{
+	// Skip the write if the value did not change, the server is not sent an update for it
+	int current;
+	if(clientFunctions->getClientSelfVariableAsInt(scHandlerID, flag, &current) == ERROR_ok && current == value)
+		return true;
+
+	if(CheckAndLog(clientFunctions->setClientSelfVariableAsInt(scHandlerID, flag, value), message))
+		return false;
+
+	FlushSelfUpdates(scHandlerID);
+	return true;
+}
+
+bool NiftyKbFunctions::SetSelfVariableAsString(uint64 scHandlerID, size_t flag, const char* value, char* message)
+{
+	// Skip the write if the value did not change, the server is not sent an update for it
+	char* current;
+	if(clientFunctions->getClientSelfVariableAsString(scHandlerID, flag, &current) == ERROR_ok)
+	{
+		bool unchanged = !strcmp(current, value);
+		clientFunctions->freeMemory(current);
+		if(unchanged) return true;
+	}
+
+	if(CheckAndLog(clientFunctions->setClientSelfVariableAsString(scHandlerID, flag, value), message))
+		return false;
+
+	FlushSelfUpdates(scHandlerID);
+	return true;
+}
+
+bool NiftyKbFunctions::FlushSelfUpdates(uint64 scHandlerID)
+{
+	// While a batch is running, mark the server dirty and flush once when the batch ends
+	if(batchDepth > 0)
+	{
+		for(std::vector<uint64>::iterator it=dirtyServers.begin(); it!=dirtyServers.end(); it++)
+			if(*it == scHandlerID) return true;
+
+		dirtyServers.push_back(scHandlerID);
+		return true;
+	}
+
+	return !CheckAndLog(clientFunctions->flushClientSelfUpdates(scHandlerID, NULL), "Error flushing client updates");
+}
+
+void NiftyKbFunctions::FlushPendingUpdates()
+{
+	for(std::vector<uint64>::iterator it=dirtyServers.begin(); it!=dirtyServers.end(); it++)
+		CheckAndLog(clientFunctions->flushClientSelfUpdates(*it, NULL), "Error flushing client updates");
+	dirtyServers.clear();
+}
+
+void NiftyKbFunctions::BeginBatch()
+{
+	batchDepth++;
+}
+
+void NiftyKbFunctions::EndBatch(bool flush)
+{
+	// A nested batch still flushes when it ends so its updates are not held back by the outer batch
+	if(batchDepth > 0) batchDepth--;
+	if(flush) FlushPendingUpdates();
 }
 
 uint64 NiftyKbFunctions::GetActiveServerConnectionHandlerID()
@@ -91,23 +219,41 @@ uint64 NiftyKbFunctions::GetActiveServerConnectionHandlerID()
 	uint64* server;
 	uint64 handle = NULL;
 
-	if(CheckAndLog(ts3Functions.getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
+	if(CheckAndLog(clientFunctions->getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
 		return NULL;
 
 	// Find the first server that matches the criteria
 	for(server = servers; *server != (uint64)NULL && handle == NULL; server++)
 	{
 		int result;
-		if(!CheckAndLog(ts3Functions.getClientSelfVariableAsInt(*server, CLIENT_INPUT_HARDWARE, &result), "Error retrieving client variable"))
+		if(!CheckAndLog(clientFunctions->getClientSelfVariableAsInt(*server, CLIENT_INPUT_HARDWARE, &result), "Error retrieving client variable"))
 		{
 			if(result) handle = *server;
 		}
 	}
 
-	ts3Functions.freeMemory(servers);
+	clientFunctions->freeMemory(servers);
 	return handle;
 }
 
+bool NiftyKbFunctions::IsServerConnectionHandler(uint64 scHandlerID)
+{
+	uint64* servers;
+	uint64* server;
+	bool found = false;
+
+	if(CheckAndLog(clientFunctions->getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
+		return false;
+
+	for(server = servers; *server != (uint64)NULL && !found; server++)
+	{
+		if(*server == scHandlerID) found = true;
+	}
+
+	clientFunctions->freeMemory(servers);
+	return found;
+}
+
 uint64 NiftyKbFunctions::GetServerHandleByVariable(char* value, size_t flag)
 {
 	char* variable;
@@ -115,21 +261,21 @@ uint64 NiftyKbFunctions::GetServerHandleByVariable(char* value, size_t flag)
 	uint64* server;
 	uint64 result;
 
-	if(CheckAndLog(ts3Functions.getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
+	if(CheckAndLog(clientFunctions->getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
 		return (uint64)NULL;
 
 	// Find the first server that matches the criteria
 	for(server = servers, result = (uint64)NULL; *server != (uint64)NULL && result == (uint64)NULL; server++)
 	{
-		if(!CheckAndLog(ts3Functions.getServerVariableAsString(*server, flag, &variable), "Error retrieving server variable"))
+		if(!CheckAndLog(clientFunctions->getServerVariableAsString(*server, flag, &variable), "Error retrieving server variable"))
 		{
 			// If the variable matches the value set the result, this will end the loop
 			if(!strcmp(value, variable)) result = *server;
-			ts3Functions.freeMemory(variable);
+			clientFunctions->freeMemory(variable);
 		}
 	}
 
-	ts3Functions.freeMemory(servers);
+	clientFunctions->freeMemory(servers);
 	return result;
 }
 
@@ -140,21 +286,21 @@ uint64 NiftyKbFunctions::GetChannelIDByVariable(uint64 scHandlerID, char* value,
 	uint64* channel;
 	uint64 result;
 
-	if(CheckAndLog(ts3Functions.getChannelList(scHandlerID, &channels), "Error retrieving list of channels"))
+	if(CheckAndLog(clientFunctions->getChannelList(scHandlerID, &channels), "Error retrieving list of channels"))
 		return (uint64)NULL;
 
 	// Find the first channel that matches the criteria
 	for(channel = channels, result = (uint64)NULL; *channel != (uint64)NULL && result == NULL; channel++)
 	{
-		if(!CheckAndLog(ts3Functions.getChannelVariableAsString(scHandlerID, *channel, flag, &variable), "Error retrieving channel variable"))
+		if(!CheckAndLog(clientFunctions->getChannelVariableAsString(scHandlerID, *channel, flag, &variable), "Error retrieving channel variable"))
 		{
 			// If the variable matches the value set the result, this will end the loop
 			if(!strcmp(value, variable)) result = *channel;
-			ts3Functions.freeMemory(variable);
+			clientFunctions->freeMemory(variable);
 		}
 	}
 
-	ts3Functions.freeMemory(channels);
+	clientFunctions->freeMemory(channels);
 	return result;
 }
 
@@ -165,117 +311,100 @@ anyID NiftyKbFunctions::GetClientIDByVariable(uint64 scHandlerID, char* value, s
 	anyID* client;
 	anyID result;
 
-	if(CheckAndLog(ts3Functions.getClientList(scHandlerID, &clients), "Error retrieving list of clients"))
+	if(CheckAndLog(clientFunctions->getClientList(scHandlerID, &clients), "Error retrieving list of clients"))
 		return (anyID)NULL;
 
 	// Find the first client that matches the criteria
 	for(client = clients, result = (anyID)NULL; *client != (uint64)NULL && result == (anyID)NULL; client++)
 	{
-		if(!CheckAndLog(ts3Functions.getClientVariableAsString(scHandlerID, *client, flag, &variable), "Error retrieving client variable"))
+		if(!CheckAndLog(clientFunctions->getClientVariableAsString(scHandlerID, *client, flag, &variable), "Error retrieving client variable"))
 		{
 			// If the variable matches the value set the result, this will end the loop
 			if(!strcmp(value, variable)) result = *client;
-			ts3Functions.freeMemory(variable);
+			clientFunctions->freeMemory(variable);
 		}
 	}
 
-	ts3Functions.freeMemory(clients);
+	clientFunctions->freeMemory(clients);
 	return result;
 }
 
 bool NiftyKbFunctions::SetPushToTalk(uint64 scHandlerID, bool shouldTalk)
 {
-	// If PTT is inactive, store the current settings
-	if(!pttActive)
+	// The baseline of the server tells what has to change. The client does not report every change of the
+	// voice activation and input settings, so a press reads it again and the release restores what it found.
+	ServerState* state = GetServerState(scHandlerID);
+	if(state->pttActive == shouldTalk) return true;
+	if(shouldTalk) ReadBaseline(state);
+
+	// If VAD is active and the input is active, disable VAD, restore VAD setting afterwards
+	if(state->vadActive)
 	{
-		// Get the current VAD setting
-		char* vad;
-		if(CheckAndLog(ts3Functions.getPreProcessorConfigValue(scHandlerID, "vad", &vad), "Error retrieving vad setting"))
+		if(CheckAndLog(clientFunctions->setPreProcessorConfigValue(scHandlerID, "vad",
+			(shouldTalk && state->inputActive) ? "false" : "true"), "Error toggling vad"))
 			return false;
-		vadActive = !strcmp(vad, "true");
-		ts3Functions.freeMemory(vad);
+	}
 
-		// Get the current input setting, this will indicate whether VAD is being used in combination with PTT
-		int input;
-		if(CheckAndLog(ts3Functions.getClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED, &input), "Error retrieving input setting"))
+	// Activate the input, restore the input setting afterwards. The input is not sent to the server.
+	if(!state->inputActive)
+	{
+		if(CheckAndLog(clientFunctions->setClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED,
+			shouldTalk ? INPUT_ACTIVE : INPUT_DEACTIVATED), "Error toggling input"))
 			return false;
-		inputActive = !input; // We want to know when it is active, not when it is inactive
+		FlushSelfUpdates(scHandlerID);
 	}
 
-	// If VAD is active and the input is active, disable VAD, restore VAD setting afterwards
-	if(CheckAndLog(ts3Functions.setPreProcessorConfigValue(scHandlerID, "vad",
-		(shouldTalk && (vadActive && inputActive)) ? "false" : (vadActive)?"true":"false"), "Error toggling vad"))
-		return false;
-
-	// Activate the input, restore the input setting afterwards
-	if(CheckAndLog(ts3Functions.setClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED,
-		(shouldTalk || inputActive) ? INPUT_ACTIVE : INPUT_DEACTIVATED), "Error toggling input"))
-		return false;
-
-	// Update the client
-	ts3Functions.flushClientSelfUpdates(scHandlerID, NULL);
-
 	// Commit the change
-	pttActive = shouldTalk;
+	state->pttActive = shouldTalk;
 
 	return true;
 }
 
 bool NiftyKbFunctions::SetVoiceActivation(uint64 scHandlerID, bool shouldActivate)
 {
+	ServerState* state = GetServerState(scHandlerID);
+
 	// Activate Voice Activity Detection
-	if(CheckAndLog(ts3Functions.setPreProcessorConfigValue(scHandlerID, "vad", (shouldActivate && !pttActive)?"true":"false"), "Error toggling vad"))
+	if(CheckAndLog(clientFunctions->setPreProcessorConfigValue(scHandlerID, "vad", (shouldActivate && !state->pttActive)?"true":"false"), "Error toggling vad"))
 		return false;
 
 	// Activate the input, restore the input setting afterwards
-	if(CheckAndLog(ts3Functions.setClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED,
-		(shouldActivate) ? INPUT_ACTIVE : INPUT_DEACTIVATED), "Error toggling input"))
+	if(!SetSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED,
+		(shouldActivate) ? INPUT_ACTIVE : INPUT_DEACTIVATED, "Error toggling input"))
 		return false;
 
-	// Update the client
-	ts3Functions.flushClientSelfUpdates(scHandlerID, NULL);
-
 	// Commit the change
-	vadActive = shouldActivate;
-	inputActive = shouldActivate;
+	state->vadActive = shouldActivate;
+	state->inputActive = shouldActivate;
 
 	return true;
 }
 
 bool NiftyKbFunctions::SetContinuousTransmission(uint64 scHandlerID, bool shouldActivate)
 {
+	ServerState* state = GetServerState(scHandlerID);
+
 	// Activate the input, restore the input setting afterwards
-	if(CheckAndLog(ts3Functions.setClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED,
-		(shouldActivate || pttActive) ? INPUT_ACTIVE : INPUT_DEACTIVATED), "Error toggling input"))
+	if(!SetSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED,
+		(shouldActivate || state->pttActive) ? INPUT_ACTIVE : INPUT_DEACTIVATED, "Error toggling input"))
 		return false;
 
-	// Update the client
-	ts3Functions.flushClientSelfUpdates(scHandlerID, NULL);
-
 	// Commit the change
-	inputActive = shouldActivate;
+	state->inputActive = shouldActivate;
 
 	return true;
 }
 
 bool NiftyKbFunctions::SetInputMute(uint64 scHandlerID, bool shouldMute)
 {
-	if(CheckAndLog(ts3Functions.setClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_MUTED,
-		shouldMute ? INPUT_DEACTIVATED : INPUT_ACTIVE), "Error toggling input mute"))
-		return false;
-
-	ts3Functions.flushClientSelfUpdates(scHandlerID, NULL);
-	return true;
+	return SetSelfVariableAsInt(scHandlerID, CLIENT_INPUT_MUTED,
+		shouldMute ? INPUT_DEACTIVATED : INPUT_ACTIVE, "Error toggling input mute");
 }
 
 bool NiftyKbFunctions::SetOutputMute(uint64 scHandlerID, bool shouldMute)
 {
-	if(CheckAndLog(ts3Functions.setClientSelfVariableAsInt(scHandlerID, CLIENT_OUTPUT_MUTED,
-		shouldMute ? INPUT_DEACTIVATED : INPUT_ACTIVE), "Error toggling output mute"))
-		return false;
-
-	ts3Functions.flushClientSelfUpdates(scHandlerID, NULL);
-	return true;
+	return SetSelfVariableAsInt(scHandlerID, CLIENT_OUTPUT_MUTED,
+		shouldMute ? INPUT_DEACTIVATED : INPUT_ACTIVE, "Error toggling output mute");
 }
 
 bool NiftyKbFunctions::SetGlobalAway(bool isAway, char* msg)
@@ -284,7 +413,7 @@ bool NiftyKbFunctions::SetGlobalAway(bool isAway, char* msg)
 	uint64 handle;
 	int i;
 
-	if(CheckAndLog(ts3Functions.getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
+	if(CheckAndLog(clientFunctions->getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
 		return false;
 
 	handle = servers[0];
@@ -294,30 +423,27 @@ bool NiftyKbFunctions::SetGlobalAway(bool isAway, char* msg)
 		handle = servers[i];
 	}
 
-	ts3Functions.freeMemory(servers);
+	clientFunctions->freeMemory(servers);
 	return true;
 }
 
 bool NiftyKbFunctions::SetAway(uint64 scHandlerID, bool isAway, char* msg)
 {
-	if(CheckAndLog(ts3Functions.setClientSelfVariableAsInt(scHandlerID, CLIENT_AWAY,
-		isAway ? AWAY_ZZZ : AWAY_NONE), "Error setting away status"))
+	if(!SetSelfVariableAsInt(scHandlerID, CLIENT_AWAY,
+		isAway ? AWAY_ZZZ : AWAY_NONE, "Error setting away status"))
 		return false;
 
-	if(CheckAndLog(ts3Functions.setClientSelfVariableAsString(scHandlerID, CLIENT_AWAY_MESSAGE, isAway && msg != NULL ? msg : ""), "Error setting away message"))
-		return false;
-
-	return CheckAndLog(ts3Functions.flushClientSelfUpdates(scHandlerID, NULL), "Error flushing after setting away status");
+	return SetSelfVariableAsString(scHandlerID, CLIENT_AWAY_MESSAGE, isAway && msg != NULL ? msg : "", "Error setting away message");
 }
 
-bool NiftyKbFunctions::JoinChannel(uint64 scHandlerID, uint64 channel)
+bool NiftyKbFunctions::JoinChannel(uint64 scHandlerID, uint64 channel, const char* returnCode)
 {
 	anyID self;
 
-	if(CheckAndLog(ts3Functions.getClientID(scHandlerID, &self), "Error getting own client id"))
+	if(CheckAndLog(clientFunctions->getClientID(scHandlerID, &self), "Error getting own client id"))
 		return false;
 
-	if(CheckAndLog(ts3Functions.requestClientMove(scHandlerID, self, channel, "", NULL), "Error joining channel"))
+	if(CheckAndLog(clientFunctions->requestClientMove(scHandlerID, self, channel, "", returnCode), "Error joining channel"))
 		return false;
 
 	return true;
@@ -325,35 +451,42 @@ bool NiftyKbFunctions::JoinChannel(uint64 scHandlerID, uint64 channel)
 
 bool NiftyKbFunctions::SetWhisperList(uint64 scHandlerID, bool shouldWhisper)
 {
-	WhisperIterator list;
+	ServerState* state = GetServerState(scHandlerID);
+	WhisperList& list = state->whisperList;
 
 	if(shouldWhisper)
 	{
-		list = whisperLists.find(scHandlerID);
-		if(list == whisperLists.end()) shouldWhisper = false;
+		if(list.clients.empty() && list.channels.empty()) shouldWhisper = false;
 		else
 		{
 			// Add the NULL-terminator
-			list->second.clients.push_back((anyID)NULL);
-			list->second.channels.push_back((uint64)NULL);
+			list.clients.push_back((anyID)NULL);
+			list.channels.push_back((uint64)NULL);
 		}
 	}
 
 	/*
 	 * For efficiency purposes I will violate the vector abstraction and give a direct pointer to its internal C array
 	 */
-	if(CheckAndLog(ts3Functions.requestClientSetWhisperList(scHandlerID, (anyID)NULL, shouldWhisper?&list->second.channels[0]:(uint64*)NULL, shouldWhisper?&list->second.clients[0]:(anyID*)NULL, NULL), "Error setting whisper list"))
+	if(CheckAndLog(clientFunctions->requestClientSetWhisperList(scHandlerID, (anyID)NULL, shouldWhisper?&list.channels[0]:(uint64*)NULL, shouldWhisper?&list.clients[0]:(anyID*)NULL, NULL), "Error setting whisper list"))
+	{
+		if(shouldWhisper)
+		{
+			list.clients.pop_back();
+			list.channels.pop_back();
+		}
 		return false;
+	}
 
 	if(shouldWhisper)
 	{
 		// Remove the NULL-terminator
-		list->second.clients.pop_back();
-		list->second.channels.pop_back();
+		list.clients.pop_back();
+		list.channels.pop_back();
 	}
 
-	ts3Functions.flushClientSelfUpdates(scHandlerID, NULL);
-	whisperActive = shouldWhisper;
+	FlushSelfUpdates(scHandlerID);
+	state->whisperActive = shouldWhisper;
 
 	return true;
 }
@@ -361,74 +494,78 @@ bool NiftyKbFunctions::SetWhisperList(uint64 scHandlerID, bool shouldWhisper)
 void NiftyKbFunctions::WhisperListClear(uint64 scHandlerID)
 {
 	SetWhisperList(scHandlerID, false);
-	whisperLists.erase(scHandlerID);
+
+	ServerState* state = GetServerState(scHandlerID);
+	state->whisperList.clients.clear();
+	state->whisperList.channels.clear();
 }
 
 void NiftyKbFunctions::WhisperAddClient(uint64 scHandlerID, anyID client)
 {
-	// Find the whisperlist, create it if it doesn't exist
-	std::pair<WhisperIterator,bool> result = whisperLists.insert(std::pair<uint64,WhisperList>(scHandlerID, WhisperList()));
-	WhisperIterator list = result.first;
+	ServerState* state = GetServerState(scHandlerID);
+	std::vector<anyID>& clients = state->whisperList.clients;
 
 	/*
 	 * Do not add if duplicate. I could use a set, but that would be inefficient as
 	 * ordering is unimportant and it would require me to convert to C arrays when
 	 * activating the whisper list.
 	 */
-	for(std::vector<anyID>::iterator it=list->second.clients.begin(); it!=list->second.clients.end(); it++)
+	for(std::vector<anyID>::iterator it=clients.begin(); it!=clients.end(); it++)
 		if(*it == client) return;
 
-	list->second.clients.push_back(client);
-	if(whisperActive) SetWhisperList(scHandlerID, true);
+	clients.push_back(client);
+	if(state->whisperActive) SetWhisperList(scHandlerID, true);
 }
 
 void NiftyKbFunctions::WhisperAddChannel(uint64 scHandlerID, uint64 channel)
 {
-	// Find the whisperlist, create it if it doesn't exist
-	std::pair<WhisperIterator,bool> result = whisperLists.insert(std::pair<uint64,WhisperList>(scHandlerID, WhisperList()));
-	WhisperIterator list = result.first;
+	ServerState* state = GetServerState(scHandlerID);
+	std::vector<uint64>& channels = state->whisperList.channels;
 
 	/*
 	 * Do not add if duplicate. I could use a set, but that would be inefficient as
 	 * ordering is unimportant and it would require me to convert to C arrays when
 	 * activating the whisper list.
 	 */
-	for(std::vector<uint64>::iterator it=list->second.channels.begin(); it!=list->second.channels.end(); it++)
+	for(std::vector<uint64>::iterator it=channels.begin(); it!=channels.end(); it++)
 		if(*it == channel) return;
 
-	list->second.channels.push_back(channel);
-	if(whisperActive) SetWhisperList(scHandlerID, true);
+	channels.push_back(channel);
+	if(state->whisperActive) SetWhisperList(scHandlerID, true);
 }
 
 bool NiftyKbFunctions::SetReplyList(uint64 scHandlerID, bool shouldReply)
 {
-	ReplyIterator list;
+	ServerState* state = GetServerState(scHandlerID);
+	std::vector<anyID>& list = state->replyList;
 
 	if(shouldReply)
 	{
-		list = replyLists.find(scHandlerID);
-		if(list == replyLists.end()) shouldReply = false;
+		if(list.empty()) shouldReply = false;
 		else
 		{
 			// Add the NULL-terminator
-			list->second.push_back((anyID)NULL);
+			list.push_back((anyID)NULL);
 		}
 	}
 
 	/*
 	 * For efficiency I will violate the vector abstraction and give a direct pointer to its internal C array
 	 */
-	if(CheckAndLog(ts3Functions.requestClientSetWhisperList(scHandlerID, (anyID)NULL, NULL, shouldReply?&list->second[0]:(anyID*)NULL, NULL), "Error setting reply list"))
+	if(CheckAndLog(clientFunctions->requestClientSetWhisperList(scHandlerID, (anyID)NULL, NULL, shouldReply?&list[0]:(anyID*)NULL, NULL), "Error setting reply list"))
+	{
+		if(shouldReply) list.pop_back();
 		return false;
+	}
 
 	if(shouldReply)
 	{
 		// Remove the NULL-terminator
-		list->second.pop_back();
+		list.pop_back();
 	}
 
-	ts3Functions.flushClientSelfUpdates(scHandlerID, NULL);
-	replyActive = shouldReply;
+	FlushSelfUpdates(scHandlerID);
+	state->replyActive = shouldReply;
 
 	if(!shouldReply) return SetWhisperList(scHandlerID, true);
 	return true;
@@ -437,56 +574,55 @@ bool NiftyKbFunctions::SetReplyList(uint64 scHandlerID, bool shouldReply)
 void NiftyKbFunctions::ReplyListClear(uint64 scHandlerID)
 {
 	SetReplyList(scHandlerID, false);
-	replyLists.erase(scHandlerID);
+	GetServerState(scHandlerID)->replyList.clear();
 }
 
 void NiftyKbFunctions::ReplyAddClient(uint64 scHandlerID, anyID client)
 {
-	// Find the whisperlist, create it if it doesn't exist
-	std::pair<ReplyIterator,bool> result = replyLists.insert(std::pair<uint64,std::vector<anyID>>(scHandlerID, std::vector<anyID>()));
-	ReplyIterator list = result.first;
+	ServerState* state = GetServerState(scHandlerID);
+	std::vector<anyID>& list = state->replyList;
 
 	/*
 	 * Do not add if duplicate. I could use a set, but that would be inefficient as
 	 * ordering is unimportant and it would require me to convert to C arrays when
 	 * activating the whisper list.
 	 */
-	for(std::vector<anyID>::iterator it=list->second.begin(); it!=list->second.end(); it++)
+	for(std::vector<anyID>::iterator it=list.begin(); it!=list.end(); it++)
 		if(*it == client) return;
 
-	list->second.push_back(client);
-	if(replyActive) SetReplyList(scHandlerID, true);
+	list.push_back(client);
+	if(state->replyActive) SetReplyList(scHandlerID, true);
 }
 
 bool NiftyKbFunctions::SetActiveServer(uint64 handle)
 {
-	return CheckAndLog(ts3Functions.activateCaptureDevice(handle), "Error activating server");
+	return CheckAndLog(clientFunctions->activateCaptureDevice(handle), "Error activating server");
 }
 
-bool NiftyKbFunctions::MuteClient(uint64 scHandlerID, anyID client)
+bool NiftyKbFunctions::MuteClient(uint64 scHandlerID, anyID client, const char* returnCode)
 {
-	if(CheckAndLog(ts3Functions.requestMuteClients(scHandlerID, &client, NULL), "Error muting client"))
+	if(CheckAndLog(clientFunctions->requestMuteClients(scHandlerID, &client, returnCode), "Error muting client"))
 		return false;
 
-	return CheckAndLog(ts3Functions.requestClientVariables(scHandlerID, client, NULL), "Error flushing after muting client");
+	return CheckAndLog(clientFunctions->requestClientVariables(scHandlerID, client, NULL), "Error flushing after muting client");
 }
 
-bool NiftyKbFunctions::UnmuteClient(uint64 scHandlerID, anyID client)
+bool NiftyKbFunctions::UnmuteClient(uint64 scHandlerID, anyID client, const char* returnCode)
 {
-	if(CheckAndLog(ts3Functions.requestUnmuteClients(scHandlerID, &client, NULL), "Error unmuting client"))
+	if(CheckAndLog(clientFunctions->requestUnmuteClients(scHandlerID, &client, returnCode), "Error unmuting client"))
 		return false;
 
-	return CheckAndLog(ts3Functions.requestClientVariables(scHandlerID, client, NULL), "Error flushing after unmuting client");
+	return CheckAndLog(clientFunctions->requestClientVariables(scHandlerID, client, NULL), "Error flushing after unmuting client");
 }
 
-bool NiftyKbFunctions::ServerKickClient(uint64 scHandlerID, anyID client)
+bool NiftyKbFunctions::ServerKickClient(uint64 scHandlerID, anyID client, const char* returnCode)
 {
-	return CheckAndLog(ts3Functions.requestClientKickFromServer(scHandlerID, client, "", NULL), "Error kicking client from server");
+	return CheckAndLog(clientFunctions->requestClientKickFromServer(scHandlerID, client, "", returnCode), "Error kicking client from server");
 }
 
-bool NiftyKbFunctions::ChannelKickClient(uint64 scHandlerID, anyID client)
+bool NiftyKbFunctions::ChannelKickClient(uint64 scHandlerID, anyID client, const char* returnCode)
 {
-	return CheckAndLog(ts3Functions.requestClientKickFromChannel(scHandlerID, client, "", NULL), "Error kicking client from channel");
+	return CheckAndLog(clientFunctions->requestClientKickFromChannel(scHandlerID, client, "", returnCode), "Error kicking client from channel");
 }
 
 bool NiftyKbFunctions::SetMasterVolume(uint64 scHandlerID, float value)
@@ -497,10 +633,10 @@ bool NiftyKbFunctions::SetMasterVolume(uint64 scHandlerID, float value)
 	if(value > 20.0) value = 20.0;
 
 	snprintf(str, 6, "%.1f", value);
-	return CheckAndLog(ts3Functions.setPlaybackConfigValue(scHandlerID, "volume_modifier", str), "Error setting master volume");
+	return CheckAndLog(clientFunctions->setPlaybackConfigValue(scHandlerID, "volume_modifier", str), "Error setting master volume");
 }
 
-bool NiftyKbFunctions::JoinChannelRelative(uint64 scHandlerID, bool next)
+bool NiftyKbFunctions::JoinChannelRelative(uint64 scHandlerID, bool next, const char* returnCode)
 {
 	anyID self;
 	uint64 ownId;
@@ -510,10 +646,10 @@ bool NiftyKbFunctions::JoinChannelRelative(uint64 scHandlerID, bool next)
 	if(Channel::GetChannelHierarchy(scHandlerID, &root) != 0) return false;
 
 	// Get own channel
-	if(CheckAndLog(ts3Functions.getClientID(scHandlerID, &self), "Error getting own client id"))
+	if(CheckAndLog(clientFunctions->getClientID(scHandlerID, &self), "Error getting own client id"))
 		return false;
 
-	if(CheckAndLog(ts3Functions.getChannelOfClient(scHandlerID, self, &ownId), "Error getting own channel id"))
+	if(CheckAndLog(clientFunctions->getChannelOfClient(scHandlerID, self, &ownId), "Error getting own channel id"))
 		return false;
 
 	// Find own channel in hierarchy
@@ -533,13 +669,13 @@ bool NiftyKbFunctions::JoinChannelRelative(uint64 scHandlerID, bool next)
 
 		// If this channel is passworded, join the next
 		int pswd;
-		CheckAndLog(ts3Functions.getChannelVariableAsInt(scHandlerID, channel->id, CHANNEL_FLAG_PASSWORD, &pswd), "Error getting channel info");
+		CheckAndLog(clientFunctions->getChannelVariableAsInt(scHandlerID, channel->id, CHANNEL_FLAG_PASSWORD, &pswd), "Error getting channel info");
 		if(!pswd) found = true;
 	}
 	if(!found) return false;
 
 	// If a joinable channel was found, attempt to join it
-	return CheckAndLog(ts3Functions.requestClientMove(scHandlerID, self, channel->id, "", NULL), "Error joining channel");
+	return CheckAndLog(clientFunctions->requestClientMove(scHandlerID, self, channel->id, "", returnCode), "Error joining channel");
 }
 
 bool NiftyKbFunctions::SetActiveServerRelative(uint64 scHandlerID, bool next)
@@ -549,7 +685,7 @@ bool NiftyKbFunctions::SetActiveServerRelative(uint64 scHandlerID, bool next)
 	int result;
 
 	// Get server list
-	if(CheckAndLog(ts3Functions.getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
+	if(CheckAndLog(clientFunctions->getServerConnectionHandlerList(&servers), "Error retrieving list of servers"))
 		return false;
 
 	// Find active server in the list
@@ -572,10 +708,10 @@ bool NiftyKbFunctions::SetActiveServerRelative(uint64 scHandlerID, bool next)
 	}
 
 	// Check if already active
-	bool ret = !CheckAndLog(ts3Functions.getClientSelfVariableAsInt(*server, CLIENT_INPUT_HARDWARE, &result), "Error retrieving client variable");
+	bool ret = !CheckAndLog(clientFunctions->getClientSelfVariableAsInt(*server, CLIENT_INPUT_HARDWARE, &result), "Error retrieving client variable");
 	if(!result) SetActiveServer(*server);
 
-	ts3Functions.freeMemory(servers);
+	clientFunctions->freeMemory(servers);
 	return ret;
 }
 
@@ -603,7 +739,7 @@ uint64 NiftyKbFunctions::GetChannelIDFromPath(uint64 scHandlerID, char* path)
 	/*
 	 * For efficiency I will violate the vector abstraction and give a direct pointer to its internal C array
 	 */
-	if(CheckAndLog(ts3Functions.getChannelIDFromChannelNames(scHandlerID, &hierachy[0], &parent), "Error getting parent channel ID"))
+	if(CheckAndLog(clientFunctions->getChannelIDFromChannelNames(scHandlerID, &hierachy[0], &parent), "Error getting parent channel ID"))
 		return false;
 
 	return parent;
@@ -613,7 +749,7 @@ bool NiftyKbFunctions::ConnectToBookmark(char* label, PluginConnectTab connectTa
 {
 	// Get the bookmark list
 	PluginBookmarkList* bookmarks;
-	if(CheckAndLog(ts3Functions.getBookmarkList(&bookmarks), "Error getting bookmark list"))
+	if(CheckAndLog(clientFunctions->getBookmarkList(&bookmarks), "Error getting bookmark list"))
 		return false;
 
 	// Find the bookmark
@@ -629,12 +765,12 @@ bool NiftyKbFunctions::ConnectToBookmark(char* label, PluginConnectTab connectTa
 			if(!strcmp(item.name, label))
 			{
 				// Connect to the bookmark
-				ret = !CheckAndLog(ts3Functions.guiConnectBookmark(connectTab, item.uuid, scHandlerID), "Failed to connect to bookmark");
+				ret = !CheckAndLog(clientFunctions->guiConnectBookmark(connectTab, item.uuid, scHandlerID), "Failed to connect to bookmark");
 			}
 		}
 	}
 
-	ts3Functions.freeMemory(bookmarks);
+	clientFunctions->freeMemory(bookmarks);
 	return ret;
 }
 
@@ -642,11 +778,11 @@ std::string NiftyKbFunctions::GetDefaultPlaybackProfile()
 {
 	char** profiles;
 	int defaultProfile;
-	if(CheckAndLog(ts3Functions.getProfileList(PLUGIN_GUI_SOUND_PLAYBACK, &defaultProfile, &profiles), "Error retrieving playback profiles"))
+	if(CheckAndLog(clientFunctions->getProfileList(PLUGIN_GUI_SOUND_PLAYBACK, &defaultProfile, &profiles), "Error retrieving playback profiles"))
 		return std::string();
 
 	std::string profile = profiles[defaultProfile];
-	ts3Functions.freeMemory(profiles);
+	clientFunctions->freeMemory(profiles);
 	return profile;
 }
 
@@ -654,11 +790,11 @@ std::string NiftyKbFunctions::GetDefaultCaptureProfile()
 {
 	char** profiles;
 	int defaultProfile;
-	if(CheckAndLog(ts3Functions.getProfileList(PLUGIN_GUI_SOUND_CAPTURE, &defaultProfile, &profiles), "Error retrieving capture profiles"))
+	if(CheckAndLog(clientFunctions->getProfileList(PLUGIN_GUI_SOUND_CAPTURE, &defaultProfile, &profiles), "Error retrieving capture profiles"))
 		return std::string();
 
 	std::string profile = profiles[defaultProfile];
-	ts3Functions.freeMemory(profiles);
+	clientFunctions->freeMemory(profiles);
 	return profile;
 }
 
@@ -666,7 +802,7 @@ int NiftyKbFunctions::GetConnectionStatus(uint64 scHandlerID)
 {
 	int status;
 
-	if(CheckAndLog(ts3Functions.getConnectionStatus(scHandlerID, &status), "Error retrieving connection status"))
+	if(CheckAndLog(clientFunctions->getConnectionStatus(scHandlerID, &status), "Error retrieving connection status"))
 		return STATUS_DISCONNECTED; // Assume we're not connected
 
 	return status;
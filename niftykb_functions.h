@@ -12,7 +12,6 @@
 #include "plugin_definitions.h"
 
 #include <vector>
-#include <map>
 #include <string>
 
 typedef struct
@@ -20,36 +19,69 @@ typedef struct
 	std::vector<anyID> clients;
 	std::vector<uint64> channels;
 } WhisperList;
-typedef std::map<uint64, std::vector<anyID>>::iterator ReplyIterator;
-typedef std::map<uint64, WhisperList>::iterator WhisperIterator;
 
-class NiftyKbFunctions
+/*
+ * The plugin state on one server connection. The baseline is how the client transmits without push-to-talk,
+ * it is read when the state is created and on every push-to-talk press, and kept up to date by the commands
+ * and the own client updates in between. The user may change it in the client without an update.
+ */
+typedef struct
 {
-public:
+	uint64 scHandlerID;
+
 	/* Push-to-talk */
 	bool pttActive;
-	bool vadActive;
-	bool inputActive;
+	bool vadActive;   // Voice activation baseline
+	bool inputActive; // Input baseline, the input is active without push-to-talk
 
 	/* Whisper lists */
 	bool whisperActive;
 	bool replyActive;
+	WhisperList whisperList;
+	std::vector<anyID> replyList;
+} ServerState;
 
+class NiftyKbFunctions
+{
+public:
 	/* Resources */
 	std::string infoIcon;
 	std::string errorSound;
 private:
-	std::map<uint64, WhisperList> whisperLists;
-	std::map<uint64, std::vector<anyID>> replyLists;
+	/* Server connections, few enough that a linear search beats a map */
+	std::vector<ServerState> servers;
+
+	/* Batching */
+	int batchDepth; // Batches nest, the high priority lane runs its own batch during a slow background call
+	std::vector<uint64> dirtyServers; // Servers with self updates that have not been flushed
+
+	bool SetSelfVariableAsInt(uint64 scHandlerID, size_t flag, int value, char* message);
+	bool SetSelfVariableAsString(uint64 scHandlerID, size_t flag, const char* value, char* message);
 
 	inline bool CheckAndLog(unsigned int returnCode, char* message = NULL);
+	void ReadBaseline(ServerState* state);
 public:
 	NiftyKbFunctions(void);
 	~NiftyKbFunctions(void);
 
+	// Server state, created on first use or when the connection is established and destroyed on disconnect.
+	// A pointer is valid until a server is added or removed.
+	ServerState* GetServerState(uint64 scHandlerID);
+	ServerState* FindServerState(uint64 scHandlerID); // NULL if the server has no state
+	void AddServerState(uint64 scHandlerID);
+	void RemoveServerState(uint64 scHandlerID);
+	void RefreshServerState(uint64 scHandlerID);
+
 	// Error handler
 	void ErrorMessage(uint64 scHandlerID, char* message);
 
+	// Batching, self updates are flushed once per dirty server when the batch ends
+	bool FlushSelfUpdates(uint64 scHandlerID);
+	void FlushPendingUpdates();
+	inline bool HasPendingUpdates() const { return !dirtyServers.empty(); }
+	void BeginBatch();
+	void EndBatch(bool flush = true);
+
 	// Getters
 	uint64 GetActiveServerConnectionHandlerID(void);
 	uint64 GetServerHandleByVariable(char* value, size_t flag);
@@ -59,6 +91,7 @@ public:
 	std::string GetDefaultPlaybackProfile();
 	std::string GetDefaultCaptureProfile();
 	int GetConnectionStatus(uint64 scHandlerID);
+	bool IsServerConnectionHandler(uint64 scHandlerID);
 
 	// Communication
 	bool SetPushToTalk(uint64 scHandlerID, bool shouldTalk);
@@ -80,12 +113,12 @@ public:
 	bool SetActiveServer(uint64 handle);
 	bool SetAway(uint64 scHandlerID, bool isAway, char* msg = "");
 	bool SetGlobalAway(bool isAway, char* msg = NULL);
-	bool JoinChannel(uint64 scHandlerID, uint64 channel);
-	bool ServerKickClient(uint64 scHandlerID, anyID client);
-	bool ChannelKickClient(uint64 scHandlerID, anyID client);
-	bool JoinChannelRelative(uint64 scHandlerID, bool next);
-	inline bool JoinNextChannel(uint64 scHandlerID) { return JoinChannelRelative(scHandlerID, true); }
-	inline bool JoinPrevChannel(uint64 scHandlerID) { return JoinChannelRelative(scHandlerID, false); }
+	bool JoinChannel(uint64 scHandlerID, uint64 channel, const char* returnCode = NULL);
+	bool ServerKickClient(uint64 scHandlerID, anyID client, const char* returnCode = NULL);
+	bool ChannelKickClient(uint64 scHandlerID, anyID client, const char* returnCode = NULL);
+	bool JoinChannelRelative(uint64 scHandlerID, bool next, const char* returnCode = NULL);
+	inline bool JoinNextChannel(uint64 scHandlerID, const char* returnCode = NULL) { return JoinChannelRelative(scHandlerID, true, returnCode); }
+	inline bool JoinPrevChannel(uint64 scHandlerID, const char* returnCode = NULL) { return JoinChannelRelative(scHandlerID, false, returnCode); }
 	bool SetActiveServerRelative(uint64 scHandlerID, bool next);
 	inline bool SetNextActiveServer(uint64 scHandlerID) { return SetActiveServerRelative(scHandlerID, true); }
 	inline bool SetPrevActiveServer(uint64 scHandlerID) { return SetActiveServerRelative(scHandlerID, false); }
@@ -93,8 +126,8 @@ public:
 
 	// Miscellaneous
 	bool SetMasterVolume(uint64 scHandlerID, float value);
-	bool MuteClient(uint64 scHandlerID, anyID client);
-	bool UnmuteClient(uint64 scHandlerID, anyID client);
+	bool MuteClient(uint64 scHandlerID, anyID client, const char* returnCode = NULL);
+	bool UnmuteClient(uint64 scHandlerID, anyID client, const char* returnCode = NULL);
 };
 
 #endif
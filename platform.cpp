@@ -0,0 +1,313 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dlfcn.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "platform.h"
+
+#ifndef _WIN32
+// Absolute deadline for the pthread timed waits
+static void Deadline(clockid_t clock, unsigned long timeoutMsecs, struct timespec* ts)
+{
+	clock_gettime(clock, ts);
+	ts->tv_sec += timeoutMsecs / 1000;
+	ts->tv_nsec += (timeoutMsecs % 1000) * 1000000;
+	if(ts->tv_nsec >= 1000000000)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+#endif
+
+/*********************************** Mutex ************************************/
+
+Mutex::Mutex(void)
+{
+#ifdef _WIN32
+	hMutex = CreateMutex(NULL, FALSE, NULL);
+#else
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+#endif
+}
+
+Mutex::~Mutex(void)
+{
+#ifdef _WIN32
+	CloseHandle(hMutex);
+#else
+	pthread_mutex_destroy(&mutex);
+#endif
+}
+
+bool Mutex::Lock(unsigned long timeoutMsecs)
+{
+#ifdef _WIN32
+	return WaitForSingleObject(hMutex, (timeoutMsecs == PLATFORM_INFINITE) ? INFINITE : timeoutMsecs) == WAIT_OBJECT_0;
+#else
+	if(timeoutMsecs == PLATFORM_INFINITE) return pthread_mutex_lock(&mutex) == 0;
+
+	struct timespec ts;
+	Deadline(CLOCK_REALTIME, timeoutMsecs, &ts);
+	return pthread_mutex_timedlock(&mutex, &ts) == 0;
+#endif
+}
+
+void Mutex::Unlock()
+{
+#ifdef _WIN32
+	ReleaseMutex(hMutex);
+#else
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+/*********************************** Event ************************************/
+
+Event::Event(void)
+{
+#ifdef _WIN32
+	hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+	signalled = false;
+	pthread_mutex_init(&mutex, NULL);
+
+	// Wait on the monotonic clock so timeouts are not affected by changes to the system time
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&cond, &attr);
+	pthread_condattr_destroy(&attr);
+#endif
+}
+
+Event::~Event(void)
+{
+#ifdef _WIN32
+	CloseHandle(hEvent);
+#else
+	pthread_cond_destroy(&cond);
+	pthread_mutex_destroy(&mutex);
+#endif
+}
+
+void Event::Set()
+{
+#ifdef _WIN32
+	SetEvent(hEvent);
+#else
+	pthread_mutex_lock(&mutex);
+	signalled = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&mutex);
+#endif
+}
+
+bool Event::Wait(unsigned long timeoutMsecs)
+{
+#ifdef _WIN32
+	return WaitForSingleObject(hEvent, (timeoutMsecs == PLATFORM_INFINITE) ? INFINITE : timeoutMsecs) == WAIT_OBJECT_0;
+#else
+	struct timespec ts;
+	if(timeoutMsecs != PLATFORM_INFINITE) Deadline(CLOCK_MONOTONIC, timeoutMsecs, &ts);
+
+	pthread_mutex_lock(&mutex);
+	int result = 0;
+	while(!signalled && result != ETIMEDOUT)
+	{
+		if(timeoutMsecs == PLATFORM_INFINITE) result = pthread_cond_wait(&cond, &mutex);
+		else result = pthread_cond_timedwait(&cond, &mutex, &ts);
+	}
+	bool set = signalled;
+	signalled = false;
+	pthread_mutex_unlock(&mutex);
+
+	return set;
+#endif
+}
+
+/*********************************** Flag ************************************/
+
+Flag::operator bool() const
+{
+#ifdef _WIN32
+	long raised = value;
+	_ReadWriteBarrier();
+	return raised != 0;
+#else
+	return __atomic_load_n(&value, __ATOMIC_ACQUIRE) != 0;
+#endif
+}
+
+Flag& Flag::operator=(bool raised)
+{
+#ifdef _WIN32
+	InterlockedExchange(&value, raised ? 1 : 0);
+#else
+	__atomic_store_n(&value, raised ? 1 : 0, __ATOMIC_RELEASE);
+#endif
+	return *this;
+}
+
+/*********************************** Thread ************************************/
+
+Thread::Thread(void) :
+	proc(NULL),
+	arg(NULL)
+{
+#ifdef _WIN32
+	hThread = NULL;
+#else
+	started = false;
+#endif
+}
+
+Thread::~Thread(void)
+{
+#ifdef _WIN32
+	if(hThread != NULL) CloseHandle(hThread);
+#endif
+}
+
+#ifdef _WIN32
+DWORD WINAPI Thread::Run(LPVOID thread)
+{
+	Thread* self = (Thread*)thread;
+	return (DWORD)self->proc(self->arg);
+}
+#else
+void* Thread::Run(void* thread)
+{
+	Thread* self = (Thread*)thread;
+	self->proc(self->arg);
+	self->finished.Set();
+	return NULL;
+}
+#endif
+
+bool Thread::Start(ThreadProc proc, void* arg)
+{
+	this->proc = proc;
+	this->arg = arg;
+
+#ifdef _WIN32
+	// A thread may be started again once it was joined
+	if(hThread != NULL) CloseHandle(hThread);
+	hThread = CreateThread(NULL, (SIZE_T)NULL, Run, this, 0, NULL);
+	return hThread != NULL;
+#else
+	started = (pthread_create(&thread, NULL, Run, this) == 0);
+	return started;
+#endif
+}
+
+bool Thread::Join(unsigned long timeoutMsecs)
+{
+#ifdef _WIN32
+	if(hThread == NULL) return true;
+	return WaitForSingleObject(hThread, (timeoutMsecs == PLATFORM_INFINITE) ? INFINITE : timeoutMsecs) == WAIT_OBJECT_0;
+#else
+	if(!started) return true;
+	started = false;
+
+	if(!finished.Wait(timeoutMsecs))
+	{
+		pthread_detach(thread);
+		return false;
+	}
+	pthread_join(thread, NULL);
+	return true;
+#endif
+}
+
+/*********************************** Miscellaneous ************************************/
+
+void SleepMsecs(unsigned long msecs)
+{
+#ifdef _WIN32
+	Sleep(msecs);
+#else
+	usleep(msecs * 1000);
+#endif
+}
+
+void* FindLoadedModule(const char* name)
+{
+#ifdef _WIN32
+	return (void*)GetModuleHandle(name);
+#else
+	// Only find modules that are already loaded, never load one
+	char file[512];
+	snprintf(file, sizeof(file), "%s.so", name);
+	void* module = dlopen(file, RTLD_LAZY | RTLD_NOLOAD);
+
+	// The reference is not needed, the plugin stays loaded while TeamSpeak runs
+	if(module != NULL) dlclose(module);
+	return module;
+#endif
+}
+
+void* FindModuleSymbol(void* module, const char* symbol)
+{
+#ifdef _WIN32
+	return (void*)GetProcAddress((HMODULE)module, symbol);
+#else
+	return dlsym(module, symbol);
+#endif
+}
+
+size_t ReadIniString(const char* file, const char* section, const char* key, char* value, size_t size)
+{
+#ifdef _WIN32
+	return GetPrivateProfileString(section, key, NULL, value, (DWORD)size, file);
+#else
+	FILE* ini = fopen(file, "r");
+	if(ini == NULL) return 0;
+
+	char line[512];
+	size_t length = 0;
+	bool inSection = false;
+	size_t keyLength = strlen(key);
+	while(length == 0 && fgets(line, sizeof(line), ini) != NULL)
+	{
+		// Strip the line ending
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if(line[0] == '[')
+		{
+			char* end = strchr(line, ']');
+			if(end != NULL) *end = '\0';
+			inSection = !strcmp(line+1, section);
+		}
+		else if(inSection && !strncmp(line, key, keyLength) && line[keyLength] == '=')
+		{
+			length = strlen(line + keyLength + 1);
+			if(length >= size) length = size-1;
+			memcpy(value, line + keyLength + 1, length);
+			value[length] = '\0';
+		}
+	}
+
+	fclose(ini);
+	return length;
+#endif
+}
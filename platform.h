@@ -0,0 +1,124 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include <stddef.h>
+
+#define PLATFORM_INFINITE ((unsigned long)-1)
+
+// The Visual Studio project defines the architecture, other builds take it from the compiler
+#if !defined(ARCH_X86_32) && !defined(ARCH_X86_64)
+#if defined(__x86_64__) || defined(__aarch64__)
+#define ARCH_X86_64
+#else
+#define ARCH_X86_32
+#endif
+#endif
+
+/*
+ * Recursive mutex, a thread that holds the lock may lock it again.
+ */
+class Mutex
+{
+private:
+#ifdef _WIN32
+	HANDLE hMutex;
+#else
+	pthread_mutex_t mutex;
+#endif
+public:
+	Mutex(void);
+	~Mutex(void);
+
+	// Returns false if the lock could not be acquired within the timeout
+	bool Lock(unsigned long timeoutMsecs = PLATFORM_INFINITE);
+	void Unlock();
+};
+
+/*
+ * Auto-reset event, a successful wait resets it.
+ */
+class Event
+{
+private:
+#ifdef _WIN32
+	HANDLE hEvent;
+#else
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool signalled;
+#endif
+public:
+	Event(void);
+	~Event(void);
+
+	void Set();
+
+	// Returns false if the event was not set within the timeout
+	bool Wait(unsigned long timeoutMsecs = PLATFORM_INFINITE);
+};
+
+/*
+ * Flag that is raised or cleared by one thread and read by others. A thread that sees it change also
+ * sees everything that was written before it changed.
+ */
+class Flag
+{
+private:
+	volatile long value;
+public:
+	Flag(bool raised = false) : value(raised ? 1 : 0) {}
+
+	operator bool() const;
+	Flag& operator=(bool raised);
+};
+
+typedef unsigned long (*ThreadProc)(void* arg);
+
+class Thread
+{
+private:
+	ThreadProc proc;
+	void* arg;
+#ifdef _WIN32
+	HANDLE hThread;
+	static DWORD WINAPI Run(LPVOID thread);
+#else
+	pthread_t thread;
+	bool started;
+	Event finished;
+	static void* Run(void* thread);
+#endif
+public:
+	Thread(void);
+	~Thread(void);
+
+	bool Start(ThreadProc proc, void* arg);
+
+	// Returns false if the thread did not exit within the timeout, the thread is abandoned then
+	bool Join(unsigned long timeoutMsecs);
+};
+
+void SleepMsecs(unsigned long msecs);
+
+// Loaded modules, used to find other TeamSpeak plugins
+void* FindLoadedModule(const char* name);
+void* FindModuleSymbol(void* module, const char* symbol);
+
+// Reads a value from an ini file, returns the length of the value or 0 if it was not found
+size_t ReadIniString(const char* file, const char* section, const char* key, char* value, size_t size);
+
+#endif
@@ -24,14 +24,36 @@
 #include "plugin.h"
 #include "niftykb_functions.h"
 #include "ts3_settings.h"
+#include "commands.h"
+#include "message.h"
+#include "stats.h"
+#include "ack.h"
+#include "platform.h"
+#include "transport.h"
+#include "mailslot_transport.h"
+#include "socket_transport.h"
+#include "uring_transport.h"
+#include "ring_transport.h"
+#include "frame.h"
+#include "sender.h"
+#include "traffic.h"
+#include "replay.h"
+#include "command_queue.h"
+#include "state_snapshot.h"
+#include "executor.h"
+#include "timer_wheel.h"
+#include "schedule.h"
+#include "clock.h"
 
 #include <sstream>
 #include <string>
 #include <vector>
 
 struct TS3Functions ts3Functions;
+struct TS3Functions* clientFunctions = &ts3Functions;
 NiftyKbFunctions niftykbFunctions;
 TS3Settings ts3Settings;
+MessagePool messagePool;
 
 #define PLUGIN_API_VERSION 20
 
@@ -40,19 +62,19 @@ TS3Settings ts3Settings;
 #define INFODATA_BUFSIZE 128
 #define SERVERINFO_BUFSIZE 256
 #define CHANNELINFO_BUFSIZE 512
-#define RETURNCODE_BUFSIZE 128
-#define REQUESTCLIENTMOVERETURNCODES_SLOTS 5
 
 #define PLUGIN_THREAD_TIMEOUT 1000
 
-#define TIMER_MSEC 10000
+#define PTT_DELAY_REFRESH 10000
 
-/* Array for request client move return codes. See comments within ts3plugin_processCommand for details */
-static char requestClientMoveReturnCodes[REQUESTCLIENTMOVERETURNCODES_SLOTS][RETURNCODE_BUFSIZE];
+#define CONSOLE_SENDER "console"
+
+#define BINDING_PREFIX '#'
+#define ACK_ID_PREFIX '@'
 
 // Plugin values
 char* pluginID = NULL;
-bool pluginRunning = false;
+Flag pluginRunning(false);
 
 // Error codes
 enum PluginError
@@ -63,19 +85,150 @@ enum PluginError
 	PLUGIN_ERROR_NOT_FOUND
 };
 
-// Thread handles
-static HANDLE hMailslotThread = NULL;
+// Plugin threads
+static Thread receiveThread;
+static Thread ringThread;
+static Thread backgroundThread;
+static Thread executorThread;
+
+// Command endpoint, a mailslot on Windows and a Unix-domain socket elsewhere, received through io_uring if the kernel supports it
+#ifdef _WIN32
+static MailslotTransport transport;
+#else
+static UringTransport transport;
+#endif
+
+// Shared memory endpoint for high-rate senders, received on its own thread
+static RingTransport ringTransport;
+static volatile int receiveError = PLUGIN_ERROR_NONE;
+
+// Rate limits and round-robin fairness between the senders on the command endpoints
+static SenderTable senders;
+
+// Traffic recording, and the replay of a recording against a stand-in for the client
+static TrafficRecorder trafficRecorder;
+static Event recordingEvent;
+static Flag recordingHandled(false); // The executor started or stopped the recording
+static bool recordingStarted = false;
+static char recordingPath[PATH_BUFSIZE];
+static Thread replayThread;
+static Event replayEvent;
+static Flag replayRunning(false);
+static char replayPath[PATH_BUFSIZE];
+static float replaySpeed = 1.0f;
+static bool replayVirtual = false; // Replays on a virtual clock that jumps from one message or timer to the next
+
+// The client functions are swapped on the executor, the replay thread hands the states over in these
+static TS3Functions replayFunctions;
+static Flag replaySwapped(false);
+static ClientState replayState;
+static ReplayCounters replayCounters;
+
+static VirtualClock replayClock;
+
+// Rewrites a collapsed step in a command queue, see the collapse rules
+void FormatStep(Message* message, unsigned int group, float amount);
+
+// Every change to the plugin state runs on the executor thread, the other threads post tasks to it
+static Executor executor;
+
+// High priority lane, messages that were posted to the executor wait here until it runs them
+static CommandQueue commandQueue(messagePool, FormatStep);
+
+// Background lane, messages with slow commands wait here until the high priority lane is idle
+static CommandQueue backgroundQueue(messagePool, FormatStep);
+
+// A slow call the executor hands to the background thread, see RunOnBackground
+typedef struct
+{
+	const CommandInfo* command;
+	uint64 scHandlerID;
+	char* arg;               // Argument for the resolver
+	const CommandArgs* args; // Arguments for the handler, NULL to resolve the target
+	uint64 target;           // Resolved target
+	bool done;               // Set on the executor once the call returned
+} BackgroundCall;
+static BackgroundCall* volatile backgroundCall = NULL;
+static Event backgroundEvent;
+static volatile bool backgroundExited = false;
+
+// Tasks that must not run while a slow call is in flight, such as swapping out the client functions the
+// call is using. The executor holds them back until RunOnBackground returns.
+#define DEFERRED_TASKS 4
+static BackgroundCall* backgroundInFlight = NULL;
+static ExecutorTask deferredTasks[DEFERRED_TASKS];
+static size_t deferredCount = 0;
+
+// Runs on the executor, returns true if the task was held back until the slow call in flight returned
+bool DeferWhileBackground(const ExecutorTask& task)
+{
+	// Every kind of deferred task waits at most once, the room is only exhausted by a bug
+	if(backgroundInFlight == NULL || deferredCount == DEFERRED_TASKS) return false;
+	deferredTasks[deferredCount++] = task;
+	return true;
+}
+
+// Timers run on the executor, it sleeps until the earliest one expires
+void PTTDelayCallback(WheelTimer* timer);
+void FlushTimerCallback(WheelTimer* timer);
+void SenderTimerCallback(WheelTimer* timer);
+static TimerWheel timerWheel;
+
+// Clock of the timers, the scheduler and the rate limits, see PluginUseClock. Only the executor switches it,
+// the latency statistics always use StatsNow.
+static SystemClock systemClock;
+static Clock* volatile pluginClock = &systemClock;
+
+// The executor reports back here once it switched the clock or settled at the current time
+static Mutex clockMutex;
+static Event clockEvent;
+static bool clockSwitched = false;
+static bool clockSettled = false;
+static bool clockIdle = false;
+static uint64 clockNextTimer = 0;
+
+// Delayed and repeating commands
+void RunScheduledCommand(const char* line, uint64 due);
+static CommandScheduler scheduler(timerWheel, RunScheduledCommand);
+
+// PTT Delay Timer, releases push-to-talk on the server it was started on
+static WheelTimer pttDelayTimer(PTTDelayCallback);
+static uint64 pttDelayServer = 0;
+
+// PTT Delay setting, cached so releasing PTT does not query the settings database every time
+static int pttDelayMsecs = 0;
+static bool pttDelayCached = false;
+static uint64 pttDelayUpdated = 0;
 
-// Mutex handles
-static HANDLE hMutex = NULL;
+// Self update flush timer, holds back self updates for flushDelay milliseconds to coalesce them
+static WheelTimer flushTimer(FlushTimerCallback);
+static int flushDelay = 0;
 
-// PTT Delay Timer
-static HANDLE hPttDelayTimer = (HANDLE)NULL;
-static LARGE_INTEGER dueTime;
+// Releases the messages that were throttled by their sender's rate limit
+static WheelTimer senderTimer(SenderTimerCallback);
+
+// Command bindings
+static BindingTable bindingTable;
+
+// Command latency statistics, only used on the executor
+static StatsTable statsTable;
+
+// Command acknowledgements
+static AckChannel ackChannel;
+
+// Own state published in shared memory for overlays and keyboard LEDs
+static StatePublisher statePublisher;
+void PublishPluginState(uint64 scHandlerID);
+void PublishServerState(uint64 scHandlerID);
 
 // Module proc definitions
+#ifdef _WIN32
 typedef const char* (WINAPI *CommandKeywordProc)();
 typedef int (WINAPI *ProcessCommandProc)(uint64, const char*);
+#else
+typedef const char* (*CommandKeywordProc)();
+typedef int (*ProcessCommandProc)(uint64, const char*);
+#endif
 
 /*********************************** Plugin error handlers ************************************/
 
@@ -91,7 +244,7 @@ bool IsConnected(uint64 scHandlerID)
 
 inline bool IsArgumentEmpty(uint64 scHandlerID, char* arg)
 {
-	if(arg == NULL && *arg == (char)NULL)
+	if(arg == NULL || *arg == (char)NULL)
 	{
 		niftykbFunctions.ErrorMessage(scHandlerID, "Missing argument");
 		return true;
@@ -99,23 +252,196 @@ inline bool IsArgumentEmpty(uint64 scHandlerID, char* arg)
 	return false;
 }
 
+// The argument as a number, either as it arrived in a binary frame or parsed from the text
+inline bool GetNumberArg(const CommandArgs& args, float* value)
+{
+	if(args.hasNumber)
+	{
+		*value = args.number;
+		return true;
+	}
+	if(args.text == NULL || *args.text == (char)NULL) return false;
+
+	*value = (float)atof(args.text);
+	return true;
+}
+
+/*
+ * Return code to send a server request with, NULL if the command is not acknowledged.
+ * The request is registered before it is sent, so a fast response cannot be missed.
+ */
+const char* UseReturnCode(const CommandArgs& args)
+{
+	ReturnCode* returnCode = args.returnCode;
+	if(returnCode == NULL) return NULL;
+
+	if(!returnCode->used)
+	{
+		uint64 now = StatsNow();
+		ackChannel.Expect(returnCode->code, returnCode->id, returnCode->command, now, now - returnCode->received);
+		returnCode->used = true;
+	}
+	return returnCode->code;
+}
+
+inline bool ParseBindingSlot(const StringRef& str, unsigned int* slot)
+{
+	if(str.length == 0) return false;
+
+	unsigned int value = 0;
+	for(size_t i=0; i<str.length; i++)
+	{
+		if(str.data[i] < '0' || str.data[i] > '9') return false;
+		value = value*10 + (str.data[i] - '0');
+		if(value >= BindingTable::MAX_BINDINGS) return false;
+	}
+
+	*slot = value;
+	return true;
+}
+
+// Delays and intervals of scheduled commands, in milliseconds up to a day
+inline bool ParseScheduleMsecs(const StringRef& str, uint64* msecs)
+{
+	if(str.length == 0) return false;
+
+	uint64 value = 0;
+	for(size_t i=0; i<str.length; i++)
+	{
+		if(str.data[i] < '0' || str.data[i] > '9') return false;
+		value = value*10 + (str.data[i] - '0');
+		if(value > 86400000) return false;
+	}
+
+	*msecs = value;
+	return true;
+}
+
 /*********************************** Plugin callbacks ************************************/
 
-VOID CALLBACK PTTDelayCallback(LPVOID lpArgToCompletionRoutine,DWORD dwTimerLowValue,DWORD dwTimerHighValue)
+void ArmTimer(WheelTimer* timer, int msecs)
+{
+	// Runs on the executor, the expiry is picked up before it goes to sleep again
+	timerWheel.Start(timer, pluginClock->Now(), (uint64)msecs * 1000);
+}
+
+void CancelPTTDelay(uint64 scHandlerID)
+{
+	// Runs on the executor, a release pending on another server still runs
+	if(pttDelayServer == scHandlerID) timerWheel.Cancel(&pttDelayTimer);
+}
+
+void PTTDelayCallback(WheelTimer*)
+{
+	// Runs on the executor, turn off PTT
+	niftykbFunctions.SetPushToTalk(pttDelayServer, false);
+	PublishPluginState(niftykbFunctions.GetActiveServerConnectionHandlerID());
+}
+
+void LeaveServer(uint64 scHandlerID)
+{
+	// Runs on the executor before the active server changes, push-to-talk held on it is released right away
+	CancelPTTDelay(scHandlerID);
+	niftykbFunctions.SetPushToTalk(scHandlerID, false);
+}
+
+void FlushPendingTask(const ExecutorTask& task)
+{
+	// Runs on the executor, send the held back self updates
+	if(DeferWhileBackground(task)) return;
+	niftykbFunctions.FlushPendingUpdates();
+}
+
+void FlushTimerCallback(WheelTimer*)
+{
+	ExecutorTask task;
+	task.proc = FlushPendingTask;
+	task.message = NULL;
+	task.data = NULL;
+	task.scHandlerID = 0;
+	task.value = 0;
+	FlushPendingTask(task);
+}
+
+/*********************************** TeamSpeak events ************************************/
+
+// The callbacks run on the TeamSpeak threads, they only post one of these to the executor's event queue
+
+void QueueEvent(TaskProc proc, uint64 scHandlerID, unsigned int value = 0, Message* message = NULL)
+{
+	// The executor reports the dropped events
+	if(!executor.PostEvent(proc, scHandlerID, value, message)) messagePool.Release(message);
+}
+
+void ReportDroppedEvents()
+{
+	unsigned long dropped = executor.TakeDroppedEvents();
+	if(dropped == 0) return;
+
+	char msg[64];
+	snprintf(msg, sizeof(msg), "Event queue full, %lu event(s) dropped", dropped);
+	ts3Functions.logMessage(msg, LogLevel_WARNING, "NiftyKb Plugin", 0);
+}
+
+// The plugin keeps running on the other endpoint when one failed, so the error is shown while it runs
+void ReportReceiveError(uint64 scHandlerID)
+{
+	int errorCode = receiveError;
+	if(errorCode != PLUGIN_ERROR_NONE)
+	{
+		switch(errorCode) {
+		case PLUGIN_ERROR_CREATESLOT_FAILED: niftykbFunctions.ErrorMessage(scHandlerID, "Could not create command endpoint."); break;
+		case PLUGIN_ERROR_READ_FAILED: niftykbFunctions.ErrorMessage(scHandlerID, "Could not read command endpoint."); break;
+		case PLUGIN_ERROR_NOT_FOUND: niftykbFunctions.ErrorMessage(scHandlerID, "Something not found."); break;
+		default: niftykbFunctions.ErrorMessage(scHandlerID, "NiftyKb Plugin failed to start, check the clientlog for more info."); break;
+		}
+	}
+}
+
+void ConnectionEstablished(const ExecutorTask& task)
+{
+	// Read the settings push-to-talk returns to and publish the own state as soon as it is known
+	niftykbFunctions.AddServerState(task.scHandlerID);
+	PublishServerState(task.scHandlerID);
+	ReportReceiveError(task.scHandlerID);
+}
+
+void ConnectionLost(const ExecutorTask& task)
+{
+	// A pending push-to-talk release has nothing left to release, a server that is gone is no longer published
+	CancelPTTDelay(task.scHandlerID);
+	niftykbFunctions.RemoveServerState(task.scHandlerID);
+	statePublisher.RemoveServer(task.scHandlerID);
+}
+
+void OwnClientUpdated(const ExecutorTask& task)
 {
-	// Acquire the mutex
-	WaitForSingleObject(hMutex, PLUGIN_THREAD_TIMEOUT);
+	// The settings may have been changed in the client rather than by a command
+	niftykbFunctions.RefreshServerState(task.scHandlerID);
+	PublishServerState(task.scHandlerID);
+}
+
+void OwnTalkStatusChanged(const ExecutorTask& task)
+{
+	statePublisher.SetTalkStatus(task.scHandlerID, (int)task.value);
+}
 
-	// Turn off PTT
-	niftykbFunctions.SetPushToTalk(niftykbFunctions.GetActiveServerConnectionHandlerID(), false);
+void AddReplyClient(const ExecutorTask& task)
+{
+	// Add the client that whispered to us to the reply list of its server
+	niftykbFunctions.ReplyAddClient(task.scHandlerID, (anyID)task.value);
+}
 
-	// Release the mutex
-	ReleaseMutex(hMutex);
+void CompleteServerRequest(const ExecutorTask& task)
+{
+	// The message holds the return code, the value the error and the receipt time when the response arrived
+	ackChannel.Complete(task.message->data, task.value, task.message->received);
+	messagePool.Release(task.message);
 }
 
 /*********************************** Plugin functions ************************************/
 
-bool ExecutePluginCommand(uint64 scHandlerID, char* keyword, char* command)
+bool ExecutePluginCommand(uint64 scHandlerID, const StringRef& keyword, char* command)
 {
 	// Get the plugin list
 	std::vector<std::string> plugins;
@@ -125,7 +451,7 @@ bool ExecutePluginCommand(uint64 scHandlerID, char* keyword, char* command)
 	for(std::vector<std::string>::iterator it=plugins.begin(); it!=plugins.end(); it++)
 	{
 		// Get the module handle
-		HMODULE pluginModule = GetModuleHandle(it->c_str());
+		void* pluginModule = FindLoadedModule(it->c_str());
 
 		// Module not found, try to guess the correct module name
 		if(pluginModule == NULL)
@@ -133,16 +459,16 @@ bool ExecutePluginCommand(uint64 scHandlerID, char* keyword, char* command)
 			// A list of suffixes a plugin can have based on the architecture (64bit vs 32bit).
 			// For some reason the linux, mac and powerpc suffixes are not ignored on windows.
 			#ifdef ARCH_X86_32
-				char* suffixes[] = { "_win32", "_x86", "_32", "_i386", "_linux_x86", "_mac", "_ppc" };
+				const char* suffixes[] = { "_win32", "_x86", "_32", "_i386", "_linux_x86", "_mac", "_ppc" };
 			#endif
 			#ifdef ARCH_X86_64
-				char* suffixes[] = { "_win64", "_amd64", "_64", "_linux_amd64", "_mac", "_ppc" };
+				const char* suffixes[] = { "_win64", "_amd64", "_64", "_linux_amd64", "_mac", "_ppc" };
 			#endif
 
-			for(int i=0; pluginModule == NULL && i<sizeof(suffixes); i++)
+			for(size_t i=0; pluginModule == NULL && i<sizeof(suffixes)/sizeof(suffixes[0]); i++)
 			{
 				std::string moduleName = (*it) + suffixes[i];
-				pluginModule = GetModuleHandle(moduleName.c_str());
+				pluginModule = FindLoadedModule(moduleName.c_str());
 			}
 		}
 
@@ -150,11 +476,11 @@ bool ExecutePluginCommand(uint64 scHandlerID, char* keyword, char* command)
 		if(pluginModule != NULL)
 		{
 			// Check if the keyword matches
-			CommandKeywordProc pCommandKeyword = (CommandKeywordProc)GetProcAddress(pluginModule, "ts3plugin_commandKeyword");
-			if(pCommandKeyword != NULL && !strcmp(pCommandKeyword(), keyword))
+			CommandKeywordProc pCommandKeyword = (CommandKeywordProc)FindModuleSymbol(pluginModule, "ts3plugin_commandKeyword");
+			if(pCommandKeyword != NULL && StringRefEquals(keyword, pCommandKeyword()))
 			{
 				// Execute the command
-				ProcessCommandProc pProcessCommand = (ProcessCommandProc)GetProcAddress(pluginModule, "ts3plugin_processCommand");
+				ProcessCommandProc pProcessCommand = (ProcessCommandProc)FindModuleSymbol(pluginModule, "ts3plugin_processCommand");
 				if(pProcessCommand != NULL)
 				{
 					pProcessCommand(scHandlerID, command);
@@ -173,8 +499,8 @@ bool SetInfoIcon()
 	if(!ts3Settings.GetIconPack(iconPack)) return false;
 
 	// Find the path to the skin
-	char path[MAX_PATH];
-	ts3Functions.getResourcesPath(path, MAX_PATH);
+	char path[PATH_BUFSIZE];
+	ts3Functions.getResourcesPath(path, PATH_BUFSIZE);
 
 	// Build and commit the path
 	std::stringstream ss;
@@ -191,8 +517,8 @@ bool SetErrorSound()
 	if(!ts3Settings.GetSoundPack(soundPack)) return false;
 
 	// Find the path to the soundpack
-	char path[MAX_PATH];
-	ts3Functions.getResourcesPath(path, MAX_PATH);
+	char path[PATH_BUFSIZE];
+	ts3Functions.getResourcesPath(path, PATH_BUFSIZE);
 	std::stringstream ss;
 	ss << path << "sound/" << soundPack;
 
@@ -201,8 +527,8 @@ bool SetErrorSound()
 	config.append("/settings.ini");
 
 	// Parse the config file for the sound file
-	char file[MAX_PATH];
-	int size = GetPrivateProfileString("soundfiles", "SERVER_ERROR", NULL, file, MAX_PATH, config.c_str());
+	char file[PATH_BUFSIZE];
+	size_t size = ReadIniString(config.c_str(), "soundfiles", "SERVER_ERROR", file, PATH_BUFSIZE);
 	if(size == 0) return false;
 
 	// Filter out the filename: play("file.wav")
@@ -215,583 +541,1998 @@ bool SetErrorSound()
 	return true;
 }
 
-bool PTTDelay()
+int GetPTTDelaySetting()
 {
 	// Get default capture profile and preprocessor data
 	std::string data;
-	if(!ts3Settings.GetPreProcessorData(niftykbFunctions.GetDefaultCaptureProfile(), data)) return false;
-	if(ts3Settings.GetValueFromData(data, "delay_ptt") != "true") return false;
-	int msecs = atoi(ts3Settings.GetValueFromData(data, "delay_ptt_msecs").c_str());
+	if(!ts3Settings.GetPreProcessorData(niftykbFunctions.GetDefaultCaptureProfile(), data)) return 0;
+	if(ts3Settings.GetValueFromData(data, "delay_ptt") != "true") return 0;
+	return atoi(ts3Settings.GetValueFromData(data, "delay_ptt_msecs").c_str());
+}
+
+bool PTTDelay(uint64 scHandlerID)
+{
+	// Refresh the cached setting at most once every PTT_DELAY_REFRESH milliseconds
+	uint64 now = StatsNow();
+	if(!pttDelayCached || now - pttDelayUpdated > (uint64)PTT_DELAY_REFRESH * 1000)
+	{
+		pttDelayMsecs = GetPTTDelaySetting();
+		pttDelayUpdated = now;
+		pttDelayCached = true;
+	}
 
 	// If a delay is configured, set the PTT delay timer
-	if(msecs > 0)
+	if(pttDelayMsecs > 0)
 	{
-		dueTime.QuadPart = -(msecs * TIMER_MSEC);
-		SetWaitableTimer(hPttDelayTimer, &dueTime, 0, PTTDelayCallback, NULL, FALSE);
+		ArmTimer(&pttDelayTimer, pttDelayMsecs);
+		pttDelayServer = scHandlerID;
 		return true;
 	}
 
 	return false;
 }
 
-void ParseCommand(char* cmd, char* arg)
+/*********************************** Target resolvers ************************************/
+
+uint64 ResolveServerName(uint64, char* arg)
 {
-	// Acquire the mutex
-	if(WaitForSingleObject(hMutex, PLUGIN_THREAD_TIMEOUT) != WAIT_OBJECT_0)
-	{
-		ts3Functions.logMessage("Timeout while waiting for mutex", LogLevel_WARNING, "NiftyKb Plugin", 0);
-		return;
-	}
+	return niftykbFunctions.GetServerHandleByVariable(arg, VIRTUALSERVER_NAME);
+}
 
-	// Get the active server
-	uint64 scHandlerID = niftykbFunctions.GetActiveServerConnectionHandlerID();
-	if(scHandlerID == NULL)
-	{
-		ts3Functions.logMessage("Failed to get an active server, falling back to current server", LogLevel_DEBUG, "NiftyKb Plugin", 0);
-		scHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
-	}
+uint64 ResolveServerUID(uint64, char* arg)
+{
+	return niftykbFunctions.GetServerHandleByVariable(arg, VIRTUALSERVER_UNIQUE_IDENTIFIER);
+}
 
-	/***** Communication *****/
-	if(!strcmp(cmd, "TS3_PTT_ACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-		{
-			CancelWaitableTimer(hPttDelayTimer);
-			niftykbFunctions.SetPushToTalk(scHandlerID, true);
-		}
-	}
-	else if(!strcmp(cmd, "TS3_PTT_DEACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-		{
-			if(!PTTDelay()) // If query failed
-				niftykbFunctions.SetPushToTalk(scHandlerID, false);
-		}
-	}
-	else if(!strcmp(cmd, "TS3_PTT_TOGGLE"))
-	{
-		if(IsConnected(scHandlerID))
-		{
-			if(niftykbFunctions.pttActive) CancelWaitableTimer(hPttDelayTimer);
-			niftykbFunctions.SetPushToTalk(scHandlerID, !niftykbFunctions.pttActive);
-		}
-	}
-	else if(!strcmp(cmd, "TS3_VAD_ACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetVoiceActivation(scHandlerID, true);
-	}
-	else if(!strcmp(cmd, "TS3_VAD_DEACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetVoiceActivation(scHandlerID, false);
-	}
-	else if(!strcmp(cmd, "TS3_VAD_TOGGLE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetVoiceActivation(scHandlerID, !niftykbFunctions.vadActive);
-	}
-	else if(!strcmp(cmd, "TS3_CT_ACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetContinuousTransmission(scHandlerID, true);
-	}
-	else if(!strcmp(cmd, "TS3_CT_DEACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetContinuousTransmission(scHandlerID, false);
-	}
-	else if(!strcmp(cmd, "TS3_CT_TOGGLE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetContinuousTransmission(scHandlerID, !niftykbFunctions.inputActive);
-	}
-	else if(!strcmp(cmd, "TS3_INPUT_MUTE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetInputMute(scHandlerID, true);
-	}
-	else if(!strcmp(cmd, "TS3_INPUT_UNMUTE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetInputMute(scHandlerID, false);
-	}
-	else if(!strcmp(cmd, "TS3_INPUT_TOGGLE"))
-	{
-		if(IsConnected(scHandlerID))
-		{
-			int muted;
-			ts3Functions.getClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_MUTED, &muted);
-			niftykbFunctions.SetInputMute(scHandlerID, !muted);
-		}
-	}
-	else if(!strcmp(cmd, "TS3_OUTPUT_MUTE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetOutputMute(scHandlerID, true);
-	}
-	else if(!strcmp(cmd, "TS3_OUTPUT_UNMUTE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetOutputMute(scHandlerID, false);
-	}
-	else if(!strcmp(cmd, "TS3_OUTPUT_TOGGLE"))
-	{
-		if(IsConnected(scHandlerID))
-		{
-			int muted;
-			ts3Functions.getClientSelfVariableAsInt(scHandlerID, CLIENT_OUTPUT_MUTED, &muted);
-			niftykbFunctions.SetOutputMute(scHandlerID, !muted);
-		}
-	}
-	/***** Server interaction *****/
-	else if(!strcmp(cmd, "TS3_AWAY_ZZZ"))
-	{
-		niftykbFunctions.SetAway(scHandlerID, true, arg);
-	}
-	else if(!strcmp(cmd, "TS3_AWAY_NONE"))
+uint64 ResolveServerIP(uint64, char* arg)
+{
+	return niftykbFunctions.GetServerHandleByVariable(arg, VIRTUALSERVER_IP);
+}
+
+uint64 ResolveChannel(uint64 scHandlerID, char* arg)
+{
+	uint64 id = niftykbFunctions.GetChannelIDFromPath(scHandlerID, arg);
+	if(id == (uint64)NULL) id = niftykbFunctions.GetChannelIDByVariable(scHandlerID, arg, CHANNEL_NAME);
+	return id;
+}
+
+uint64 ResolveChannelID(uint64, char* arg)
+{
+	return atoi(arg);
+}
+
+uint64 ResolveClientName(uint64 scHandlerID, char* arg)
+{
+	return niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_NICKNAME);
+}
+
+uint64 ResolveClientUID(uint64 scHandlerID, char* arg)
+{
+	return niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_UNIQUE_IDENTIFIER);
+}
+
+/*********************************** Command handlers ************************************/
+
+/***** Communication *****/
+void HandlePTTActivate(uint64 scHandlerID, const CommandArgs&)
+{
+	CancelPTTDelay(scHandlerID);
+	niftykbFunctions.SetPushToTalk(scHandlerID, true);
+}
+
+void HandlePTTDeactivate(uint64 scHandlerID, const CommandArgs&)
+{
+	if(!PTTDelay(scHandlerID)) // If query failed
+		niftykbFunctions.SetPushToTalk(scHandlerID, false);
+}
+
+void HandlePTTToggle(uint64 scHandlerID, const CommandArgs&)
+{
+	bool pttActive = niftykbFunctions.GetServerState(scHandlerID)->pttActive;
+	if(pttActive) CancelPTTDelay(scHandlerID);
+	niftykbFunctions.SetPushToTalk(scHandlerID, !pttActive);
+}
+
+void HandleVADActivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetVoiceActivation(scHandlerID, true);
+}
+
+void HandleVADDeactivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetVoiceActivation(scHandlerID, false);
+}
+
+void HandleVADToggle(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetVoiceActivation(scHandlerID, !niftykbFunctions.GetServerState(scHandlerID)->vadActive);
+}
+
+void HandleCTActivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetContinuousTransmission(scHandlerID, true);
+}
+
+void HandleCTDeactivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetContinuousTransmission(scHandlerID, false);
+}
+
+void HandleCTToggle(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetContinuousTransmission(scHandlerID, !niftykbFunctions.GetServerState(scHandlerID)->inputActive);
+}
+
+void HandleInputMute(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetInputMute(scHandlerID, true);
+}
+
+void HandleInputUnmute(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetInputMute(scHandlerID, false);
+}
+
+void HandleInputToggle(uint64 scHandlerID, const CommandArgs&)
+{
+	int muted;
+	clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_MUTED, &muted);
+	niftykbFunctions.SetInputMute(scHandlerID, !muted);
+}
+
+void HandleOutputMute(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetOutputMute(scHandlerID, true);
+}
+
+void HandleOutputUnmute(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetOutputMute(scHandlerID, false);
+}
+
+void HandleOutputToggle(uint64 scHandlerID, const CommandArgs&)
+{
+	int muted;
+	clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_OUTPUT_MUTED, &muted);
+	niftykbFunctions.SetOutputMute(scHandlerID, !muted);
+}
+
+/***** Server interaction *****/
+void HandleAwayZzz(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.SetAway(scHandlerID, true, args.text);
+}
+
+void HandleAwayNone(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetAway(scHandlerID, false);
+}
+
+void HandleAwayToggle(uint64 scHandlerID, const CommandArgs& args)
+{
+	int away;
+	clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_AWAY, &away);
+	niftykbFunctions.SetAway(scHandlerID, !away, args.text);
+}
+
+void HandleGlobalAwayZzz(uint64, const CommandArgs& args)
+{
+	niftykbFunctions.SetGlobalAway(true, args.text);
+}
+
+void HandleGlobalAwayNone(uint64, const CommandArgs&)
+{
+	niftykbFunctions.SetGlobalAway(false);
+}
+
+void HandleGlobalAwayToggle(uint64 scHandlerID, const CommandArgs& args)
+{
+	int away;
+	clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_AWAY, &away);
+	niftykbFunctions.SetGlobalAway(!away, args.text);
+}
+
+void HandleActivateServer(uint64 scHandlerID, const CommandArgs& args)
+{
+	if(args.target != scHandlerID)
 	{
-		niftykbFunctions.SetAway(scHandlerID, false);
+		LeaveServer(scHandlerID);
+		niftykbFunctions.SetActiveServer(args.target);
 	}
-	else if(!strcmp(cmd, "TS3_AWAY_TOGGLE"))
+	else niftykbFunctions.ErrorMessage(scHandlerID, "Server not found");
+}
+
+void HandleActivateServerID(uint64 scHandlerID, const CommandArgs& args)
+{
+	if(args.target != scHandlerID) LeaveServer(scHandlerID);
+	niftykbFunctions.SetActiveServer(args.target);
+}
+
+void HandleActivateCurrent(uint64 scHandlerID, const CommandArgs&)
+{
+	uint64 handle = clientFunctions->getCurrentServerConnectionHandlerID();
+	if(handle != (uint64)NULL)
 	{
-		int away;
-		ts3Functions.getClientSelfVariableAsInt(scHandlerID, CLIENT_AWAY, &away);
-		niftykbFunctions.SetAway(scHandlerID, !away, arg);
+		if(handle != scHandlerID) LeaveServer(scHandlerID);
+		niftykbFunctions.SetActiveServer(handle);
 	}
-	else if(!strcmp(cmd, "TS3_GLOBALAWAY_ZZZ"))
-	{
-		niftykbFunctions.SetGlobalAway(true, arg);
+	else niftykbFunctions.ErrorMessage(scHandlerID, "Server not found");
+}
+
+void HandleServerNext(uint64 scHandlerID, const CommandArgs&)
+{
+	LeaveServer(scHandlerID);
+	niftykbFunctions.SetNextActiveServer(scHandlerID);
+}
+
+void HandleServerPrev(uint64 scHandlerID, const CommandArgs&)
+{
+	LeaveServer(scHandlerID);
+	niftykbFunctions.SetPrevActiveServer(scHandlerID);
+}
+
+void HandleJoinChannel(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.JoinChannel(scHandlerID, args.target, UseReturnCode(args));
+}
+
+void HandleChannelNext(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.JoinNextChannel(scHandlerID, UseReturnCode(args));
+}
+
+void HandleChannelPrev(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.JoinPrevChannel(scHandlerID, UseReturnCode(args));
+}
+
+void HandleKickClient(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.ServerKickClient(scHandlerID, (anyID)args.target, UseReturnCode(args));
+}
+
+void HandleChanKickClient(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.ChannelKickClient(scHandlerID, (anyID)args.target, UseReturnCode(args));
+}
+
+void HandleBookmarkConnect(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.ConnectToBookmark(args.text, PLUGIN_CONNECT_TAB_NEW_IF_CURRENT_CONNECTED, &scHandlerID);
+}
+
+/***** Whispering *****/
+void HandleWhisperActivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetWhisperList(scHandlerID, true);
+}
+
+void HandleWhisperDeactivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetWhisperList(scHandlerID, false);
+}
+
+void HandleWhisperToggle(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetWhisperList(scHandlerID, !niftykbFunctions.GetServerState(scHandlerID)->whisperActive);
+}
+
+void HandleWhisperClear(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.WhisperListClear(scHandlerID);
+}
+
+void HandleWhisperClient(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.WhisperAddClient(scHandlerID, (anyID)args.target);
+}
+
+void HandleWhisperChannel(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.WhisperAddChannel(scHandlerID, args.target);
+}
+
+void HandleReplyActivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetReplyList(scHandlerID, true);
+}
+
+void HandleReplyDeactivate(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetReplyList(scHandlerID, false);
+}
+
+void HandleReplyToggle(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.SetReplyList(scHandlerID, !niftykbFunctions.GetServerState(scHandlerID)->replyActive);
+}
+
+void HandleReplyClear(uint64 scHandlerID, const CommandArgs&)
+{
+	niftykbFunctions.ReplyListClear(scHandlerID);
+}
+
+/***** Miscellaneous *****/
+void HandleMuteClient(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.MuteClient(scHandlerID, (anyID)args.target, UseReturnCode(args));
+}
+
+void HandleUnmuteClient(uint64 scHandlerID, const CommandArgs& args)
+{
+	niftykbFunctions.UnmuteClient(scHandlerID, (anyID)args.target, UseReturnCode(args));
+}
+
+void HandleMuteToggleClient(uint64 scHandlerID, const CommandArgs& args)
+{
+	int muted;
+	anyID id = (anyID)args.target;
+	clientFunctions->getClientVariableAsInt(scHandlerID, id, CLIENT_IS_MUTED, &muted);
+	if(!muted) niftykbFunctions.MuteClient(scHandlerID, id, UseReturnCode(args));
+	else niftykbFunctions.UnmuteClient(scHandlerID, id, UseReturnCode(args));
+}
+
+void HandleVolumeUp(uint64 scHandlerID, const CommandArgs& args)
+{
+	float diff;
+	if(!GetNumberArg(args, &diff)) diff = 1.0f;
+	float value;
+	clientFunctions->getPlaybackConfigValueAsFloat(scHandlerID, "volume_modifier", &value);
+	niftykbFunctions.SetMasterVolume(scHandlerID, value+diff);
+}
+
+void HandleVolumeDown(uint64 scHandlerID, const CommandArgs& args)
+{
+	float diff;
+	if(!GetNumberArg(args, &diff)) diff = 1.0f;
+	float value;
+	clientFunctions->getPlaybackConfigValueAsFloat(scHandlerID, "volume_modifier", &value);
+	niftykbFunctions.SetMasterVolume(scHandlerID, value-diff);
+}
+
+void HandleVolumeSet(uint64 scHandlerID, const CommandArgs& args)
+{
+	float value;
+	if(GetNumberArg(args, &value)) niftykbFunctions.SetMasterVolume(scHandlerID, value);
+}
+
+void HandlePluginCommand(uint64 scHandlerID, const CommandArgs& args)
+{
+	// Split the keyword from the command
+	StringRef keyword;
+	Tokenizer tokens(args.text);
+	if(!tokens.Next(&keyword)) return;
+	if(keyword.length > 0 && *keyword.data == '/') // Skip the slash
+	{
+		keyword.data++;
+		keyword.length--;
 	}
-	else if(!strcmp(cmd, "TS3_GLOBALAWAY_NONE"))
+
+	// Execute the command
+	char* command = tokens.Rest();
+	if(!IsArgumentEmpty(scHandlerID, command))
+		ExecutePluginCommand(scHandlerID, keyword, command);
+}
+
+void HandleFlushDelay(uint64, const CommandArgs& args)
+{
+	float msecs = 0.0f;
+	GetNumberArg(args, &msecs);
+	flushDelay = (msecs > 0.0f) ? (int)msecs : 0;
+}
+
+void HandleRateLimit(uint64, const CommandArgs& args)
+{
+	// Messages per second and burst size for every sender, a rate of 0 lifts the limit
+	float rate = 0.0f;
+	double burst = 0.0;
+	GetNumberArg(args, &rate);
+	if(!args.hasNumber && args.text != NULL)
 	{
-		niftykbFunctions.SetGlobalAway(false);
+		char* end;
+		strtod(args.text, &end);
+		burst = strtod(end, NULL);
 	}
-	else if(!strcmp(cmd, "TS3_GLOBALAWAY_TOGGLE"))
+	senders.SetLimit(rate, burst);
+}
+
+void HandleAckEndpoint(uint64 scHandlerID, const CommandArgs& args)
+{
+	// Without a path acknowledgements are turned off
+	if(args.text == NULL || *args.text == (char)NULL) ackChannel.Close();
+	else if(!ackChannel.Open(args.text)) niftykbFunctions.ErrorMessage(scHandlerID, "Acknowledgement endpoint not found");
+}
+
+/***** Scheduling *****/
+void ScheduleCommand(uint64 scHandlerID, const CommandArgs& args, bool named, bool repeat);
+
+void HandleDelay(uint64 scHandlerID, const CommandArgs& args)
+{
+	ScheduleCommand(scHandlerID, args, false, false);
+}
+
+void HandleSchedule(uint64 scHandlerID, const CommandArgs& args)
+{
+	ScheduleCommand(scHandlerID, args, true, false);
+}
+
+void HandleRepeat(uint64 scHandlerID, const CommandArgs& args)
+{
+	ScheduleCommand(scHandlerID, args, true, true);
+}
+
+void HandleCancel(uint64 scHandlerID, const CommandArgs& args)
+{
+	if(IsArgumentEmpty(scHandlerID, args.text)) return;
+
+	StringRef token;
+	Tokenizer tokens(args.text);
+	char name[SCHEDULE_NAME_BUFSIZE];
+	if(!tokens.Next(&token) || token.length >= SCHEDULE_NAME_BUFSIZE)
 	{
-		int away;
-		ts3Functions.getClientSelfVariableAsInt(scHandlerID, CLIENT_AWAY, &away);
-		niftykbFunctions.SetGlobalAway(!away, arg);
+		niftykbFunctions.ErrorMessage(scHandlerID, "Invalid schedule name");
+		return;
 	}
-	else if(!strcmp(cmd, "TS3_ACTIVATE_SERVER"))
+	memcpy(name, token.data, token.length);
+	name[token.length] = (char)NULL;
+
+	if(!scheduler.Cancel(name)) niftykbFunctions.ErrorMessage(scHandlerID, "Schedule not found");
+}
+
+/***** Bindings *****/
+void HandleBind(uint64 scHandlerID, const CommandArgs& args);
+
+void HandleUnbind(uint64 scHandlerID, const CommandArgs& args)
+{
+	unsigned int slot;
+	StringRef token;
+	Tokenizer tokens(args.text);
+	if(tokens.Next(&token) && ParseBindingSlot(token, &slot)) bindingTable.Unbind(slot);
+	else niftykbFunctions.ErrorMessage(scHandlerID, "Invalid binding slot");
+}
+
+/*********************************** Command table ************************************/
+
+static const CommandInfo commands[] =
+{
+	/***** Communication *****/
+	{ 1,   "TS3_PTT_ACTIVATE",          HandlePTTActivate,        COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 2,   "TS3_PTT_DEACTIVATE",        HandlePTTDeactivate,      COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 3,   "TS3_PTT_TOGGLE",            HandlePTTToggle,          COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 4,   "TS3_VAD_ACTIVATE",          HandleVADActivate,        COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 5,   "TS3_VAD_DEACTIVATE",        HandleVADDeactivate,      COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 6,   "TS3_VAD_TOGGLE",            HandleVADToggle,          COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 7,   "TS3_CT_ACTIVATE",           HandleCTActivate,         COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 8,   "TS3_CT_DEACTIVATE",         HandleCTDeactivate,       COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 9,   "TS3_CT_TOGGLE",             HandleCTToggle,           COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 10,  "TS3_INPUT_MUTE",            HandleInputMute,          COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 11,  "TS3_INPUT_UNMUTE",          HandleInputUnmute,        COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 12,  "TS3_INPUT_TOGGLE",          HandleInputToggle,        COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 13,  "TS3_OUTPUT_MUTE",           HandleOutputMute,         COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 14,  "TS3_OUTPUT_UNMUTE",         HandleOutputUnmute,       COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 15,  "TS3_OUTPUT_TOGGLE",         HandleOutputToggle,       COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+
+	/***** Server interaction *****/
+	{ 16,  "TS3_AWAY_ZZZ",              HandleAwayZzz,            COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 17,  "TS3_AWAY_NONE",             HandleAwayNone,           COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 18,  "TS3_AWAY_TOGGLE",           HandleAwayToggle,         COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 19,  "TS3_GLOBALAWAY_ZZZ",        HandleGlobalAwayZzz,      COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 20,  "TS3_GLOBALAWAY_NONE",       HandleGlobalAwayNone,     COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 21,  "TS3_GLOBALAWAY_TOGGLE",     HandleGlobalAwayToggle,   COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 22,  "TS3_ACTIVATE_SERVER",       HandleActivateServer,     COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_SERVER,  ResolveServerName },
+	{ 23,  "TS3_ACTIVATE_SERVERID",     HandleActivateServerID,   COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_SERVER,  ResolveServerUID },
+	{ 24,  "TS3_ACTIVATE_SERVERIP",     HandleActivateServerID,   COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_SERVER,  ResolveServerIP },
+	{ 25,  "TS3_ACTIVATE_CURRENT",      HandleActivateCurrent,    COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 26,  "TS3_SERVER_NEXT",           HandleServerNext,         COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 27,  "TS3_SERVER_PREV",           HandleServerPrev,         COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 28,  "TS3_JOIN_CHANNEL",          HandleJoinChannel,        COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CHANNEL, ResolveChannel },
+	{ 29,  "TS3_JOIN_CHANNELID",        HandleJoinChannel,        COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CHANNEL, ResolveChannelID },
+	{ 30,  "TS3_CHANNEL_NEXT",          HandleChannelNext,        COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_NONE,    NULL },
+	{ 31,  "TS3_CHANNEL_PREV",          HandleChannelPrev,        COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_NONE,    NULL },
+	{ 32,  "TS3_KICK_CLIENT",           HandleKickClient,         COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientName },
+	{ 33,  "TS3_KICK_CLIENTID",         HandleKickClient,         COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientUID },
+	{ 34,  "TS3_CHANKICK_CLIENT",       HandleChanKickClient,     COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientName },
+	{ 35,  "TS3_CHANKICK_CLIENTID",     HandleChanKickClient,     COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientUID },
+	{ 36,  "TS3_BOOKMARK_CONNECT",      HandleBookmarkConnect,    COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_NONE,    NULL },
+
+	/***** Whispering *****/
+	{ 37,  "TS3_WHISPER_ACTIVATE",      HandleWhisperActivate,    COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 38,  "TS3_WHISPER_DEACTIVATE",    HandleWhisperDeactivate,  COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 39,  "TS3_WHISPER_TOGGLE",        HandleWhisperToggle,      COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 40,  "TS3_WHISPER_CLEAR",         HandleWhisperClear,       COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 41,  "TS3_WHISPER_CLIENT",        HandleWhisperClient,      COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND,          COMMAND_TARGET_CLIENT,  ResolveClientName },
+	{ 42,  "TS3_WHISPER_CLIENTID",      HandleWhisperClient,      COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND,          COMMAND_TARGET_CLIENT,  ResolveClientUID },
+	{ 43,  "TS3_WHISPER_CHANNEL",       HandleWhisperChannel,     COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND,          COMMAND_TARGET_CHANNEL, ResolveChannel },
+	{ 44,  "TS3_WHISPER_CHANNELID",     HandleWhisperChannel,     COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND,          COMMAND_TARGET_CHANNEL, ResolveChannelID },
+	{ 45,  "TS3_REPLY_ACTIVATE",        HandleReplyActivate,      COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 46,  "TS3_REPLY_DEACTIVATE",      HandleReplyDeactivate,    COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 47,  "TS3_REPLY_TOGGLE",          HandleReplyToggle,        COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 48,  "TS3_REPLY_CLEAR",           HandleReplyClear,         COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+
+	/***** Miscellaneous *****/
+	{ 49,  "TS3_MUTE_CLIENT",           HandleMuteClient,         COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientName },
+	{ 50,  "TS3_MUTE_CLIENTID",         HandleMuteClient,         COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientUID },
+	{ 51,  "TS3_UNMUTE_CLIENT",         HandleUnmuteClient,       COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientName },
+	{ 52,  "TS3_UNMUTE_CLIENTID",       HandleUnmuteClient,       COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientUID },
+	{ 53,  "TS3_MUTE_TOGGLE_CLIENT",    HandleMuteToggleClient,   COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientName },
+	{ 54,  "TS3_MUTE_TOGGLE_CLIENTID",  HandleMuteToggleClient,   COMMAND_FLAG_CONNECTION | COMMAND_FLAG_ARGUMENT, COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_CLIENT,  ResolveClientUID },
+	{ 55,  "TS3_VOLUME_UP",             HandleVolumeUp,           COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 56,  "TS3_VOLUME_DOWN",           HandleVolumeDown,         COMMAND_FLAG_CONNECTION,                         COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 57,  "TS3_VOLUME_SET",            HandleVolumeSet,          COMMAND_FLAG_CONNECTION | COMMAND_FLAG_NUMBER,   COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 58,  "TS3_PLUGIN_COMMAND",        HandlePluginCommand,      COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_BACKGROUND_UNLOCKED, COMMAND_TARGET_NONE,    NULL },
+	{ 59,  "TS3_FLUSH_DELAY",           HandleFlushDelay,         COMMAND_FLAG_NUMBER,                             COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 60,  "TS3_ACK_ENDPOINT",          HandleAckEndpoint,        COMMAND_FLAG_NONE,                               COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 63,  "TS3_RATE_LIMIT",            HandleRateLimit,          COMMAND_FLAG_NUMBER,                             COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+
+	/***** Scheduling *****/
+	{ 64,  "TS3_DELAY",                 HandleDelay,              COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 65,  "TS3_SCHEDULE",              HandleSchedule,           COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 66,  "TS3_REPEAT",                HandleRepeat,             COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 67,  "TS3_CANCEL",                HandleCancel,             COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+
+	/***** Bindings *****/
+	{ 61,  "TS3_BIND",                  HandleBind,               COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL },
+	{ 62,  "TS3_UNBIND",                HandleUnbind,             COMMAND_FLAG_ARGUMENT,                           COMMAND_LANE_HIGH,                COMMAND_TARGET_NONE,    NULL }
+};
+
+static CommandTable commandTable;
+
+const CommandTable& PluginCommandTable()
+{
+	return commandTable;
+}
+
+typedef struct
+{
+	unsigned int opcode;
+	CollapseKind kind;
+	unsigned int group; // Opcode of the command that a collapsed step runs as
+	float sign;         // Direction of a step
+} CollapseRule;
+
+/*
+ * Commands that may be collapsed with their neighbours while a lane is backed up, see CommandQueue.
+ * A step down counts as a negative step up, a run of steps down folds into one negative step.
+ */
+static const CollapseRule collapseRules[] =
+{
+	{ 3,  COLLAPSE_TOGGLE,    3,  1.0f }, // TS3_PTT_TOGGLE
+	{ 6,  COLLAPSE_TOGGLE,    6,  1.0f }, // TS3_VAD_TOGGLE
+	{ 9,  COLLAPSE_TOGGLE,    9,  1.0f }, // TS3_CT_TOGGLE
+	{ 12, COLLAPSE_TOGGLE,    12, 1.0f }, // TS3_INPUT_TOGGLE
+	{ 15, COLLAPSE_TOGGLE,    15, 1.0f }, // TS3_OUTPUT_TOGGLE
+	{ 39, COLLAPSE_TOGGLE,    39, 1.0f }, // TS3_WHISPER_TOGGLE
+	{ 47, COLLAPSE_TOGGLE,    47, 1.0f }, // TS3_REPLY_TOGGLE
+	{ 41, COLLAPSE_DUPLICATE, 41, 1.0f }, // TS3_WHISPER_CLIENT
+	{ 42, COLLAPSE_DUPLICATE, 42, 1.0f }, // TS3_WHISPER_CLIENTID
+	{ 43, COLLAPSE_DUPLICATE, 43, 1.0f }, // TS3_WHISPER_CHANNEL
+	{ 44, COLLAPSE_DUPLICATE, 44, 1.0f }, // TS3_WHISPER_CHANNELID
+	{ 55, COLLAPSE_STEP,      55, 1.0f }, // TS3_VOLUME_UP
+	{ 56, COLLAPSE_STEP,      55, -1.0f } // TS3_VOLUME_DOWN
+};
+
+void HandleBind(uint64 scHandlerID, const CommandArgs& args)
+{
+	// Split the slot from the bound command and its argument
+	unsigned int slot;
+	StringRef token, cmd;
+	Tokenizer tokens(args.text);
+	if(!tokens.Next(&token) || !ParseBindingSlot(token, &slot) || !tokens.Next(&cmd))
 	{
-		if(!IsArgumentEmpty(scHandlerID, arg))
+		niftykbFunctions.ErrorMessage(scHandlerID, "Invalid binding slot");
+		return;
+	}
+
+	const CommandInfo* command = commandTable.Find(cmd.data, cmd.length);
+	if(command != NULL) bindingTable.Bind(slot, command, tokens.Rest());
+	else niftykbFunctions.ErrorMessage(scHandlerID, "Command not recognized");
+}
+
+void ScheduleCommand(uint64 scHandlerID, const CommandArgs& args, bool named, bool repeat)
+{
+	// Split the name and the delay from the command line, the line runs as if it was sent as a message
+	if(IsArgumentEmpty(scHandlerID, args.text)) return;
+
+	char name[SCHEDULE_NAME_BUFSIZE] = "";
+	uint64 msecs;
+	StringRef token, cmd;
+	Tokenizer tokens(args.text);
+	if(named)
+	{
+		if(!tokens.Next(&token) || token.length >= SCHEDULE_NAME_BUFSIZE)
 		{
-			uint64 handle = niftykbFunctions.GetServerHandleByVariable(arg, VIRTUALSERVER_NAME);
-			if(handle != (uint64)NULL && handle != scHandlerID)
-			{
-				CancelWaitableTimer(hPttDelayTimer);
-				niftykbFunctions.SetActiveServer(handle);
-			}
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Server not found");
+			niftykbFunctions.ErrorMessage(scHandlerID, "Invalid schedule name");
+			return;
 		}
+		memcpy(name, token.data, token.length);
+		name[token.length] = (char)NULL;
 	}
-	else if(!strcmp(cmd, "TS3_ACTIVATE_SERVERID"))
+	if(!tokens.Next(&token) || !ParseScheduleMsecs(token, &msecs))
 	{
-		if(!IsArgumentEmpty(scHandlerID, arg))
+		niftykbFunctions.ErrorMessage(scHandlerID, "Invalid delay");
+		return;
+	}
+
+	// Check the command now, a typo should not only show up once the delay passed
+	char* line = tokens.Rest();
+	if(IsArgumentEmpty(scHandlerID, line)) return;
+	Tokenizer lineTokens(line);
+	if(!lineTokens.Next(&cmd) || (*cmd.data != BINDING_PREFIX && commandTable.Find(cmd.data, cmd.length) == NULL))
+	{
+		niftykbFunctions.ErrorMessage(scHandlerID, "Command not recognized");
+		return;
+	}
+
+	// A repeat runs first after one interval, send the command itself as well to run it right away
+	uint64 delay = msecs * 1000;
+	if(!scheduler.Add(name, line, pluginClock->Now(), delay, repeat ? delay : 0))
+		niftykbFunctions.ErrorMessage(scHandlerID, "Too many scheduled commands");
+}
+
+// State shared by the commands in one message
+typedef struct
+{
+	bool background;   // Running on the background lane
+	uint64 received;   // Timestamps for the latency statistics
+	uint64 locked;
+	StatsBatch* stats;
+} MessageContext;
+
+// Hands a slow call to the background thread, the executor keeps running the high priority lane until it returns
+void RunOnBackground(BackgroundCall* call);
+
+/*
+ * Runs a command on the executor. On the background lane the target is resolved and handlers that do not
+ * touch plugin state run on the background thread, so slow lookups never hold back the high priority lane.
+ */
+bool ExecuteCommand(uint64 scHandlerID, const CommandInfo* command, char* arg, CommandBinding* binding, const MessageContext& context, ReturnCode* returnCode, const TypedArgs* typed = NULL)
+{
+	bool background = context.background;
+
+	// Check the requirements before running the handler, a typed argument only stands in for the text
+	// when the handler uses it: a target for commands with a resolver, a number for numeric commands
+	bool hasTyped = typed != NULL && ((typed->hasTarget && command->resolver != NULL)
+		|| (typed->hasNumber && (command->flags & COMMAND_FLAG_NUMBER)));
+	if((command->flags & COMMAND_FLAG_CONNECTION) && !IsConnected(scHandlerID)) return false;
+	if((command->flags & (COMMAND_FLAG_ARGUMENT | COMMAND_FLAG_NUMBER)) && !hasTyped && IsArgumentEmpty(scHandlerID, arg)) return false;
+
+	// The binding may be changed by the high priority lane during a slow call, work on a copy of its argument
+	char argument[MESSAGE_BUFSIZE];
+	unsigned long version = (binding != NULL) ? binding->version : 0;
+	if(background && binding != NULL && arg != NULL)
+	{
+		_strcpy(argument, MESSAGE_BUFSIZE, arg);
+		arg = argument;
+	}
+
+	CommandArgs args;
+	args.text = arg;
+	args.target = (uint64)NULL;
+	args.hasNumber = typed != NULL && typed->hasNumber;
+	args.number = args.hasNumber ? typed->number : 0.0f;
+	args.returnCode = returnCode;
+
+	// Resolve the target, bindings reuse their previous resolution until it is invalidated
+	if(command->resolver != NULL)
+	{
+		if(typed != NULL && typed->hasTarget) args.target = typed->target;
+		else if(binding == NULL || !bindingTable.GetCachedTarget(binding, scHandlerID, &args.target))
 		{
-			uint64 handle = niftykbFunctions.GetServerHandleByVariable(arg, VIRTUALSERVER_UNIQUE_IDENTIFIER);
-			if(handle != (uint64)NULL)
+			// Read the generation first so an invalidation during the lookup is not missed
+			unsigned long generation = bindingTable.Generation(command->target);
+			if(background)
 			{
-				CancelWaitableTimer(hPttDelayTimer);
-				niftykbFunctions.SetActiveServer(handle);
+				BackgroundCall call = { command, scHandlerID, arg, NULL, (uint64)NULL, false };
+				RunOnBackground(&call);
+				args.target = call.target;
+			}
+			else args.target = command->resolver(scHandlerID, arg);
+
+			// Only cache the resolution if the slot was not rebound during the lookup
+			if(binding != NULL && args.target != (uint64)NULL && binding->version == version)
+			{
+				bindingTable.SetCachedTarget(binding, scHandlerID, generation, args.target);
+
+				// The resolver may have modified the scratch copy, restore it for the handler
+				if(!background) memcpy(&binding->scratch[0], &binding->arg[0], binding->arg.size());
 			}
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Server not found");
 		}
-	}
-	else if(!strcmp(cmd, "TS3_ACTIVATE_SERVERIP"))
-	{
-		if(!IsArgumentEmpty(scHandlerID, arg))
+
+		if(args.target == (uint64)NULL)
 		{
-			uint64 handle = niftykbFunctions.GetServerHandleByVariable(arg, VIRTUALSERVER_IP);
-			if(handle != (uint64)NULL)
+			switch(command->target)
 			{
-				CancelWaitableTimer(hPttDelayTimer);
-				niftykbFunctions.SetActiveServer(handle);
+			case COMMAND_TARGET_SERVER: niftykbFunctions.ErrorMessage(scHandlerID, "Server not found"); break;
+			case COMMAND_TARGET_CHANNEL: niftykbFunctions.ErrorMessage(scHandlerID, "Channel not found"); break;
+			case COMMAND_TARGET_CLIENT: niftykbFunctions.ErrorMessage(scHandlerID, "Client not found"); break;
+			default: break;
 			}
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Server not found");
+			return false;
 		}
 	}
-	else if(!strcmp(cmd, "TS3_ACTIVATE_CURRENT"))
+
+	CommandTiming timing;
+	timing.command = command - commands;
+	timing.received = context.received;
+	timing.locked = context.locked;
+	timing.resolved = StatsNow();
+
+	if(background && command->lane == COMMAND_LANE_BACKGROUND_UNLOCKED)
 	{
-		uint64 handle = ts3Functions.getCurrentServerConnectionHandlerID();
-		if(handle != (uint64)NULL)
-		{
-			CancelWaitableTimer(hPttDelayTimer);
-			niftykbFunctions.SetActiveServer(handle);
-		}
-		else niftykbFunctions.ErrorMessage(scHandlerID, "Server not found");
+		BackgroundCall call = { command, scHandlerID, NULL, &args, (uint64)NULL, false };
+		RunOnBackground(&call);
 	}
-	else if(!strcmp(cmd, "TS3_SERVER_NEXT"))
+	else command->handler(scHandlerID, args);
+
+	// The flush time is filled in once the whole message has run
+	timing.returned = StatsNow();
+	context.stats->Add(timing);
+	return true;
+}
+
+bool ExecuteBinding(uint64 scHandlerID, CommandBinding* binding, const MessageContext& context, ReturnCode* returnCode)
+{
+	// Hand the command a copy of the argument, the bound argument must survive modification
+	memcpy(&binding->scratch[0], &binding->arg[0], binding->arg.size());
+	return ExecuteCommand(scHandlerID, binding->command, binding->arg.size() > 1 ? &binding->scratch[0] : NULL, binding, context, returnCode);
+}
+
+/*
+ * Runs a command or a binding and acknowledges the result, command is NULL if it was not found.
+ */
+void DispatchCommand(uint64 scHandlerID, const char* id, const CommandInfo* command, CommandBinding* binding, char* arg, const TypedArgs* typed, const MessageContext& context)
+{
+	// Server requests are sent with a return code so the response can be acknowledged
+	bool ack = ackChannel.IsOpen();
+	ReturnCode returnCode;
+	returnCode.used = false;
+	if(ack && pluginID != NULL)
 	{
-		CancelWaitableTimer(hPttDelayTimer);
-		niftykbFunctions.SetNextActiveServer(scHandlerID);
+		clientFunctions->createReturnCode(pluginID, returnCode.code, RETURNCODE_BUFSIZE);
+		returnCode.id = id;
+		returnCode.received = context.received;
 	}
-	else if(!strcmp(cmd, "TS3_SERVER_PREV"))
+	ReturnCode* code = (ack && pluginID != NULL) ? &returnCode : NULL;
+
+	bool ok = false;
+	if(command != NULL)
 	{
-		CancelWaitableTimer(hPttDelayTimer);
-		niftykbFunctions.SetPrevActiveServer(scHandlerID);
+		returnCode.command = command->name;
+		if(binding != NULL) ok = ExecuteBinding(scHandlerID, binding, context, code);
+		else ok = ExecuteCommand(scHandlerID, command, arg, NULL, context, code, typed);
 	}
-	else if(!strcmp(cmd, "TS3_JOIN_CHANNEL"))
+
+	// Server requests are acknowledged once the server responds
+	if(ack && !returnCode.used)
+		ackChannel.Send(id, (command != NULL) ? command->name : "-", ok, StatsNow() - context.received);
+}
+
+void ParseCommand(uint64 scHandlerID, char* line, const MessageContext& context)
+{
+	// Separate the argument from the command
+	StringRef cmd;
+	Tokenizer tokens(line);
+	if(!tokens.Next(&cmd)) return;
+
+	// The sender may identify the command to match up its acknowledgement
+	char id[ACK_ID_BUFSIZE] = "-";
+	if(*cmd.data == ACK_ID_PREFIX && cmd.length > 1)
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
-		{
-			uint64 id = niftykbFunctions.GetChannelIDFromPath(scHandlerID, arg);
-			if(id == (uint64)NULL) id = niftykbFunctions.GetChannelIDByVariable(scHandlerID, arg, CHANNEL_NAME);
-			if(id != (uint64)NULL) niftykbFunctions.JoinChannel(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Channel not found");
-		}
+		size_t length = (cmd.length-1 < ACK_ID_BUFSIZE) ? cmd.length-1 : ACK_ID_BUFSIZE-1;
+		memcpy(id, cmd.data+1, length);
+		id[length] = (char)NULL;
+		if(!tokens.Next(&cmd)) return;
 	}
-	else if(!strcmp(cmd, "TS3_JOIN_CHANNELID"))
+	char* arg = tokens.Rest();
+
+	const CommandInfo* command = NULL;
+	CommandBinding* binding = NULL;
+	if(*cmd.data == BINDING_PREFIX)
+	{
+		// Trigger a bound command
+		unsigned int slot;
+		StringRef number = { cmd.data+1, cmd.length-1 };
+		binding = ParseBindingSlot(number, &slot) ? bindingTable.Get(slot) : NULL;
+		if(binding != NULL) command = binding->command;
+		else niftykbFunctions.ErrorMessage(scHandlerID, "Binding not found");
+	}
+	else
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		// Look up the command
+		command = commandTable.Find(cmd.data, cmd.length);
+		if(command == NULL)
 		{
-			uint64 id = atoi(arg);
-			if(id != (uint64)NULL) niftykbFunctions.JoinChannel(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Channel not found");
+			char name[COMMAND_BUFSIZE];
+			size_t length = (cmd.length < COMMAND_BUFSIZE) ? cmd.length : COMMAND_BUFSIZE-1;
+			memcpy(name, cmd.data, length);
+			name[length] = (char)NULL;
+
+			ts3Functions.logMessage("Command not recognized:", LogLevel_WARNING, "NiftyKb Plugin", 0);
+			ts3Functions.logMessage(name, LogLevel_WARNING, "NiftyKb Plugin", 0);
+			niftykbFunctions.ErrorMessage(scHandlerID, "Command not recognized");
 		}
 	}
-	else if(!strcmp(cmd, "TS3_CHANNEL_NEXT"))
+
+	DispatchCommand(scHandlerID, id, command, binding, arg, NULL, context);
+}
+
+// The command of a binary frame, or the bound command for FRAME_OPCODE_BINDING
+const CommandInfo* FindFrameCommand(const FrameCommand& cmd, CommandBinding** binding)
+{
+	*binding = NULL;
+	if(cmd.opcode != FRAME_OPCODE_BINDING) return commandTable.FindOpcode(cmd.opcode);
+
+	if(cmd.typed.hasTarget && cmd.typed.target < BindingTable::MAX_BINDINGS) *binding = bindingTable.Get((unsigned int)cmd.typed.target);
+	return (*binding != NULL) ? (*binding)->command : NULL;
+}
+
+void ParseFrame(uint64 scHandlerID, Message* message, const MessageContext& context)
+{
+	FrameReader frame(message->data, message->length);
+	FrameCommand cmd;
+	while(frame.Next(&cmd))
 	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.JoinNextChannel(scHandlerID);
+		uint64 server = cmd.hasServer ? cmd.server : scHandlerID;
+
+		CommandBinding* binding;
+		const CommandInfo* command = FindFrameCommand(cmd, &binding);
+		if(command == NULL)
+		{
+			if(cmd.opcode == FRAME_OPCODE_BINDING) niftykbFunctions.ErrorMessage(server, "Binding not found");
+			else
+			{
+				char name[COMMAND_BUFSIZE];
+				snprintf(name, COMMAND_BUFSIZE, "Opcode %u", cmd.opcode);
+				ts3Functions.logMessage("Command not recognized:", LogLevel_WARNING, "NiftyKb Plugin", 0);
+				ts3Functions.logMessage(name, LogLevel_WARNING, "NiftyKb Plugin", 0);
+				niftykbFunctions.ErrorMessage(server, "Command not recognized");
+			}
+		}
+		else if(cmd.hasServer && cmd.server != scHandlerID && !niftykbFunctions.IsServerConnectionHandler(cmd.server))
+		{
+			// Commands keep state per server, never let a frame address a server that does not exist
+			niftykbFunctions.ErrorMessage(scHandlerID, "Server not found");
+			command = NULL;
+			binding = NULL;
+			server = scHandlerID;
+		}
+
+		// Typed arguments do not apply to bindings, they run with the arguments they were bound with
+		DispatchCommand(server, cmd.id, command, binding, cmd.text, (binding == NULL) ? &cmd.typed : NULL, context);
 	}
-	else if(!strcmp(cmd, "TS3_CHANNEL_PREV"))
+
+	if(frame.Failed()) ts3Functions.logMessage("Malformed command frame", LogLevel_WARNING, "NiftyKb Plugin", 0);
+}
+
+/*
+ * A message holds one command per line. All commands in a batch of messages run in one go on the
+ * server that was active when the batch arrived, self updates are flushed once per server at the end.
+ * Runs on the executor, on the background lane the high priority lane runs during slow lookups, see ExecuteCommand.
+ */
+void ParseMessages(Message** messages, size_t count, bool background)
+{
+	StatsBatch stats;
+	MessageContext context;
+	context.background = background;
+	context.locked = StatsNow();
+	context.stats = &stats;
+
+	// Get the active server
+	uint64 scHandlerID = niftykbFunctions.GetActiveServerConnectionHandlerID();
+	if(scHandlerID == NULL)
 	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.JoinPrevChannel(scHandlerID);
+		ts3Functions.logMessage("Failed to get an active server, falling back to current server", LogLevel_DEBUG, "NiftyKb Plugin", 0);
+		scHandlerID = clientFunctions->getCurrentServerConnectionHandlerID();
 	}
-	else if(!strcmp(cmd, "TS3_KICK_CLIENT"))
+
+	niftykbFunctions.BeginBatch();
+
+	for(size_t i=0; i<count; i++)
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		context.received = messages[i]->received;
+
+		// Binary frames carry their commands ready to run
+		if(IsFrame(messages[i]->data, messages[i]->length))
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_NICKNAME);
-			if(id != (anyID)NULL) niftykbFunctions.ServerKickClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			ParseFrame(scHandlerID, messages[i], context);
+			continue;
+		}
+
+		char* line = messages[i]->data;
+		while(line != NULL)
+		{
+			// Split the lines by inserting a NULL-terminator
+			char* next = strchr(line, '\n');
+			if(next != NULL)
+			{
+				*next = (char)NULL;
+				next++;
+			}
+
+			// Accept both line endings
+			size_t length = strlen(line);
+			if(length > 0 && line[length-1] == '\r') line[length-1] = (char)NULL;
+
+			if(*line != (char)NULL) ParseCommand(scHandlerID, line, context);
+			line = next;
 		}
 	}
-	else if(!strcmp(cmd, "TS3_KICK_CLIENTID"))
+
+	// Flush now, or hold the updates back until the flush timer expires
+	niftykbFunctions.EndBatch(flushDelay == 0);
+	if(niftykbFunctions.HasPendingUpdates() && !flushTimer.IsArmed()) ArmTimer(&flushTimer, flushDelay);
+	stats.Commit(statsTable, StatsNow());
+
+	// The client variables are published once the server confirms them, see ts3plugin_onUpdateClientEvent
+	PublishPluginState(scHandlerID);
+}
+
+/*
+ * A message goes to the background lane if any of its commands does, the whole message moves
+ * so the commands in it still run in order.
+ */
+bool IsBackgroundMessage(Message* message)
+{
+	if(IsFrame(message->data, message->length))
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		FrameReader frame(message->data, message->length);
+		FrameCommand cmd;
+		while(frame.Next(&cmd))
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_UNIQUE_IDENTIFIER);
-			if(id != (anyID)NULL) niftykbFunctions.ServerKickClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			CommandBinding* binding;
+			const CommandInfo* command = FindFrameCommand(cmd, &binding);
+			if(command != NULL && command->lane != COMMAND_LANE_HIGH) return true;
 		}
+		return false;
 	}
-	else if(!strcmp(cmd, "TS3_CHANKICK_CLIENT"))
+
+	for(const char* line = message->data; line != NULL; line = strchr(line, '\n'))
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		if(*line == '\n') line++;
+
+		// Find the command name, skipping the acknowledgement identifier
+		while(*line == ' ') line++;
+		if(*line == ACK_ID_PREFIX)
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_NICKNAME);
-			if(id != (anyID)NULL) niftykbFunctions.ChannelKickClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			line += strcspn(line, " \r\n");
+			while(*line == ' ') line++;
 		}
+		size_t length = strcspn(line, " \r\n");
+		if(length == 0) continue;
+
+		const CommandInfo* command = NULL;
+		if(*line == BINDING_PREFIX)
+		{
+			unsigned int slot;
+			StringRef number = { line+1, length-1 };
+			CommandBinding* binding = ParseBindingSlot(number, &slot) ? bindingTable.Get(slot) : NULL;
+			if(binding != NULL) command = binding->command;
+		}
+		else command = commandTable.Find(line, length);
+
+		if(command != NULL && command->lane != COMMAND_LANE_HIGH) return true;
 	}
-	else if(!strcmp(cmd, "TS3_CHANKICK_CLIENTID"))
+	return false;
+}
+
+/*
+ * Finds out how a queued message may be collapsed, see collapseRules. Only a message with a single text
+ * command collapses, messages with an acknowledgement identifier, bindings and binary frames are kept as they are.
+ */
+CollapseInfo ClassifyMessage(const Message* message)
+{
+	CollapseInfo info;
+	info.kind = COLLAPSE_NONE;
+	info.group = 0;
+	info.amount = 0.0f;
+	if(IsFrame(message->data, message->length)) return info;
+
+	// The command must be the only line of the message
+	const char* line = message->data;
+	while(*line == ' ') line++;
+	size_t length = strcspn(line, " \r\n");
+	const char* end = line + strcspn(line, "\r\n");
+	if(length == 0 || end[strspn(end, " \r\n")] != (char)NULL) return info;
+
+	const CommandInfo* command = commandTable.Find(line, length);
+	if(command == NULL) return info;
+
+	for(size_t i=0; i<sizeof(collapseRules)/sizeof(CollapseRule); i++)
+	{
+		const CollapseRule& rule = collapseRules[i];
+		if(rule.opcode != command->opcode) continue;
+
+		// Steps are one unless the argument says otherwise, like GetNumberArg
+		const char* arg = line + length;
+		while(*arg == ' ') arg++;
+		info.kind = rule.kind;
+		info.group = rule.group;
+		info.amount = rule.sign * ((arg < end) ? (float)atof(arg) : 1.0f);
+		break;
+	}
+	return info;
+}
+
+void FormatStep(Message* message, unsigned int group, float amount)
+{
+	const CommandInfo* command = commandTable.FindOpcode(group);
+	int length = snprintf(message->data, MESSAGE_BUFSIZE, "%s %g", command->name, amount);
+	message->length = (length > 0) ? (size_t)length : 0;
+}
+
+/*
+ * Refuses a message that found no room on its lane and returns its buffer to the pool. Every command in it
+ * is acknowledged as failed, so a sender waiting for its acknowledgements learns about it.
+ */
+void RejectMessage(Message* message, const char* reason)
+{
+	ts3Functions.logMessage(reason, LogLevel_WARNING, "NiftyKb Plugin", 0);
+
+	if(ackChannel.IsOpen())
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		uint64 dispatch = StatsNow() - message->received;
+		if(IsFrame(message->data, message->length))
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_UNIQUE_IDENTIFIER);
-			if(id != (anyID)NULL) niftykbFunctions.ChannelKickClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			FrameReader frame(message->data, message->length);
+			FrameCommand cmd;
+			while(frame.Next(&cmd))
+			{
+				CommandBinding* binding;
+				const CommandInfo* command = FindFrameCommand(cmd, &binding);
+				ackChannel.Send(cmd.id, (command != NULL) ? command->name : "-", false, dispatch);
+			}
 		}
+		else
+		{
+			for(char* line = message->data; line != NULL; line = strchr(line, '\n'))
+			{
+				if(*line == '\n') line++;
+
+				// Split off the acknowledgement identifier and the command name
+				char id[ACK_ID_BUFSIZE] = "-";
+				char name[COMMAND_BUFSIZE];
+				line += strspn(line, " ");
+				size_t length = strcspn(line, " \r\n");
+				if(*line == ACK_ID_PREFIX && length > 1)
+				{
+					size_t idLength = (length-1 < ACK_ID_BUFSIZE) ? length-1 : ACK_ID_BUFSIZE-1;
+					memcpy(id, line+1, idLength);
+					id[idLength] = (char)NULL;
+					line += length;
+					line += strspn(line, " ");
+					length = strcspn(line, " \r\n");
+				}
+				if(length == 0) continue;
+
+				if(length >= COMMAND_BUFSIZE) length = COMMAND_BUFSIZE-1;
+				memcpy(name, line, length);
+				name[length] = (char)NULL;
+				ackChannel.Send(id, name, false, dispatch);
+			}
+		}
+	}
+
+	messagePool.Release(message);
+}
+
+/*
+ * Runs the high priority messages that were posted to the executor, a batch at a time.
+ * Runs on the executor.
+ */
+void RunCommandQueue()
+{
+	Message* batch[MESSAGE_BATCH_SIZE];
+	size_t count;
+	do
+	{
+		count = 0;
+		while(count < MESSAGE_BATCH_SIZE && (batch[count] = commandQueue.Pop()) != NULL)
+			count++;
+		if(count > 0) ParseMessages(batch, count, false);
+
+		for(size_t i=0; i<count; i++)
+			messagePool.Release(batch[i]);
+	} while(count == MESSAGE_BATCH_SIZE);
+}
+
+/*
+ * Puts a message on its lane. The messages that were queued together run as one batch once all of them
+ * are on the lane. Only when the high priority lane is full, even after collapsing it, does the lane run
+ * right away to make room, so a fast command is never rejected.
+ * Runs on the executor.
+ */
+void RouteMessage(Message* message)
+{
+	if(IsBackgroundMessage(message))
+	{
+		if(!backgroundQueue.Push(message, ClassifyMessage(message)))
+			RejectMessage(message, "Background queue full, message rejected");
+		return;
 	}
-	else if(!strcmp(cmd, "TS3_BOOKMARK_CONNECT"))
+
+	if(!commandQueue.Push(message, ClassifyMessage(message)))
 	{
-		if(!IsArgumentEmpty(scHandlerID, arg))
-			niftykbFunctions.ConnectToBookmark(arg, PLUGIN_CONNECT_TAB_NEW_IF_CURRENT_CONNECTED, &scHandlerID);
+		// The queued messages arrived first
+		RunCommandQueue();
+		ParseMessages(&message, 1, false);
+		messagePool.Release(message);
 	}
-	/***** Whispering *****/
-	else if(!strcmp(cmd, "TS3_WHISPER_ACTIVATE"))
+}
+
+// Runs on the executor, for the messages that were posted to it
+void QueueMessage(const ExecutorTask& task)
+{
+	RouteMessage(task.message);
+}
+
+/*
+ * Queues a scheduled command line as a message of its own. The timers are run before the high priority lane,
+ * so all lines that are due at once run as one batch in the same wakeup.
+ * Runs on the executor.
+ */
+void RunScheduledCommand(const char* line, uint64 due)
+{
+	Message* message = messagePool.Acquire();
+	if(message == NULL)
 	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetWhisperList(scHandlerID, TRUE);
+		ts3Functions.logMessage("No message buffer left, scheduled command skipped", LogLevel_WARNING, "NiftyKb Plugin", 0);
+		return;
 	}
-	else if(!strcmp(cmd, "TS3_WHISPER_DEACTIVATE"))
+
+	// The latency statistics count from the time the line was due
+	uint64 now = pluginClock->Now();
+	_strcpy(message->data, MESSAGE_BUFSIZE, line);
+	message->length = strlen(message->data);
+	message->received = StatsNow() - ((now > due) ? now - due : 0);
+	message->peer = 0;
+	RouteMessage(message);
+}
+
+/*
+ * Queues a received message with its sender and takes ownership of its buffer. A message dropped by the
+ * rate limit is only counted, logging it would let a flooding sender flood the log.
+ * Runs on the executor, for the messages that were posted to it.
+ */
+void AdmitMessage(const ExecutorTask& task)
+{
+	if(!senders.Admit(task.message, task.message->sender, pluginClock->Now())) messagePool.Release(task.message);
+}
+
+/*
+ * Posts a batch of messages to the executor and takes ownership of their buffers. Never waits, a message
+ * is only rejected if the executor has a whole queue of tasks waiting.
+ */
+void PostMessages(Message** messages, size_t count, TaskProc proc)
+{
+	ExecutorTask task;
+	task.proc = proc;
+	task.data = NULL;
+	task.scHandlerID = 0;
+	task.value = 0;
+
+	for(size_t i=0; i<count; i++)
 	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetWhisperList(scHandlerID, FALSE);
+		task.message = messages[i];
+		if(!executor.Post(task)) RejectMessage(messages[i], "Executor queue full, message rejected");
 	}
-	else if(!strcmp(cmd, "TS3_WHISPER_TOGGLE"))
+}
+
+// Messages that skip the rate limit, like the commands typed in the console
+void SubmitMessages(Message** messages, size_t count)
+{
+	PostMessages(messages, count, QueueMessage);
+}
+
+// Received messages, the executor queues them by the sender named in message->sender
+void AdmitMessages(Message** messages, size_t count)
+{
+	PostMessages(messages, count, AdmitMessage);
+}
+
+/*
+ * Puts the queued messages the rate limits allow on their lanes, round-robin over the senders.
+ * Runs on the executor.
+ */
+void RunSenders(uint64 now)
+{
+	Message* batch[MESSAGE_BATCH_SIZE];
+	size_t count;
+	while((count = senders.Schedule(batch, MESSAGE_BATCH_SIZE, now)) > 0)
 	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetWhisperList(scHandlerID, !niftykbFunctions.whisperActive);
+		for(size_t i=0; i<count; i++)
+			RouteMessage(batch[i]);
 	}
-	else if(!strcmp(cmd, "TS3_WHISPER_CLEAR"))
+}
+
+/*********************************** Self state ************************************/
+
+void PublishPluginState(uint64 scHandlerID)
+{
+	// A server without state has nothing active
+	unsigned int flags = 0;
+	ServerState* state = niftykbFunctions.FindServerState(scHandlerID);
+	if(state != NULL)
+	{
+		if(state->pttActive) flags |= SNAPSHOT_PTT;
+		if(state->vadActive) flags |= SNAPSHOT_VAD;
+		if(state->inputActive) flags |= SNAPSHOT_CONTINUOUS;
+		if(state->whisperActive) flags |= SNAPSHOT_WHISPER;
+		if(state->replyActive) flags |= SNAPSHOT_REPLY;
+	}
+	statePublisher.SetPluginState(scHandlerID, flags);
+}
+
+void PublishServerState(uint64 scHandlerID)
+{
+	// Not published until the own client has an ID on the server
+	anyID clientID;
+	if(clientFunctions->getClientID(scHandlerID, &clientID) != ERROR_ok || clientID == 0) return;
+
+	int value;
+	unsigned int flags = 0;
+	if(clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED, &value) == ERROR_ok && value) flags |= SNAPSHOT_INPUT_DEACTIVATED;
+	if(clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_MUTED, &value) == ERROR_ok && value) flags |= SNAPSHOT_INPUT_MUTED;
+	if(clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_OUTPUT_MUTED, &value) == ERROR_ok && value) flags |= SNAPSHOT_OUTPUT_MUTED;
+	if(clientFunctions->getClientSelfVariableAsInt(scHandlerID, CLIENT_AWAY, &value) == ERROR_ok && value) flags |= SNAPSHOT_AWAY;
+	statePublisher.SetServerState(scHandlerID, clientID, flags);
+}
+
+/*********************************** Statistics ************************************/
+
+// Runs on the executor, post it from other threads
+void PrintStats(const ExecutorTask&)
+{
+	static const char* stageNames[STATS_STAGE_COUNT] = { "lock", "resolve", "execute", "flush", "total" };
+
+	ts3Functions.printMessageToCurrentTab("NiftyKb command latency in microseconds (p50/p99/max):");
+	bool empty = true;
+	for(size_t i=0; i<sizeof(commands)/sizeof(CommandInfo); i++)
+	{
+		const CommandStats* stats = statsTable.Get(i);
+		if(stats == NULL || stats->stages[STATS_STAGE_TOTAL].Count() == 0) continue;
+
+		std::stringstream ss;
+		ss << commands[i].name << " (" << stats->stages[STATS_STAGE_TOTAL].Count() << ")";
+		for(int j=0; j<STATS_STAGE_COUNT; j++)
+		{
+			const Histogram& histogram = stats->stages[j];
+			ss << " " << stageNames[j] << " " << histogram.Percentile(50.0) << "/" << histogram.Percentile(99.0) << "/" << histogram.Max();
+		}
+		ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+		empty = false;
+	}
+	if(empty) ts3Functions.printMessageToCurrentTab("No commands recorded");
+
+	// Sender counters
+	SenderStats senderStats[SENDER_SLOTS];
+	size_t senderCount = senders.Snapshot(senderStats, SENDER_SLOTS);
+	if(senderCount > 0) ts3Functions.printMessageToCurrentTab("NiftyKb senders (accepted/throttled/dropped):");
+	for(size_t i=0; i<senderCount; i++)
+	{
+		std::stringstream ss;
+		ss << senderStats[i].name << " " << senderStats[i].accepted << "/" << senderStats[i].throttled << "/" << senderStats[i].dropped;
+		ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+	}
+
+	// Queue counters
+	static const char* laneNames[2] = { "high", "background" };
+	CommandQueue* queues[2] = { &commandQueue, &backgroundQueue };
+	ts3Functions.printMessageToCurrentTab("NiftyKb command queues (depth/peak/collapsed/rejected):");
+	for(int i=0; i<2; i++)
+	{
+		CommandQueueStats queueStats;
+		queues[i]->GetStats(&queueStats);
+
+		std::stringstream ss;
+		ss << laneNames[i] << " " << queueStats.depth << "/" << queueStats.peak << "/" << queueStats.collapsed << "/" << queueStats.rejected;
+		ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+	}
+}
+
+// Runs on the executor, post it from other threads
+void ResetStats(const ExecutorTask&)
+{
+	statsTable.Reset();
+	senders.ResetStats();
+	commandQueue.ResetStats();
+	backgroundQueue.ResetStats();
+	ts3Functions.printMessageToCurrentTab("NiftyKb command statistics reset");
+}
+
+/*********************************** Plugin threads ************************************/
+/*
+ * NOTE: Threads block until there is work for them, a thread that blocks must be woken
+ * by the shutdown procedure. It will not wait longer than PLUGIN_THREAD_TIMEOUT for a thread to exit.
+ */
+
+/*
+ * Opens a command endpoint before its receive thread is started, so the shutdown procedure can always
+ * wake the thread, even if it is stopped right after it was started.
+ */
+bool OpenEndpoint(Transport* transport)
+{
+	if(!transport->Open())
 	{
-		niftykbFunctions.WhisperListClear(scHandlerID);
+		std::string error = std::string("Failed to open command endpoint ") + transport->Name();
+		ts3Functions.logMessage(error.c_str(), LogLevel_ERROR, "NiftyKb Plugin", 0);
+		receiveError = PLUGIN_ERROR_CREATESLOT_FAILED;
+		return false;
 	}
-	else if(!strcmp(cmd, "TS3_WHISPER_CLIENT"))
+
+	std::string info = std::string("Command endpoint opened at ") + transport->Name();
+	ts3Functions.logMessage(info.c_str(), LogLevel_INFO, "NiftyKb Plugin", 0);
+	return true;
+}
+
+unsigned long ReceiveThread(void* pData)
+{
+	Transport* transport = (Transport*)pData;
+
+	// While the plugin is running
+	Message* batch[MESSAGE_BATCH_SIZE];
+	while (pluginRunning)
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		// Retrieve message into a pooled buffer
+		Message* message = messagePool.Acquire();
+		if (message == NULL) {
+			SleepMsecs(1); // all buffers are in use, try again later
+			continue;
+		}
+
+		// Block until a message arrives, the shutdown procedure wakes us
+		TransportResult result = transport->Receive(message);
+		if (result == TRANSPORT_ERROR) {
+			messagePool.Release(message);
+			ts3Functions.logMessage("Failed to read command endpoint", LogLevel_ERROR, "NiftyKb Plugin", 0);
+			receiveError = PLUGIN_ERROR_READ_FAILED;
+			return PLUGIN_ERROR_READ_FAILED;
+		}
+		if (!pluginRunning || result != TRANSPORT_MESSAGE) {
+			messagePool.Release(message);
+			continue;
+		}
+		uint64 received = StatsNow();
+		message->received = received;
+		batch[0] = message;
+
+		// Drain the messages that arrived in the meantime, the whole burst is handled in one go
+		size_t count = 1;
+		while (count < MESSAGE_BATCH_SIZE && (message = messagePool.Acquire()) != NULL)
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_NICKNAME);
-			if(id != (anyID)NULL) niftykbFunctions.WhisperAddClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			if (transport->Poll(message) != TRANSPORT_MESSAGE) {
+				messagePool.Release(message);
+				break;
+			}
+			message->received = received;
+			batch[count++] = message;
 		}
-	}
-	else if(!strcmp(cmd, "TS3_WHISPER_CLIENTID"))
-	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+
+		// Name the senders and hand the burst to the executor, it queues the messages by sender
+		for (size_t i=0; i<count; i++)
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_UNIQUE_IDENTIFIER);
-			if(id != (anyID)NULL) niftykbFunctions.WhisperAddClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			IdentifySender(batch[i]);
+			trafficRecorder.Write(batch[i], batch[i]->sender, received);
 		}
+		AdmitMessages(batch, count);
 	}
-	else if(!strcmp(cmd, "TS3_WHISPER_CHANNEL"))
+
+	return PLUGIN_ERROR_NONE;
+}
+
+void CompleteBackgroundCall(const ExecutorTask& task)
+{
+	// Posted by the background thread once the call returned, its result is visible from here on
+	((BackgroundCall*)task.data)->done = true;
+}
+
+void SenderTimerCallback(WheelTimer*)
+{
+	// Runs on the executor, the released messages go on their lanes
+	RunSenders(pluginClock->Now());
+}
+
+void ArmSenderTimer()
+{
+	// Follows the time the next throttled message may run
+	uint64 now = pluginClock->Now();
+	uint64 release = senders.NextRelease(now);
+	if(release == 0) timerWheel.Cancel(&senderTimer);
+	else if(!senderTimer.IsArmed() || senderTimer.expires != release)
+		timerWheel.Start(&senderTimer, now, (release > now) ? release - now : 0);
+}
+
+/*
+ * Runs the posted tasks, the expired timers and the high priority lane, returns the next deadline or 0 if
+ * no timer is armed. Runs on the executor, also while a slow call of the background lane is in flight.
+ */
+uint64 RunHighPriority()
+{
+	executor.RunPending();
+	ReportDroppedEvents();
+
+	// The posted messages were all admitted, so a burst takes turns by sender
+	RunSenders(pluginClock->Now());
+	timerWheel.Advance(pluginClock->Now());
+
+	RunCommandQueue();
+
+	ArmSenderTimer();
+	return timerWheel.NextExpiry();
+}
+
+/*
+ * Blocks the executor until a task is posted or the next deadline, the shutdown procedure wakes it.
+ * The executor sleeps on the system clock, on a virtual clock the driver moves the time and posts a
+ * task whenever it did.
+ */
+void WaitForWork(uint64 next)
+{
+	executor.Wait((pluginClock == &systemClock) ? next : 0);
+}
+
+void RunOnBackground(BackgroundCall* call)
+{
+	if(!pluginRunning) return;
+
+	backgroundInFlight = call;
+	backgroundCall = call;
+	backgroundEvent.Set();
+
+	// The call uses the plugin state of the command, only the high priority lane may run in the meantime
+	while(!call->done)
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		uint64 next = RunHighPriority();
+		if(call->done) break;
+
+		// Give up on a call the background thread never took because it stopped
+		if(backgroundExited && backgroundCall == call)
 		{
-			uint64 id = niftykbFunctions.GetChannelIDFromPath(scHandlerID, arg);
-			if(id == (uint64)NULL) id = niftykbFunctions.GetChannelIDByVariable(scHandlerID, arg, CHANNEL_NAME);
-			if(id != (uint64)NULL) niftykbFunctions.WhisperAddChannel(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Channel not found");
+			backgroundCall = NULL;
+			break;
 		}
-	}
-	else if(!strcmp(cmd, "TS3_WHISPER_CHANNELID"))
+		if(!executor.HasPending()) WaitForWork(next);
+	}
+
+	// Run what waited for the call, in the order it arrived
+	backgroundInFlight = NULL;
+	ExecutorTask deferred[DEFERRED_TASKS];
+	size_t count = deferredCount;
+	for(size_t i=0; i<count; i++)
+		deferred[i] = deferredTasks[i];
+	deferredCount = 0;
+	for(size_t i=0; i<count; i++)
+		deferred[i].proc(deferred[i]);
+}
+
+/*
+ * Runs the slow calls of the background lane, one at a time. The calls do not touch plugin state,
+ * the executor keeps it consistent while they run.
+ */
+unsigned long BackgroundThread(void*)
+{
+	while (true)
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		// Block until the executor hands us a call, the shutdown procedure signals the event to wake us
+		backgroundEvent.Wait();
+
+		BackgroundCall* call = backgroundCall;
+		if (call != NULL)
 		{
-			uint64 id = atoi(arg);
-			if(id != (uint64)NULL) niftykbFunctions.WhisperAddChannel(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Channel not found");
+			backgroundCall = NULL;
+			if (call->args == NULL) call->target = call->command->resolver(call->scHandlerID, call->arg);
+			else call->command->handler(call->scHandlerID, *call->args);
+
+			ExecutorTask task;
+			task.proc = CompleteBackgroundCall;
+			task.message = NULL;
+			task.data = call;
+			task.scHandlerID = 0;
+			task.value = 0;
+			while (!executor.Post(task))
+				SleepMsecs(1);
 		}
+
+		// A call handed over during shutdown is still finished, the executor waits for it
+		if (!pluginRunning) break;
 	}
-	else if(!strcmp(cmd, "TS3_REPLY_ACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetReplyList(scHandlerID, TRUE);
-	}
-	else if(!strcmp(cmd, "TS3_REPLY_DEACTIVATE"))
-	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetReplyList(scHandlerID, FALSE);
-	}
-	else if(!strcmp(cmd, "TS3_REPLY_TOGGLE"))
+
+	backgroundExited = true;
+	executor.Wake();
+	return PLUGIN_ERROR_NONE;
+}
+
+/*
+ * Runs a batch of background messages once everything else ran, returns false if there were none.
+ * Runs on the executor.
+ */
+bool RunBackgroundLane()
+{
+	Message* batch[MESSAGE_BATCH_SIZE];
+	size_t count = 0;
+	while (count < MESSAGE_BATCH_SIZE && (batch[count] = backgroundQueue.Pop()) != NULL)
+		count++;
+	if (count == 0) return false;
+
+	ParseMessages(batch, count, true);
+
+	for (size_t i=0; i<count; i++)
+		messagePool.Release(batch[i]);
+	return true;
+}
+
+unsigned long ExecutorThread(void*)
+{
+	while (pluginRunning)
 	{
-		if(IsConnected(scHandlerID))
-			niftykbFunctions.SetReplyList(scHandlerID, !niftykbFunctions.replyActive);
+		// Posted tasks, timers and the high priority lane first, the background lane when they are done
+		uint64 next = RunHighPriority();
+		if (executor.HasPending() || RunBackgroundLane()) continue;
+
+		WaitForWork(next);
 	}
-	else if(!strcmp(cmd, "TS3_REPLY_CLEAR"))
+
+	return PLUGIN_ERROR_NONE;
+}
+
+/*********************************** Clock ************************************/
+
+// Runs on the executor, the armed timers keep the time they had left on the previous clock
+void SwitchClockTask(const ExecutorTask& task)
+{
+	Clock* clock = (task.data != NULL) ? (Clock*)task.data : &systemClock;
+	if(clock != pluginClock)
 	{
-		niftykbFunctions.ReplyListClear(scHandlerID);
+		timerWheel.Rebase(clock->Now());
+		pluginClock = clock;
 	}
-	/***** Miscellaneous *****/
-	else if(!strcmp(cmd, "TS3_MUTE_CLIENT"))
+
+	clockMutex.Lock();
+	clockSwitched = true;
+	clockMutex.Unlock();
+	clockEvent.Set();
+}
+
+bool ClockReported(const bool* flag)
+{
+	clockMutex.Lock();
+	bool reported = *flag;
+	clockMutex.Unlock();
+	return reported;
+}
+
+void PluginUseClock(Clock* clock)
+{
+	ExecutorTask task;
+	task.proc = SwitchClockTask;
+	task.message = NULL;
+	task.data = clock;
+	task.scHandlerID = 0;
+	task.value = 0;
+
+	clockMutex.Lock();
+	clockSwitched = false;
+	clockMutex.Unlock();
+	while(pluginRunning && !executor.Post(task))
+		SleepMsecs(1);
+	while(pluginRunning && !ClockReported(&clockSwitched))
+		clockEvent.Wait();
+}
+
+// Runs the timers that are due and reports whether anything is still waiting to run
+void SettleTask(const ExecutorTask&)
+{
+	timerWheel.Advance(pluginClock->Now());
+	RunSenders(pluginClock->Now());
+	ArmSenderTimer();
+
+	// A slow call that was already handed to the background thread is still running
+	bool idle = !executor.HasPending() && commandQueue.IsEmpty() && backgroundQueue.IsEmpty() && backgroundInFlight == NULL;
+
+	clockMutex.Lock();
+	clockIdle = idle;
+	clockNextTimer = timerWheel.NextExpiry();
+	clockSettled = true;
+	clockMutex.Unlock();
+	clockEvent.Set();
+}
+
+uint64 PluginSettle()
+{
+	// The lanes, the timers they arm and the slow calls of the background lane all finish on the executor,
+	// so nothing is in flight once it reports idle
+	bool idle;
+	uint64 next;
+	do
+	{
+		clockMutex.Lock();
+		clockSettled = false;
+		clockMutex.Unlock();
+		while(pluginRunning && !executor.Post(SettleTask))
+			SleepMsecs(1);
+		while(pluginRunning && !ClockReported(&clockSettled))
+			clockEvent.Wait();
+
+		clockMutex.Lock();
+		idle = clockIdle;
+		next = clockNextTimer;
+		clockMutex.Unlock();
+	} while(pluginRunning && !idle);
+	return next;
+}
+
+unsigned long PluginWakeups()
+{
+	return executor.Wakeups();
+}
+
+void PluginAdvance(VirtualClock* clock, uint64 time)
+{
+	uint64 next;
+	while(pluginRunning && (next = PluginSettle()) != 0 && next <= time && next > clock->Now())
+		clock->Set(next);
+	clock->Set(time);
+}
+
+/*********************************** Recording and replay ************************************/
+
+// Swaps in the stand-in, starting from the state the client was in when the recording started
+void SwapInReplay(const ExecutorTask& task)
+{
+	if(DeferWhileBackground(task)) return;
+
+	// Release push-to-talk on the real client first, a held key or a pending release would keep it transmitting
+	if(pttDelayTimer.IsArmed())
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
-		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_NICKNAME);
-			if(id != (anyID)NULL) niftykbFunctions.MuteClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
-		}
+		timerWheel.Cancel(&pttDelayTimer);
+		niftykbFunctions.SetPushToTalk(pttDelayServer, false);
 	}
-	else if(!strcmp(cmd, "TS3_MUTE_CLIENTID"))
+	LeaveServer(task.scHandlerID);
+	niftykbFunctions.FlushPendingUpdates();
+	InitReplayFunctions(ts3Functions, task.scHandlerID, replayState, &replayFunctions);
+	clientFunctions = &replayFunctions;
+
+	// Push-to-talk starts out released on the stand-in, so every replay of a recording runs the same way
+	niftykbFunctions.RemoveServerState(task.scHandlerID);
+	statsTable.Reset();
+	senders.ResetStats();
+	replaySwapped = true;
+	replayEvent.Set();
+}
+
+// Hands the client back, leaving the state the replay ended in and the counters of the stand-in
+void HandBackReplay(const ExecutorTask& task)
+{
+	if(DeferWhileBackground(task)) return;
+	niftykbFunctions.FlushPendingUpdates();
+	CaptureClientState(*clientFunctions, task.scHandlerID, &replayState);
+	GetReplayCounters(&replayCounters);
+	clientFunctions = &ts3Functions;
+	timerWheel.Cancel(&pttDelayTimer);
+	niftykbFunctions.RemoveServerState(task.scHandlerID);
+	replaySwapped = false;
+	replayEvent.Set();
+}
+
+// Runs a swap on the executor and waits for it, returns false if the plugin stopped first
+bool HandOffReplay(TaskProc proc, uint64 scHandlerID, bool swapped)
+{
+	while(pluginRunning && !executor.Post(proc, scHandlerID))
+		SleepMsecs(1);
+	while(pluginRunning && replaySwapped != swapped)
+		replayEvent.Wait();
+	return replaySwapped == swapped;
+}
+
+void ReportDivergence(const char* name, float replayed, float recorded, bool* diverged)
+{
+	if(replayed == recorded) return;
+
+	std::stringstream ss;
+	ss << "Diverged: " << name << " is " << replayed << " after the replay, " << recorded << " in the recording";
+	ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+	*diverged = true;
+}
+
+/*
+ * Feeds a recording back through the senders and the command lanes at its original pace, divided by the
+ * replay speed. The client is replaced by a stand-in for the duration, so nothing reaches the server.
+ *
+ * A virtual replay does not wait at all: the clock jumps to every message and every timer in turn and
+ * the executor settles before it moves on, so a replay always runs the same way and only takes as long
+ * as the commands do.
+ */
+unsigned long ReplayThread(void*)
+{
+	TrafficLog log;
+	TrafficRecord record;
+	Message* message = messagePool.Acquire();
+	if(message == NULL || !log.Open(replayPath) || !log.Next(&record, message) || record.type != TRAFFIC_STATE)
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
-		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_UNIQUE_IDENTIFIER);
-			if(id != (anyID)NULL) niftykbFunctions.MuteClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
-		}
+		if(message != NULL) messagePool.Release(message);
+		ts3Functions.printMessageToCurrentTab("Could not read the recording");
+		replayRunning = false;
+		return PLUGIN_ERROR_NOT_FOUND;
 	}
-	else if(!strcmp(cmd, "TS3_UNMUTE_CLIENT"))
+
+	// Swap in the stand-in, starting from the state the client was in when the recording started
+	uint64 scHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
+	replayState = record.state;
+	if(!HandOffReplay(SwapInReplay, scHandlerID, true))
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
-		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_NICKNAME);
-			if(id != (anyID)NULL) niftykbFunctions.UnmuteClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
-		}
+		messagePool.Release(message);
+		replayRunning = false;
+		return PLUGIN_ERROR_NONE;
 	}
-	else if(!strcmp(cmd, "TS3_UNMUTE_CLIENTID"))
+
+	ClientState recorded;
+	bool hasRecorded = false;
+	size_t count = 0;
+	uint64 recordedTime = 0;
+	Clock* clock = &systemClock;
+	if(replayVirtual)
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
-		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_UNIQUE_IDENTIFIER);
-			if(id != (anyID)NULL) niftykbFunctions.UnmuteClient(scHandlerID, id);
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
-		}
+		// The virtual clock carries on from the system clock, or from where the last virtual replay stopped
+		replayClock.Set(StatsNow());
+		PluginUseClock(&replayClock);
+		clock = &replayClock;
 	}
-	else if(!strcmp(cmd, "TS3_MUTE_TOGGLE_CLIENT"))
+	uint64 started = clock->Now();
+	while(pluginRunning && message != NULL && log.Next(&record, message))
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+		recordedTime = record.time;
+		if(record.type == TRAFFIC_STATE)
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_NICKNAME);
-			if(id != (anyID)NULL)
-			{
-				int muted;
-				ts3Functions.getClientVariableAsInt(scHandlerID, id, CLIENT_IS_MUTED, &muted);
-				if(!muted) niftykbFunctions.MuteClient(scHandlerID, id);
-				else niftykbFunctions.UnmuteClient(scHandlerID, id);
-			}
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			// The last state record holds the state the client was in when the recording stopped
+			recorded = record.state;
+			hasRecorded = true;
+			continue;
 		}
-	}
-	else if(!strcmp(cmd, "TS3_MUTE_TOGGLE_CLIENTID"))
-	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
+
+		// Wait until the message is due, the shutdown procedure signals the event to wake us
+		uint64 due = started + (uint64)(record.time / replaySpeed);
+		if(replayVirtual) PluginAdvance(&replayClock, due);
+		uint64 now = clock->Now();
+		while(pluginRunning && now < due)
 		{
-			anyID id = niftykbFunctions.GetClientIDByVariable(scHandlerID, arg, CLIENT_UNIQUE_IDENTIFIER);
-			if(id != (anyID)NULL)
-			{
-				int muted;
-				ts3Functions.getClientVariableAsInt(scHandlerID, id, CLIENT_IS_MUTED, &muted);
-				if(!muted) niftykbFunctions.MuteClient(scHandlerID, id);
-				else niftykbFunctions.UnmuteClient(scHandlerID, id);
-			}
-			else niftykbFunctions.ErrorMessage(scHandlerID, "Client not found");
+			replayEvent.Wait((unsigned long)((due - now + 999) / 1000));
+			now = clock->Now();
 		}
-	}
-	else if(!strcmp(cmd, "TS3_VOLUME_UP"))
-	{
-		if(IsConnected(scHandlerID))
+
+		message->received = StatsNow();
+		message->peer = 0;
+		if(!strcmp(record.sender, CONSOLE_SENDER)) SubmitMessages(&message, 1);
+		else
 		{
-			float diff = (arg!=NULL && *arg != (char)NULL)?(float)atof(arg):1.0f;
-			float value;
-			ts3Functions.getPlaybackConfigValueAsFloat(scHandlerID, "volume_modifier", &value);
-			niftykbFunctions.SetMasterVolume(scHandlerID, value+diff);
+			_strcpy(message->sender, MESSAGE_SENDER_BUFSIZE, record.sender);
+			AdmitMessages(&message, 1);
 		}
+		count++;
+
+		while(pluginRunning && (message = messagePool.Acquire()) == NULL)
+			SleepMsecs(1);
 	}
-	else if(!strcmp(cmd, "TS3_VOLUME_DOWN"))
+	if(message != NULL) messagePool.Release(message);
+	uint64 duration = clock->Now() - started;
+
+	// Let the throttled and background messages finish
+	uint64 deadline = clock->Now() + PLUGIN_THREAD_TIMEOUT * 1000;
+	if(replayVirtual)
 	{
-		if(IsConnected(scHandlerID))
-		{
-			float diff = (arg!=NULL && *arg != (char)NULL)?(float)atof(arg):1.0f;
-			float value;
-			ts3Functions.getPlaybackConfigValueAsFloat(scHandlerID, "volume_modifier", &value);
-			niftykbFunctions.SetMasterVolume(scHandlerID, value-diff);
-		}
+		// Delayed commands run as well, repeating ones until the deadline
+		PluginAdvance(&replayClock, deadline);
+		PluginSettle();
+		PluginUseClock(NULL);
 	}
-	else if(!strcmp(cmd, "TS3_VOLUME_SET"))
+	else
 	{
-		if(IsConnected(scHandlerID) && !IsArgumentEmpty(scHandlerID, arg))
-		{
-			float value = (float)atof(arg);
-			niftykbFunctions.SetMasterVolume(scHandlerID, value);
-		}
+		while(pluginRunning && StatsNow() < deadline && (!senders.IsEmpty() || executor.HasPending() || !commandQueue.IsEmpty() || !backgroundQueue.IsEmpty()))
+			SleepMsecs(1);
 	}
-	else if(!strcmp(cmd, "TS3_PLUGIN_COMMAND"))
-	{
-		if(!IsArgumentEmpty(scHandlerID, arg))
-		{
-			char* keyword = arg;
-			char* command = strchr(arg, ' ');
-			if(*keyword == '/') keyword++; // Skip the slash
-			if(command != NULL)
-			{
-				// Split the string by inserting a NULL-terminator
-				*command = (char)NULL;
-				command++;
 
-				// Execute the command
-				if(!IsArgumentEmpty(scHandlerID, command))
-					ExecutePluginCommand(scHandlerID, keyword, command);
-			}
-		}
-	}
-	/***** Error handler *****/
-	else
+	// Hand the client back
+	bool handedBack = HandOffReplay(HandBackReplay, scHandlerID, false);
+	ClientState replayed = replayState;
+	ReplayCounters counters = replayCounters;
+
+	if(!handedBack || !pluginRunning)
 	{
-		ts3Functions.logMessage("Command not recognized:", LogLevel_WARNING, "NiftyKb Plugin", 0);
-		ts3Functions.logMessage(cmd, LogLevel_WARNING, "NiftyKb Plugin", 0);
-		niftykbFunctions.ErrorMessage(scHandlerID, "Command not recognized");
+		replayRunning = false;
+		return PLUGIN_ERROR_NONE;
 	}
 
-	// Release the mutex
-	ReleaseMutex(hMutex);
+	std::stringstream ss;
+	if(replayVirtual) ss << "NiftyKb replayed " << count << " messages on a virtual clock, recorded in " << recordedTime / 1000 << " ms";
+	else ss << "NiftyKb replayed " << count << " messages in " << duration / 1000 << " ms, recorded in " << recordedTime / 1000 << " ms";
+	ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+	ss.str("");
+	ss << "Stand-in received " << counters.selfUpdates << " status updates and " << counters.requests << " server requests";
+	ts3Functions.printMessageToCurrentTab(ss.str().c_str());
+
+	// Compare the outcome with the state the client was really in
+	if(hasRecorded)
+	{
+		bool diverged = false;
+		ReportDivergence("input deactivated", (float)replayed.inputDeactivated, (float)recorded.inputDeactivated, &diverged);
+		ReportDivergence("input muted", (float)replayed.inputMuted, (float)recorded.inputMuted, &diverged);
+		ReportDivergence("output muted", (float)replayed.outputMuted, (float)recorded.outputMuted, &diverged);
+		ReportDivergence("away", (float)replayed.away, (float)recorded.away, &diverged);
+		ReportDivergence("voice activation", (float)replayed.vad, (float)recorded.vad, &diverged);
+		ReportDivergence("volume", replayed.volume, recorded.volume, &diverged);
+		if(!diverged) ts3Functions.printMessageToCurrentTab("No divergence from the recorded state");
+	}
+	else ts3Functions.printMessageToCurrentTab("The recording was not stopped, there is no state to compare with");
+
+	executor.Post(PrintStats);
+	replayRunning = false;
+	return PLUGIN_ERROR_NONE;
 }
 
-/*********************************** Plugin threads ************************************/
-/*
- * NOTE: Never let threads sleep longer than PLUGINTHREAD_TIMEOUT per iteration,
- * the shutdown procedure will not wait that long for the thread to exit.
- */
+void StartRecordingTask(const ExecutorTask&)
+{
+	// Runs on the executor, the state is captured in between two commands
+	ClientState state;
+	uint64 now = StatsNow();
+	CaptureClientState(*clientFunctions, clientFunctions->getCurrentServerConnectionHandlerID(), &state);
+	recordingStarted = trafficRecorder.Start(recordingPath, now, state);
+	recordingHandled = true;
+	recordingEvent.Set();
+}
 
-#define NIFTYKB_MAILSLOT_PATH "\\\\.\\mailslot\\niftykb"
+// Runs on the executor, or during the shutdown once the executor stopped
+void FinishRecording()
+{
+	ClientState state;
+	uint64 now = StatsNow();
+	CaptureClientState(*clientFunctions, clientFunctions->getCurrentServerConnectionHandlerID(), &state);
+	trafficRecorder.Stop(now, state);
+}
+
+void StopRecordingTask(const ExecutorTask&)
+{
+	FinishRecording();
+	recordingHandled = true;
+	recordingEvent.Set();
+}
 
-DWORD WINAPI MailslotThread(LPVOID pData)
+// Runs a recording task on the executor and waits for it, returns false if the plugin stopped first
+bool HandOffRecording(TaskProc proc)
 {
-	HANDLE hSlot; // Handle for the Mailslot
-	hSlot = CreateMailslot(NIFTYKB_MAILSLOT_PATH,
-		0,								// no max msg size
-		MAILSLOT_WAIT_FOREVER,
-		(LPSECURITY_ATTRIBUTES)NULL);	// default security
+	recordingHandled = false;
+	while(pluginRunning && !executor.Post(proc))
+		SleepMsecs(1);
+	while(pluginRunning && !recordingHandled)
+		recordingEvent.Wait();
+	return recordingHandled;
+}
 
-	if (hSlot == INVALID_HANDLE_VALUE) {
-		ts3Functions.logMessage("Failed CreateMailslot", LogLevel_ERROR, "NiftyKb Plugin", 0);
-		return PLUGIN_ERROR_CREATESLOT_FAILED;
+void StartRecording(const char* path)
+{
+	if(strlen(path) >= PATH_BUFSIZE)
+	{
+		ts3Functions.printMessageToCurrentTab("Invalid recording path");
+		return;
 	}
+	_strcpy(recordingPath, PATH_BUFSIZE, path);
 
-	ts3Functions.logMessage("Mailslot Created", LogLevel_INFO, "NiftyKb Plugin", 0);
+	if(!HandOffRecording(StartRecordingTask)) return;
+	if(recordingStarted) ts3Functions.printMessageToCurrentTab("NiftyKb recording started");
+	else ts3Functions.printMessageToCurrentTab("Could not start recording, is a recording already running?");
+}
 
-	// While the plugin is running
-	while (pluginRunning)
-	{
-		//DWORD timerWait = MsgWaitForMultipleObjects(1, &hPttDelayTimer, FALSE, PLUGIN_THREAD_TIMEOUT, QS_ALLINPUT);
-		//if (timerWait == WAIT_FAILED) {
-		//	break;
-		//}
-		//if (timerWait == WAIT_OBJECT_0) {
-		//	PTTDelayCallback(NULL, 0, 0);
-		//}
-		DWORD messageSize, messageCount, messageBytesRead;
-		char *messageStr, *arg;
-		DWORD messageTimeout = PLUGIN_THREAD_TIMEOUT;
-
-		BOOL ok;
-
-		ok = GetMailslotInfo(hSlot,
-			(LPDWORD)NULL, // No max size
-			&messageSize,
-			&messageCount,
-			(LPDWORD)NULL);
-			//&messageTimeout);
-		if (!ok) {
-			DWORD err = GetLastError();
-			if (err == WAIT_TIMEOUT) {
-				continue;
-			}
-			ts3Functions.logMessage("Failed GetMailslotInfo", LogLevel_ERROR, "NiftyKb Plugin", 0);
-			return PLUGIN_ERROR_READ_FAILED;
-		}
-		if (messageSize == MAILSLOT_NO_MESSAGE) {
-			::SleepEx(5, TRUE); // allow timers to fire
-			continue;
-		}
+void StopRecording()
+{
+	if(HandOffRecording(StopRecordingTask)) ts3Functions.printMessageToCurrentTab("NiftyKb recording stopped");
+}
 
-		// Retrieve message
-		messageStr = (LPTSTR)malloc(messageSize + 1);
+void StartReplay(char* args)
+{
+	if(replayRunning || trafficRecorder.IsRecording())
+	{
+		ts3Functions.printMessageToCurrentTab("Could not start replay, a recording or replay is running");
+		return;
+	}
 
-		ok = ReadFile(hSlot,
-			messageStr,
-			messageSize,
-			&messageBytesRead,
-			NULL); // not overlapped i/o
+	// The path may be quoted, the speed is optional
+	StringRef path, speed;
+	Tokenizer tokens(args);
+	if(!tokens.Next(&path) || path.length >= PATH_BUFSIZE)
+	{
+		ts3Functions.printMessageToCurrentTab("Invalid recording path");
+		return;
+	}
+	memcpy(replayPath, path.data, path.length);
+	replayPath[path.length] = (char)NULL;
+	bool hasSpeed = tokens.Next(&speed);
+	replayVirtual = hasSpeed && StringRefEquals(speed, "virtual");
+	replaySpeed = (hasSpeed && !replayVirtual) ? (float)atof(speed.data) : 1.0f;
+	if(replaySpeed <= 0.0f) replaySpeed = 1.0f;
 
-		if (!ok || messageBytesRead == 0) {
-			ts3Functions.logMessage("Failed mailslot ReadFile", LogLevel_ERROR, "NiftyKb Plugin", 0);
-			return PLUGIN_ERROR_READ_FAILED;
-		}
+	// The previous replay has finished, release its thread before starting a new one
+	replayThread.Join(PLUGIN_THREAD_TIMEOUT);
+	replayRunning = true;
+	if(!replayThread.Start(ReplayThread, NULL))
+	{
+		replayRunning = false;
+		ts3Functions.printMessageToCurrentTab("Could not start replay");
+	}
+}
 
-		// Separate the argument from the command
-		arg = strchr(messageStr, ' ');
-		if (arg != NULL) {
-			// Split the string by inserting a NULL-terminator
-			*arg = (char)NULL;
-			arg++;
-		}
+/*********************************** Shutdown ************************************/
 
-		// Parse debug string
-		ParseCommand(messageStr, arg);
+/*
+ * Stops every plugin thread and releases what the plugin holds. Used when the plugin is unloaded and when
+ * it fails to start, so nothing that was started is left running.
+ */
+void StopPlugin()
+{
+	uint64 stopping = StatsNow();
 
-		// Free the debug string
-		free(messageStr);
-	}
+	// Cancel every plugin thread at once, a woken thread sees pluginRunning is cleared and exits
+	pluginRunning = false;
+	replayEvent.Set();
+	recordingEvent.Set();
+	clockEvent.Set();
+	transport.Wake();
+	ringTransport.Wake();
+	backgroundEvent.Set();
+	executor.Wake();
+
+	// Wait for the threads that post work first
+	replayThread.Join(PLUGIN_THREAD_TIMEOUT);
+	bool receiveStopped = receiveThread.Join(PLUGIN_THREAD_TIMEOUT);
+	bool ringStopped = ringThread.Join(PLUGIN_THREAD_TIMEOUT);
+
+	// Then for the threads that run commands, the background thread finishes a call the executor waits for
+	bool backgroundStopped = backgroundThread.Join(PLUGIN_THREAD_TIMEOUT);
+	bool executorStopped = executorThread.Join(PLUGIN_THREAD_TIMEOUT);
+	if(!receiveStopped || !ringStopped || !backgroundStopped || !executorStopped)
+		ts3Functions.logMessage("A plugin thread did not stop in time", LogLevel_WARNING, "NiftyKb Plugin", 0);
+
+	// Close the command endpoints, unless a receive thread is stuck in one
+	if(receiveStopped) transport.Close();
+	if(ringStopped) ringTransport.Close();
+
+	// A replay that was cancelled before the executor handed the client back leaves the stand-in behind
+	if(executorStopped && replaySwapped)
+	{
+		clientFunctions = &ts3Functions;
+		replaySwapped = false;
+	}
+
+	// Finish the recording, every received message is in it
+	if(executorStopped && trafficRecorder.IsRecording()) FinishRecording();
+
+	// The rest belongs to the executor, an executor that did not stop in time still owns it
+	if(executorStopped)
+	{
+		// Discard the tasks and messages that were still waiting on the executor, the lanes or for their sender's tokens
+		executor.Discard(messagePool);
+		Message* message;
+		while((message = commandQueue.Pop()) != NULL)
+			messagePool.Release(message);
+		while((message = backgroundQueue.Pop()) != NULL)
+			messagePool.Release(message);
+		while((message = senders.Discard()) != NULL)
+			messagePool.Release(message);
+
+		// Cancel the PTT delay timer and the scheduled commands, send any self updates that were held back, no thread runs commands anymore
+		timerWheel.Cancel(&pttDelayTimer);
+		scheduler.Clear();
+		timerWheel.Cancel(&flushTimer);
+		timerWheel.Cancel(&senderTimer);
+		niftykbFunctions.FlushPendingUpdates();
+	}
+
+	// Stop acknowledging commands and tell the readers of the snapshot the plugin is gone
+	ackChannel.Close();
+	statePublisher.Close();
+
+	// Close settings database, the commands read the PTT delay from it
+	ts3Settings.CloseDatabase();
 
-	return PLUGIN_ERROR_NONE;
+	std::stringstream ss;
+	ss << "Plugin stopped in " << (StatsNow() - stopping) << " microseconds";
+	ts3Functions.logMessage(ss.str().c_str(), LogLevel_DEBUG, "NiftyKb Plugin", 0);
 }
 
 /*********************************** Required functions ************************************/
@@ -834,51 +2575,52 @@ void ts3plugin_setFunctionPointers(const struct TS3Functions funcs) {
  * If the function returns 1 on failure, the plugin will be unloaded again.
  */
 int ts3plugin_init() {
-	// Create the command mutex
-	hMutex = CreateMutex(NULL, FALSE, NULL);
-
-	// Create the PTT delay timer
-	hPttDelayTimer = CreateWaitableTimer(NULL, FALSE, NULL);
+	// Build the command lookup table
+	if(!commandTable.Build(commands, sizeof(commands)/sizeof(CommandInfo)))
+	{
+		ts3Functions.logMessage("Failed to build command table, unloading plugin", LogLevel_ERROR, "NiftyKb Plugin", 0);
+		return 1;
+	}
+	statsTable.Init(sizeof(commands)/sizeof(CommandInfo));
 
 	// Find and open the settings database
-	char db[MAX_PATH];
-	ts3Functions.getConfigPath(db, MAX_PATH);
-	_strcat(db, MAX_PATH, "settings.db");
+	char db[PATH_BUFSIZE];
+	ts3Functions.getConfigPath(db, PATH_BUFSIZE);
+	_strcat(db, PATH_BUFSIZE, "settings.db");
 	ts3Settings.OpenDatabase(db);
 
 	// Find the error sound and info icon
 	SetErrorSound();
 	SetInfoIcon();
 
+	// Publish the own state, the plugin works without it
+	if(!statePublisher.Open())
+		ts3Functions.logMessage("Failed to open the self state snapshot", LogLevel_WARNING, "NiftyKb Plugin", 0);
+
 	// Start the plugin threads
 	pluginRunning = true;
-	hMailslotThread = CreateThread(NULL, (SIZE_T)NULL, MailslotThread, 0, 0, NULL);
+	receiveError = PLUGIN_ERROR_NONE;
+	backgroundExited = false;
+	bool started = true;
+	if(OpenEndpoint(&transport)) started = receiveThread.Start(ReceiveThread, &transport);
+	if(OpenEndpoint(&ringTransport)) started = ringThread.Start(ReceiveThread, &ringTransport) && started;
+	started = backgroundThread.Start(BackgroundThread, NULL) && started;
+	started = executorThread.Start(ExecutorThread, NULL) && started;
 
-	if(hMailslotThread==NULL)
+	if(!started)
 	{
+		// The threads that did start are stopped again, they must not outlive the plugin
 		ts3Functions.logMessage("Failed to start threads, unloading plugin", LogLevel_ERROR, "NiftyKb Plugin", 0);
+		StopPlugin();
 		return 1;
 	}
 
-	/* Initialize return codes array for requestClientMove */
-	memset(requestClientMoveReturnCodes, 0, REQUESTCLIENTMOVERETURNCODES_SLOTS * RETURNCODE_BUFSIZE);
-
     return 0;  /* 0 = success, 1 = failure */
 }
 
 /* Custom code called right before the plugin is unloaded */
 void ts3plugin_shutdown() {
-	// Stop the plugin threads
-	pluginRunning = false;
-
-	// Close settings database
-	ts3Settings.CloseDatabase();
-
-	// Cancel PTT delay timer
-	CancelWaitableTimer(hPttDelayTimer);
-
-	// Wait for the thread to stop
-	WaitForSingleObject(hMailslotThread, PLUGIN_THREAD_TIMEOUT);
+	StopPlugin();
 
 	/*
 	 * Note:
@@ -910,7 +2652,7 @@ int ts3plugin_offersConfigure() {
 }
 
 /* Plugin might offer a configuration window. If ts3plugin_offersConfigure returns 0, this function does not need to be implemented. */
-void ts3plugin_configure(void* handle, void* qParentWidget) {
+void ts3plugin_configure(void*, void*) {
 	// char path[MAX_PATH];
 	// ts3Functions.getPluginPath(path, MAX_PATH);
 	// _strcat(path, MAX_PATH, "/README.html");
@@ -935,29 +2677,64 @@ const char* ts3plugin_commandKeyword() {
 }
 
 /* Plugin processes console command. Return 0 if plugin handled the command, 1 if not handled. */
-int ts3plugin_processCommand(uint64 serverConnectionHandlerID, const char* command) {
-	size_t length = strlen(command);
-	char* str = (char*)malloc(length+1);
-	_strcpy(str, length+1, command);
+int ts3plugin_processCommand(uint64, const char* command) {
+	uint64 received = StatsNow();
+
+	// Latency statistics, the executor owns them
+	if(!strcmp(command, "stats") || !strcmp(command, "stats reset"))
+	{
+		if(!executor.Post(!strcmp(command, "stats") ? PrintStats : ResetStats))
+			ts3Functions.logMessage("Executor queue full, command rejected", LogLevel_WARNING, "NiftyKb Plugin", 0);
+		return 0;
+	}
+
+	// Traffic recording and replay
+	if(!strcmp(command, "record stop"))
+	{
+		StopRecording();
+		return 0;
+	}
+	if(!strncmp(command, "record ", 7))
+	{
+		StartRecording(command + 7);
+		return 0;
+	}
+	if(!strncmp(command, "replay ", 7))
+	{
+		char args[PATH_BUFSIZE + COMMAND_BUFSIZE];
+		_strcpy(args, sizeof(args), command + 7);
+		StartReplay(args);
+		return 0;
+	}
 
-	// Seperate the argument from the command
-	char* arg = strchr(str, ' ');
-	if(arg != NULL)
+	size_t length = strlen(command);
+	if(length >= MESSAGE_BUFSIZE)
 	{
-		// Split the string by inserting a NULL-terminator
-		*arg = (char)NULL;
-		arg++;
+		ts3Functions.logMessage("Command too long", LogLevel_WARNING, "NiftyKb Plugin", 0);
+		return 0;
 	}
 
-	ParseCommand(str, arg);
+	// Copy the command into a pooled buffer, parsing modifies it
+	Message* message = messagePool.Acquire();
+	if(message == NULL)
+	{
+		ts3Functions.logMessage("No message buffer available", LogLevel_WARNING, "NiftyKb Plugin", 0);
+		return 0;
+	}
+	memcpy(message->data, command, length+1);
+	message->length = length;
+	message->received = received;
+	message->peer = 0;
 
-	free(str);
+	// Console commands are typed by the user, they are not rate limited
+	trafficRecorder.Write(message, CONSOLE_SENDER, received);
+	SubmitMessages(&message, 1);
 
 	return 0;  /* Plugin did not handle command */
 }
 
 /* Client changed current server connection handler */
-void ts3plugin_currentServerConnectionChanged(uint64 serverConnectionHandlerID) {
+void ts3plugin_currentServerConnectionChanged(uint64) {
 }
 
 /*
@@ -976,7 +2753,7 @@ const char* ts3plugin_infoTitle() {
  * Check the parameter "type" if you want to implement this feature only for specific item types. Set the parameter
  * "data" to NULL to have the client ignore the info data.
  */
-void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 id, enum PluginItemType type, char** data) {
+void ts3plugin_infoData(uint64, uint64, enum PluginItemType, char**) {
 }
 
 /* Required to release the memory for parameter "data" allocated in ts3plugin_infoData */
@@ -993,27 +2770,93 @@ int ts3plugin_requestAutoload() {
 	return 1;  /* 1 = request autoloaded, 0 = do not request autoload */
 }
 
-/* Show an error message if the plugin failed to load */
-void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int errorNumber) {
-    if(newStatus == STATUS_CONNECTION_ESTABLISHED)
+/* Track the connections, the executor shows an error message if a command endpoint failed */
+void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int newStatus, unsigned int) {
+	// Server handles may be reused, forget everything that was resolved on this connection
+	bindingTable.Invalidate(COMMAND_TARGET_SERVER);
+	if(newStatus == STATUS_DISCONNECTED)
 	{
-		if(!pluginRunning)
-		{
-			DWORD errorCode;
-			if(GetExitCodeThread(hMailslotThread, &errorCode) && errorCode != PLUGIN_ERROR_NONE)
-			{
-				switch(errorCode) {
-				case PLUGIN_ERROR_CREATESLOT_FAILED: niftykbFunctions.ErrorMessage(serverConnectionHandlerID, "Could not create mailslot."); break;
-				case PLUGIN_ERROR_READ_FAILED: niftykbFunctions.ErrorMessage(serverConnectionHandlerID, "Could not read mailslot."); break;
-				case PLUGIN_ERROR_NOT_FOUND: niftykbFunctions.ErrorMessage(serverConnectionHandlerID, "Something not found."); break;
-				default: niftykbFunctions.ErrorMessage(serverConnectionHandlerID, "NiftyKb Plugin failed to start, check the clientlog for more info."); break;
-				}
-			}
-		}
+		bindingTable.Invalidate(COMMAND_TARGET_CHANNEL);
+		bindingTable.Invalidate(COMMAND_TARGET_CLIENT);
 	}
+
+	if(newStatus == STATUS_CONNECTION_ESTABLISHED) QueueEvent(ConnectionEstablished, serverConnectionHandlerID);
+	else if(newStatus == STATUS_DISCONNECTED) QueueEvent(ConnectionLost, serverConnectionHandlerID);
+
 }
 
 /* Add whisper clients to reply list */
+int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char*, unsigned int error, const char* returnCode, const char*) {
+	// Return codes are only passed to the plugin that created them, the executor acknowledges the request
+	if(returnCode == NULL || *returnCode == (char)NULL) return 0;  /* If no plugin return code was used, the return value of the function is ignored */
+
+	Message* message = messagePool.Acquire();
+	if(message != NULL)
+	{
+		strncpy(message->data, returnCode, MESSAGE_BUFSIZE - 1);
+		message->data[MESSAGE_BUFSIZE - 1] = '\0';
+		message->length = strlen(message->data);
+		message->received = StatsNow();
+		message->peer = 0;
+		QueueEvent(CompleteServerRequest, serverConnectionHandlerID, error, message);
+	}
+	else ts3Functions.logMessage("Message pool exhausted, server response not acknowledged", LogLevel_WARNING, "NiftyKb Plugin", 0);
+
+	// Successful requests need no message, errors are still shown by the client
+	return (error == ERROR_ok) ? 1 : 0;
+}
+
 void ts3plugin_onTalkStatusChangeEvent(uint64 serverConnectionHandlerID, int status, int isReceivedWhisper, anyID clientID) {
-	if(isReceivedWhisper) niftykbFunctions.ReplyAddClient(niftykbFunctions.GetActiveServerConnectionHandlerID(), clientID);
+	if(isReceivedWhisper) QueueEvent(AddReplyClient, serverConnectionHandlerID, clientID);
+
+	// Only the own client is published, the talk status of others is not posted at all
+	anyID myID;
+	if(ts3Functions.getClientID(serverConnectionHandlerID, &myID) == ERROR_ok && clientID == myID)
+		QueueEvent(OwnTalkStatusChanged, serverConnectionHandlerID, status);
+}
+
+void ts3plugin_onUpdateClientEvent(uint64 serverConnectionHandlerID, anyID clientID, anyID, const char*, const char*) {
+	// Publish the own client variables, whether they were changed by a command or in the client
+	anyID myID;
+	if(ts3Functions.getClientID(serverConnectionHandlerID, &myID) == ERROR_ok && clientID == myID)
+		QueueEvent(OwnClientUpdated, serverConnectionHandlerID);
+}
+
+/* Invalidate bound server targets */
+void ts3plugin_onServerUpdatedEvent(uint64) {
+	bindingTable.Invalidate(COMMAND_TARGET_SERVER);
+}
+
+/* Invalidate bound channel targets */
+void ts3plugin_onDelChannelEvent(uint64, uint64, anyID, const char*, const char*) {
+	bindingTable.Invalidate(COMMAND_TARGET_CHANNEL);
+}
+
+void ts3plugin_onChannelMoveEvent(uint64, uint64, uint64, anyID, const char*, const char*) {
+	bindingTable.Invalidate(COMMAND_TARGET_CHANNEL);
+}
+
+void ts3plugin_onUpdateChannelEditedEvent(uint64, uint64, anyID, const char*, const char*) {
+	bindingTable.Invalidate(COMMAND_TARGET_CHANNEL);
+}
+
+/* Invalidate bound client targets, client IDs are only reassigned after a client left the server */
+void ts3plugin_onClientMoveEvent(uint64, anyID, uint64, uint64 newChannelID, int, const char*) {
+	if(newChannelID == 0) bindingTable.Invalidate(COMMAND_TARGET_CLIENT);
+}
+
+void ts3plugin_onClientMoveTimeoutEvent(uint64, anyID, uint64, uint64, int, const char*) {
+	bindingTable.Invalidate(COMMAND_TARGET_CLIENT);
+}
+
+void ts3plugin_onClientKickFromServerEvent(uint64, anyID, uint64, uint64, int, anyID, const char*, const char*, const char*) {
+	bindingTable.Invalidate(COMMAND_TARGET_CLIENT);
+}
+
+void ts3plugin_onClientBanFromServerEvent(uint64, anyID, uint64, uint64, int, anyID, const char*, const char*, uint64, const char*) {
+	bindingTable.Invalidate(COMMAND_TARGET_CLIENT);
+}
+
+void ts3plugin_onClientDisplayNameChanged(uint64, anyID, const char*, const char*) {
+	bindingTable.Invalidate(COMMAND_TARGET_CLIENT);
 }
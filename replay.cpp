@@ -0,0 +1,284 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "public_errors.h"
+#include "public_definitions.h"
+#include "public_rare_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "replay.h"
+#include "platform.h"
+
+typedef struct
+{
+	uint64 scHandlerID; // 0 if the slot is unused
+	ClientState state;
+	char awayMessage[REPLAY_AWAY_BUFSIZE];
+} ReplayServer;
+
+static TS3Functions realFunctions;
+static Mutex replayLock;
+static ReplayServer replayServers[REPLAY_SERVERS];
+static ReplayCounters replayCounters;
+static uint64 replayActiveServer = 0;
+
+// Preprocessor values handed out by the stand-in, they must not be passed on to the real freeMemory
+static char replayTrue[] = "true";
+static char replayFalse[] = "false";
+
+static ReplayServer* FindReplayServer(uint64 scHandlerID)
+{
+	// Called with the lock held, a server that is not simulated yet starts out with its real state
+	for(int i=0; i<REPLAY_SERVERS; i++)
+		if(replayServers[i].scHandlerID == scHandlerID) return &replayServers[i];
+
+	for(int i=0; i<REPLAY_SERVERS; i++)
+	{
+		ReplayServer& server = replayServers[i];
+		if(server.scHandlerID != 0) continue;
+
+		server.scHandlerID = scHandlerID;
+		CaptureClientState(realFunctions, scHandlerID, &server.state);
+		server.awayMessage[0] = '\0';
+		return &server;
+	}
+	return NULL;
+}
+
+static bool IsReplayMemory(void* pointer)
+{
+	if(pointer == replayTrue || pointer == replayFalse) return true;
+	return pointer >= (void*)replayServers && pointer < (void*)(replayServers + REPLAY_SERVERS);
+}
+
+/*********************************** Stand-in functions ************************************/
+
+static unsigned int ReplayFreeMemory(void* pointer)
+{
+	if(IsReplayMemory(pointer)) return ERROR_ok;
+	return realFunctions.freeMemory(pointer);
+}
+
+static uint64 ReplayGetCurrentServerConnectionHandlerID()
+{
+	return replayActiveServer;
+}
+
+static unsigned int ReplayActivateCaptureDevice(uint64 scHandlerID)
+{
+	replayActiveServer = scHandlerID;
+	return ERROR_ok;
+}
+
+static unsigned int ReplayPlayWaveFile(uint64, const char*)
+{
+	return ERROR_ok;
+}
+
+static unsigned int ReplayGetClientSelfVariableAsInt(uint64 scHandlerID, size_t flag, int* result)
+{
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	int* value = NULL;
+	if(server != NULL)
+	{
+		switch(flag)
+		{
+		case CLIENT_INPUT_DEACTIVATED: value = &server->state.inputDeactivated; break;
+		case CLIENT_INPUT_MUTED:       value = &server->state.inputMuted; break;
+		case CLIENT_OUTPUT_MUTED:      value = &server->state.outputMuted; break;
+		case CLIENT_AWAY:              value = &server->state.away; break;
+		}
+	}
+	if(value != NULL) *result = *value;
+	replayLock.Unlock();
+
+	// Variables that commands do not change are read from the real client
+	if(value == NULL) return realFunctions.getClientSelfVariableAsInt(scHandlerID, flag, result);
+	return ERROR_ok;
+}
+
+static unsigned int ReplaySetClientSelfVariableAsInt(uint64 scHandlerID, size_t flag, int value)
+{
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	if(server != NULL)
+	{
+		switch(flag)
+		{
+		case CLIENT_INPUT_DEACTIVATED: server->state.inputDeactivated = value; break;
+		case CLIENT_INPUT_MUTED:       server->state.inputMuted = value; break;
+		case CLIENT_OUTPUT_MUTED:      server->state.outputMuted = value; break;
+		case CLIENT_AWAY:              server->state.away = value; break;
+		}
+	}
+	replayLock.Unlock();
+	return (server != NULL) ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int ReplayGetClientSelfVariableAsString(uint64 scHandlerID, size_t flag, char** result)
+{
+	if(flag != CLIENT_AWAY_MESSAGE) return realFunctions.getClientSelfVariableAsString(scHandlerID, flag, result);
+
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	if(server != NULL) *result = server->awayMessage;
+	replayLock.Unlock();
+	return (server != NULL) ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int ReplaySetClientSelfVariableAsString(uint64 scHandlerID, size_t flag, const char* value)
+{
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	if(server != NULL && flag == CLIENT_AWAY_MESSAGE) _strcpy(server->awayMessage, REPLAY_AWAY_BUFSIZE, value);
+	replayLock.Unlock();
+	return (server != NULL) ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int ReplayFlushClientSelfUpdates(uint64, const char*)
+{
+	replayLock.Lock();
+	replayCounters.selfUpdates++;
+	replayLock.Unlock();
+	return ERROR_ok;
+}
+
+static unsigned int ReplayGetPreProcessorConfigValue(uint64 scHandlerID, const char* ident, char** result)
+{
+	if(strcmp(ident, "vad")) return realFunctions.getPreProcessorConfigValue(scHandlerID, ident, result);
+
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	if(server != NULL) *result = server->state.vad ? replayTrue : replayFalse;
+	replayLock.Unlock();
+	return (server != NULL) ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int ReplaySetPreProcessorConfigValue(uint64 scHandlerID, const char* ident, const char* value)
+{
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	if(server != NULL && !strcmp(ident, "vad")) server->state.vad = !strcmp(value, "true");
+	replayLock.Unlock();
+	return (server != NULL) ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int ReplayGetPlaybackConfigValueAsFloat(uint64 scHandlerID, const char* ident, float* result)
+{
+	if(strcmp(ident, "volume_modifier")) return realFunctions.getPlaybackConfigValueAsFloat(scHandlerID, ident, result);
+
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	if(server != NULL) *result = server->state.volume;
+	replayLock.Unlock();
+	return (server != NULL) ? ERROR_ok : ERROR_undefined;
+}
+
+static unsigned int ReplaySetPlaybackConfigValue(uint64 scHandlerID, const char* ident, const char* value)
+{
+	replayLock.Lock();
+	ReplayServer* server = FindReplayServer(scHandlerID);
+	if(server != NULL && !strcmp(ident, "volume_modifier")) server->state.volume = (float)atof(value);
+	replayLock.Unlock();
+	return (server != NULL) ? ERROR_ok : ERROR_undefined;
+}
+
+/***** Server requests, counted but never sent *****/
+static unsigned int CountReplayRequest()
+{
+	replayLock.Lock();
+	replayCounters.requests++;
+	replayLock.Unlock();
+	return ERROR_ok;
+}
+
+static unsigned int ReplayRequestClientMove(uint64, anyID, uint64, const char*, const char*)
+{
+	return CountReplayRequest();
+}
+
+static unsigned int ReplayRequestClientVariables(uint64, anyID, const char*)
+{
+	return CountReplayRequest();
+}
+
+static unsigned int ReplayRequestClientKick(uint64, anyID, const char*, const char*)
+{
+	return CountReplayRequest();
+}
+
+static unsigned int ReplayRequestClientSetWhisperList(uint64, anyID, const uint64*, const anyID*, const char*)
+{
+	return CountReplayRequest();
+}
+
+static unsigned int ReplayRequestMuteClients(uint64, const anyID*, const char*)
+{
+	return CountReplayRequest();
+}
+
+static unsigned int ReplayGuiConnectBookmark(enum PluginConnectTab, const char*, uint64* scHandlerID)
+{
+	if(scHandlerID != NULL) *scHandlerID = 0;
+	return CountReplayRequest();
+}
+
+/*********************************** Setup ************************************/
+
+void InitReplayFunctions(const TS3Functions& real, uint64 scHandlerID, const ClientState& state, TS3Functions* standIn)
+{
+	replayLock.Lock();
+	realFunctions = real;
+	memset(replayServers, 0, sizeof(replayServers));
+	memset(&replayCounters, 0, sizeof(replayCounters));
+	replayActiveServer = scHandlerID;
+
+	// The active server starts out as it was when the recording started
+	if(scHandlerID != 0)
+	{
+		replayServers[0].scHandlerID = scHandlerID;
+		replayServers[0].state = state;
+	}
+	replayLock.Unlock();
+
+	// Everything that is not simulated goes to the real client
+	*standIn = real;
+	standIn->freeMemory = ReplayFreeMemory;
+	standIn->getCurrentServerConnectionHandlerID = ReplayGetCurrentServerConnectionHandlerID;
+	standIn->activateCaptureDevice = ReplayActivateCaptureDevice;
+	standIn->playWaveFile = ReplayPlayWaveFile;
+	standIn->getClientSelfVariableAsInt = ReplayGetClientSelfVariableAsInt;
+	standIn->setClientSelfVariableAsInt = ReplaySetClientSelfVariableAsInt;
+	standIn->getClientSelfVariableAsString = ReplayGetClientSelfVariableAsString;
+	standIn->setClientSelfVariableAsString = ReplaySetClientSelfVariableAsString;
+	standIn->flushClientSelfUpdates = ReplayFlushClientSelfUpdates;
+	standIn->getPreProcessorConfigValue = ReplayGetPreProcessorConfigValue;
+	standIn->setPreProcessorConfigValue = ReplaySetPreProcessorConfigValue;
+	standIn->getPlaybackConfigValueAsFloat = ReplayGetPlaybackConfigValueAsFloat;
+	standIn->setPlaybackConfigValue = ReplaySetPlaybackConfigValue;
+	standIn->requestClientMove = ReplayRequestClientMove;
+	standIn->requestClientVariables = ReplayRequestClientVariables;
+	standIn->requestClientKickFromChannel = ReplayRequestClientKick;
+	standIn->requestClientKickFromServer = ReplayRequestClientKick;
+	standIn->requestClientSetWhisperList = ReplayRequestClientSetWhisperList;
+	standIn->requestMuteClients = ReplayRequestMuteClients;
+	standIn->requestUnmuteClients = ReplayRequestMuteClients;
+	standIn->guiConnectBookmark = ReplayGuiConnectBookmark;
+}
+
+void GetReplayCounters(ReplayCounters* counters)
+{
+	replayLock.Lock();
+	*counters = replayCounters;
+	replayLock.Unlock();
+}
@@ -0,0 +1,38 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+
+#include "public_definitions.h"
+#include "ts3_functions.h"
+#include "traffic.h"
+
+#define REPLAY_SERVERS 8
+#define REPLAY_AWAY_BUFSIZE 128
+
+typedef struct
+{
+	unsigned long selfUpdates; // Own status updates flushed to a server
+	unsigned long requests;    // Requests sent to a server, like moves, kicks and whisper lists
+} ReplayCounters;
+
+/*
+ * Stand-in for the TeamSpeak client while a recording is replayed. Own status changes, server
+ * requests and sounds are simulated and counted, nothing reaches the server. Lookups of servers,
+ * channels and clients still go to the real client, so they take as long as they would have.
+ *
+ * The stand-in starts out with the given state on the given server, other servers start out with
+ * their real state.
+ */
+void InitReplayFunctions(const TS3Functions& real, uint64 scHandlerID, const ClientState& state, TS3Functions* standIn);
+void GetReplayCounters(ReplayCounters* counters);
+
+#endif
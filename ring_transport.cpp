@@ -0,0 +1,399 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ring_transport.h"
+
+#define RING_SPIN_COUNT 2000 // Checks of the head before the plugin goes to sleep
+
+#if defined(_WIN32)
+#define RING_PAUSE() YieldProcessor()
+#elif defined(__i386__) || defined(__x86_64__)
+#define RING_PAUSE() __builtin_ia32_pause()
+#else
+#define RING_PAUSE()
+#endif
+
+// Every access to a position that the other side writes is ordered with these
+static inline unsigned int RingLoad(volatile RingWord* word)
+{
+#ifdef _WIN32
+	RingWord value = *word;
+	_ReadWriteBarrier();
+	return (unsigned int)value;
+#else
+	return (unsigned int)__atomic_load_n(word, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void RingStore(volatile RingWord* word, unsigned int value)
+{
+#ifdef _WIN32
+	_ReadWriteBarrier();
+	*word = (RingWord)value;
+#else
+	__atomic_store_n(word, (RingWord)value, __ATOMIC_RELEASE);
+#endif
+}
+
+// Full barrier, the waiting flag must be visible before the head is checked again and vice versa
+static inline RingWord RingExchange(volatile RingWord* word, RingWord value)
+{
+#ifdef _WIN32
+	return InterlockedExchange(word, value);
+#else
+	RingWord previous = __sync_lock_test_and_set(word, value);
+	__sync_synchronize();
+	return previous;
+#endif
+}
+
+// The wake flag is raised by any thread and taken by the receiving thread
+static inline long RingSwapWoken(volatile long* woken, long value)
+{
+#ifdef _WIN32
+	return InterlockedExchange(woken, value);
+#else
+	return __atomic_exchange_n(woken, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static inline bool RingIsWoken(volatile long* woken)
+{
+#ifdef _WIN32
+	return *woken != 0;
+#else
+	return __atomic_load_n(woken, __ATOMIC_ACQUIRE) != 0;
+#endif
+}
+
+static inline void RingFence()
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+static inline unsigned int RingRecordSize(unsigned int length)
+{
+	return (sizeof(unsigned int) + length + 3) & ~3u;
+}
+
+#ifndef _WIN32
+static inline void RingFutexWait(volatile RingWord* word, RingWord value)
+{
+	// Not a private futex, the producer is another process
+	syscall(SYS_futex, word, FUTEX_WAIT, value, NULL, NULL, 0);
+}
+
+static inline void RingFutexWake(volatile RingWord* word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+#endif
+
+/*********************************** RingTransport ************************************/
+
+RingTransport::RingTransport(void) :
+	ring(NULL),
+	woken(0)
+{
+#ifdef _WIN32
+	hMapping = NULL;
+	hEvent = NULL;
+#else
+	snprintf(name, sizeof(name), RING_SHARED_NAME, (unsigned int)getuid());
+#endif
+}
+
+RingTransport::~RingTransport(void)
+{
+	Close();
+}
+
+bool RingTransport::Open()
+{
+#ifdef _WIN32
+	hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, (LPSECURITY_ATTRIBUTES)NULL, PAGE_READWRITE, 0, sizeof(RingShared), RING_SHARED_NAME);
+	hEvent = CreateEvent((LPSECURITY_ATTRIBUTES)NULL, FALSE, FALSE, RING_EVENT_NAME);
+	if(hMapping != NULL) ring = (RingShared*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(RingShared));
+#else
+	// Only the user may map the ring
+	int fd = shm_open(name, O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+	if(fd != -1)
+	{
+		if(ftruncate(fd, sizeof(RingShared)) == 0)
+		{
+			void* memory = mmap(NULL, sizeof(RingShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if(memory != MAP_FAILED) ring = (RingShared*)memory;
+		}
+		close(fd);
+	}
+#endif
+
+	if(ring == NULL)
+	{
+		Close();
+		return false;
+	}
+
+	// A writer left over from a previous session starts over, it will see the new ring once the magic is set
+	RingStore(&ring->magic, 0);
+	ring->capacity = RING_CAPACITY;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->waiting = 0;
+	ring->writer = 0;
+	RingStore(&ring->magic, RING_MAGIC);
+
+	return true;
+}
+
+void RingTransport::Close()
+{
+	if(ring != NULL)
+	{
+		// Writers stop once the magic is gone
+		RingStore(&ring->magic, 0);
+#ifdef _WIN32
+		UnmapViewOfFile(ring);
+#else
+		munmap(ring, sizeof(RingShared));
+		shm_unlink(name);
+#endif
+		ring = NULL;
+	}
+
+#ifdef _WIN32
+	if(hMapping != NULL) CloseHandle(hMapping);
+	if(hEvent != NULL) CloseHandle(hEvent);
+	hMapping = hEvent = NULL;
+#endif
+}
+
+void RingTransport::WaitForProducer(unsigned int tail)
+{
+	// Tell the producer we are going to sleep, then check once more so a message written in between is not missed
+	RingExchange(&ring->waiting, 1);
+	if(RingLoad(&ring->head) == tail && !RingIsWoken(&woken))
+	{
+#ifdef _WIN32
+		WaitForSingleObject(hEvent, INFINITE);
+#else
+		RingFutexWait(&ring->waiting, 1);
+#endif
+	}
+	RingExchange(&ring->waiting, 0);
+}
+
+TransportResult RingTransport::Receive(Message* message)
+{
+	while(true)
+	{
+		if(RingSwapWoken(&woken, 0)) return TRANSPORT_WOKEN;
+
+		TransportResult result = Poll(message);
+		if(result != TRANSPORT_EMPTY) return result;
+
+		// Spin for a moment before going to sleep, bursts of messages then never need a system call
+		unsigned int tail = (unsigned int)ring->tail;
+		unsigned int head = RingLoad(&ring->head);
+		for(int i=0; head == tail && i<RING_SPIN_COUNT && !RingIsWoken(&woken); i++)
+		{
+			RING_PAUSE();
+			head = RingLoad(&ring->head);
+		}
+		if(head == tail) WaitForProducer(tail);
+	}
+}
+
+TransportResult RingTransport::Poll(Message* message)
+{
+	// Only the plugin writes the tail
+	unsigned int tail = (unsigned int)ring->tail;
+	while(true)
+	{
+		unsigned int head = RingLoad(&ring->head);
+		if(head == tail) return TRANSPORT_EMPTY;
+
+		// Records are 4-byte aligned and never wrap, the writer always leaves room for the length
+		unsigned int offset = tail & (RING_CAPACITY-1);
+		unsigned int available = head - tail;
+		unsigned int length = RING_PADDING;
+		bool corrupt = available > RING_CAPACITY || available < sizeof(length);
+		if(!corrupt) memcpy(&length, ring->data + offset, sizeof(length));
+
+		// Skip to the start of the data
+		if(!corrupt && length == RING_PADDING && RING_CAPACITY - offset <= available)
+		{
+			tail += RING_CAPACITY - offset;
+			RingStore(&ring->tail, tail);
+			continue;
+		}
+
+		/*
+		 * A record the writer could not have written means a second writer corrupted the ring. Everything
+		 * up to its head is dropped, the ring keeps working for the messages that follow.
+		 */
+		if(corrupt || length >= MESSAGE_BUFSIZE || RingRecordSize(length) > available || offset + RingRecordSize(length) > RING_CAPACITY)
+		{
+			tail = head;
+			RingStore(&ring->tail, tail);
+			continue;
+		}
+
+		memcpy(message->data, ring->data + offset + sizeof(length), length);
+		message->data[length] = '\0';
+		message->length = length;
+		message->peer = RingLoad(&ring->writer);
+
+		// Hand the space back to the writer
+		RingStore(&ring->tail, tail + RingRecordSize(length));
+
+		if(length == 0) return TRANSPORT_WOKEN;
+		return TRANSPORT_MESSAGE;
+	}
+}
+
+void RingTransport::Wake()
+{
+	RingSwapWoken(&woken, 1);
+#ifdef _WIN32
+	if(hEvent != NULL) SetEvent(hEvent);
+#else
+	if(ring != NULL)
+	{
+		RingExchange(&ring->waiting, 0);
+		RingFutexWake(&ring->waiting);
+	}
+#endif
+}
+
+/*********************************** RingWriter ************************************/
+
+RingWriter::RingWriter(void) :
+	ring(NULL)
+{
+#ifdef _WIN32
+	hMapping = NULL;
+	hEvent = NULL;
+#endif
+}
+
+RingWriter::~RingWriter(void)
+{
+	Close();
+}
+
+bool RingWriter::Open()
+{
+#ifdef _WIN32
+	hMapping = OpenFileMapping(FILE_MAP_ALL_ACCESS, FALSE, RING_SHARED_NAME);
+	hEvent = OpenEvent(EVENT_MODIFY_STATE, FALSE, RING_EVENT_NAME);
+	if(hMapping != NULL && hEvent != NULL) ring = (RingShared*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(RingShared));
+#else
+	char name[64];
+	snprintf(name, sizeof(name), RING_SHARED_NAME, (unsigned int)getuid());
+	int fd = shm_open(name, O_RDWR | O_CLOEXEC, 0600);
+	if(fd != -1)
+	{
+		void* memory = mmap(NULL, sizeof(RingShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(memory != MAP_FAILED) ring = (RingShared*)memory;
+		close(fd);
+	}
+#endif
+
+	if(ring == NULL || RingLoad(&ring->magic) != RING_MAGIC || ring->capacity != RING_CAPACITY)
+	{
+		Close();
+		return false;
+	}
+
+	// The plugin tells the senders apart by the process ID, there is only one writer at a time
+#ifdef _WIN32
+	RingStore(&ring->writer, (unsigned int)GetCurrentProcessId());
+#else
+	RingStore(&ring->writer, (unsigned int)getpid());
+#endif
+	return true;
+}
+
+void RingWriter::Close()
+{
+	if(ring != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(ring);
+#else
+		munmap(ring, sizeof(RingShared));
+#endif
+		ring = NULL;
+	}
+
+#ifdef _WIN32
+	if(hMapping != NULL) CloseHandle(hMapping);
+	if(hEvent != NULL) CloseHandle(hEvent);
+	hMapping = hEvent = NULL;
+#endif
+}
+
+bool RingWriter::Write(const char* message, size_t length)
+{
+	if(ring == NULL || RingLoad(&ring->magic) != RING_MAGIC) return false;
+	if(length >= MESSAGE_BUFSIZE) return false;
+
+	// Only the writer writes the head
+	unsigned int head = (unsigned int)ring->head;
+	unsigned int tail = RingLoad(&ring->tail);
+	unsigned int size = RingRecordSize((unsigned int)length);
+
+	// A record that does not fit before the end of the data also uses up the rest of it
+	unsigned int offset = head & (RING_CAPACITY-1);
+	unsigned int contiguous = RING_CAPACITY - offset;
+	unsigned int needed = (size > contiguous) ? size + contiguous : size;
+	if(RING_CAPACITY - (head - tail) < needed) return false;
+
+	if(size > contiguous)
+	{
+		unsigned int padding = RING_PADDING;
+		memcpy(ring->data + offset, &padding, sizeof(padding));
+		head += contiguous;
+		offset = 0;
+	}
+
+	unsigned int recordLength = (unsigned int)length;
+	memcpy(ring->data + offset, &recordLength, sizeof(recordLength));
+	memcpy(ring->data + offset + sizeof(recordLength), message, length);
+	RingStore(&ring->head, head + size);
+
+	// Only wake the plugin if it is sleeping, the head must be visible before the flag is checked
+	RingFence();
+	if(ring->waiting != 0 && RingExchange(&ring->waiting, 0) != 0)
+	{
+#ifdef _WIN32
+		SetEvent(hEvent);
+#else
+		RingFutexWake(&ring->waiting);
+#endif
+	}
+	return true;
+}
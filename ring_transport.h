@@ -0,0 +1,111 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef RING_TRANSPORT_H
+#define RING_TRANSPORT_H
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "transport.h"
+
+#define RING_MAGIC 0x4e4b5231 // "NKR1"
+#define RING_CAPACITY 65536   // Bytes of message data, a power of two
+#define RING_CACHE_LINE 64
+
+#ifdef _WIN32
+#define RING_SHARED_NAME "Local\\niftykb_ring"
+#define RING_EVENT_NAME "Local\\niftykb_ring_wake"
+typedef LONG RingWord;
+#else
+#define RING_SHARED_NAME "/niftykb-ring-%u" // Formatted with the user id
+typedef int RingWord; // Futex word
+#endif
+
+/*
+ * Layout of the shared memory. The positions are byte counters that only grow, the offset in the
+ * data is the position modulo RING_CAPACITY. Every record is a 32-bit length followed by the message,
+ * padded to 4 bytes. A record never wraps, a length of RING_PADDING skips the rest of the data.
+ */
+typedef struct
+{
+	volatile RingWord magic;    // Set by the plugin once the ring is ready
+	volatile RingWord capacity;
+	volatile RingWord writer;   // Process ID of the open writer, stamped by RingWriter::Open
+	char pad0[RING_CACHE_LINE - 3*sizeof(RingWord)];
+
+	volatile RingWord head;     // Written by the producer
+	char pad1[RING_CACHE_LINE - sizeof(RingWord)];
+
+	volatile RingWord tail;     // Written by the plugin
+	volatile RingWord waiting;  // Set by the plugin before it sleeps, the producer wakes it if set
+	char pad2[RING_CACHE_LINE - 2*sizeof(RingWord)];
+
+	char data[RING_CAPACITY];
+} RingShared;
+
+#define RING_PADDING 0xFFFFFFFF
+
+/*
+ * Receives command messages from a single producer through a ring buffer in shared memory.
+ * The producer only makes a system call to wake the plugin when it is sleeping, and the plugin
+ * spins briefly before it sleeps, so a burst of messages costs no kernel transitions at all.
+ *
+ * On Windows the plugin sleeps on a named event, elsewhere on a futex in the shared memory.
+ * Use RingWriter to send messages, only one writer may be open at a time.
+ */
+class RingTransport : public Transport
+{
+private:
+	RingShared* ring;
+	volatile long woken;
+#ifdef _WIN32
+	HANDLE hMapping;
+	HANDLE hEvent;
+#else
+	char name[64];
+#endif
+
+	void WaitForProducer(unsigned int tail);
+public:
+	RingTransport(void);
+	~RingTransport(void);
+
+	bool Open();
+	void Close();
+	TransportResult Receive(Message* message);
+	TransportResult Poll(Message* message);
+	void Wake();
+	const char* Name() const { return "shared memory ring"; }
+};
+
+/*
+ * The producer side of the ring, for applications that send commands.
+ */
+class RingWriter
+{
+private:
+	RingShared* ring;
+#ifdef _WIN32
+	HANDLE hMapping;
+	HANDLE hEvent;
+#endif
+public:
+	RingWriter(void);
+	~RingWriter(void);
+
+	// Returns false if the plugin is not running
+	bool Open();
+	void Close();
+
+	// Returns false if the message is too long or the ring is full
+	bool Write(const char* message, size_t length);
+};
+
+#endif
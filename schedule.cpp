@@ -0,0 +1,119 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <string.h>
+
+#include "schedule.h"
+
+CommandScheduler::CommandScheduler(TimerWheel& wheel, ScheduleProc proc) :
+	wheel(wheel),
+	proc(proc),
+	count(0)
+{
+	for(size_t i=0; i<SCHEDULE_CAPACITY; i++)
+	{
+		entries[i].owner = this;
+		entries[i].used = false;
+		entries[i].name[0] = '\0';
+		entries[i].line[0] = '\0';
+		entries[i].interval = 0;
+		timers[i].proc = Fire;
+		timers[i].data = &entries[i];
+	}
+}
+
+CommandScheduler::~CommandScheduler(void)
+{
+	Clear();
+}
+
+CommandScheduler::Entry* CommandScheduler::Find(const char* name)
+{
+	for(size_t i=0; i<SCHEDULE_CAPACITY; i++)
+	{
+		if(entries[i].used && entries[i].name[0] != '\0' && !strcmp(entries[i].name, name)) return &entries[i];
+	}
+	return NULL;
+}
+
+void CommandScheduler::Remove(size_t index)
+{
+	wheel.Cancel(&timers[index]);
+	entries[index].used = false;
+	count--;
+}
+
+void CommandScheduler::Fire(WheelTimer* timer)
+{
+	Entry* entry = (Entry*)timer->data;
+	CommandScheduler* scheduler = entry->owner;
+	size_t index = entry - scheduler->entries;
+
+	// The line may schedule or cancel entries itself, including this one, so it runs from a copy
+	char line[SCHEDULE_LINE_BUFSIZE];
+	strcpy(line, entry->line);
+	uint64 due = timer->expires;
+
+	if(entry->interval != 0)
+	{
+		// Keep the rhythm of the repeat, unless the wheel fell behind by a whole interval
+		uint64 now = scheduler->wheel.Now();
+		uint64 next = due + entry->interval;
+		if(next <= now) next = now + entry->interval;
+		scheduler->wheel.Start(timer, now, next - now);
+	}
+	else scheduler->Remove(index);
+
+	scheduler->proc(line, due);
+}
+
+bool CommandScheduler::Add(const char* name, const char* line, uint64 now, uint64 delay, uint64 interval)
+{
+	if(name == NULL) name = "";
+	if(strlen(name) >= SCHEDULE_NAME_BUFSIZE || strlen(line) >= SCHEDULE_LINE_BUFSIZE) return false;
+
+	// A named entry replaces the one with the same name, its timer is moved
+	Entry* entry = (*name != '\0') ? Find(name) : NULL;
+	if(entry == NULL)
+	{
+		for(size_t i=0; i<SCHEDULE_CAPACITY && entry == NULL; i++)
+		{
+			if(!entries[i].used) entry = &entries[i];
+		}
+		if(entry == NULL) return false;
+
+		entry->used = true;
+		count++;
+	}
+
+	strcpy(entry->name, name);
+	strcpy(entry->line, line);
+	entry->interval = (interval != 0 && interval < SCHEDULE_MIN_INTERVAL) ? SCHEDULE_MIN_INTERVAL : interval;
+
+	// Entries that are due in the same tick expire at the same time, so they run in a single pass of the wheel
+	uint64 expires = (now + delay + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK * TIMER_WHEEL_TICK;
+	wheel.Start(&timers[entry - entries], now, expires - now);
+	return true;
+}
+
+bool CommandScheduler::Cancel(const char* name)
+{
+	Entry* entry = Find(name);
+	if(entry == NULL) return false;
+
+	Remove(entry - entries);
+	return true;
+}
+
+void CommandScheduler::Clear()
+{
+	for(size_t i=0; i<SCHEDULE_CAPACITY; i++)
+	{
+		if(entries[i].used) Remove(i);
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include "public_definitions.h"
+#include "timer_wheel.h"
+
+#include <stddef.h>
+
+#define SCHEDULE_CAPACITY 32          // Commands waiting at once
+#define SCHEDULE_NAME_BUFSIZE 32
+#define SCHEDULE_LINE_BUFSIZE 512
+#define SCHEDULE_MIN_INTERVAL 10000   // Shortest repeat interval in microseconds
+
+// Runs a command line that is due, due is the time it was scheduled for
+typedef void (*ScheduleProc)(const char* line, uint64 due);
+
+/*
+ * Command lines that run once after a delay or repeatedly until they are cancelled. Every entry is a timer
+ * on the wheel, lines due in the same tick expire together and run in the same pass. Named entries
+ * replace an entry with the same name, unnamed entries can not be cancelled on their own.
+ *
+ * Not thread-safe, runs on the thread that advances the wheel.
+ */
+class CommandScheduler
+{
+private:
+	typedef struct
+	{
+		CommandScheduler* owner;
+		bool used;
+		char name[SCHEDULE_NAME_BUFSIZE]; // Empty for an unnamed entry
+		char line[SCHEDULE_LINE_BUFSIZE];
+		uint64 interval;                  // Microseconds between runs, 0 to run once
+	} Entry;
+
+	TimerWheel& wheel;
+	ScheduleProc proc;
+	Entry entries[SCHEDULE_CAPACITY];
+	WheelTimer timers[SCHEDULE_CAPACITY];
+	size_t count;
+
+	Entry* Find(const char* name);
+	void Remove(size_t index);
+	static void Fire(WheelTimer* timer);
+public:
+	CommandScheduler(TimerWheel& wheel, ScheduleProc proc);
+	~CommandScheduler(void);
+
+	// Returns false if every entry is in use or the name or line is too long, name may be NULL or empty
+	bool Add(const char* name, const char* line, uint64 now, uint64 delay, uint64 interval);
+
+	// Returns false if no entry has the name
+	bool Cancel(const char* name);
+	void Clear();
+
+	inline size_t Count() const { return count; }
+};
+
+#endif
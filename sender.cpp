@@ -0,0 +1,263 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "sender.h"
+#include "frame.h"
+
+// The waiting count is read by other threads to see whether the senders are drained
+static inline long SenderLoad(const volatile long* word)
+{
+#ifdef _WIN32
+	long value = *word;
+	_ReadWriteBarrier();
+	return value;
+#else
+	return __atomic_load_n(word, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void SenderStore(volatile long* word, long value)
+{
+#ifdef _WIN32
+	_ReadWriteBarrier();
+	*word = value;
+#else
+	__atomic_store_n(word, value, __ATOMIC_RELEASE);
+#endif
+}
+
+void IdentifySender(Message* message)
+{
+	// The process ID comes from the endpoint, a sender cannot make it up
+	char* name = message->sender;
+	int length;
+	if(message->peer != 0) length = snprintf(name, MESSAGE_SENDER_BUFSIZE, "pid %u", message->peer);
+	else length = snprintf(name, MESSAGE_SENDER_BUFSIZE, "anonymous");
+	char* declared = name + length;
+	size_t size = MESSAGE_SENDER_BUFSIZE - length;
+
+	if(IsFrame(message->data, message->length))
+	{
+		unsigned int sender = (unsigned char)message->data[FRAME_SENDER_OFFSET];
+		if(sender != 0) snprintf(declared, size, "/frame %u", sender);
+	}
+	else if(message->data[0] == SENDER_PREFIX)
+	{
+		// Blank out the name, the rest of the line is parsed as usual
+		size_t nameLength = strcspn(message->data, " \r\n");
+		if(nameLength > 1)
+		{
+			size_t copy = (nameLength < size-1) ? nameLength : size-2;
+			declared[0] = '/';
+			memcpy(declared+1, message->data, copy);
+			declared[copy+1] = '\0';
+			memset(message->data, ' ', nameLength);
+		}
+	}
+}
+
+SenderTable::SenderTable(void) :
+	next(0),
+	waiting(0),
+	rate(0.0),
+	burst(0.0)
+{
+	memset(senders, 0, sizeof(senders));
+}
+
+SenderTable::~SenderTable(void)
+{
+}
+
+void SenderTable::SetLimit(double rate, double burst)
+{
+	this->rate = (rate > 0.0) ? rate : 0.0;
+	this->burst = (burst >= 1.0) ? burst : ((this->rate >= 1.0) ? this->rate : 1.0);
+
+	// Every sender starts over with a full bucket
+	for(int i=0; i<SENDER_SLOTS; i++)
+		senders[i].tokens = this->burst;
+}
+
+Sender* SenderTable::Find(const char* name, uint64 now)
+{
+	// Named senders are counted per process, the process is the part of the name before the slash
+	size_t peerLength = strcspn(name, "/");
+	bool named = (name[peerLength] != '\0');
+	unsigned int names = 0;
+
+	Sender* replace = NULL;
+	for(int i=0; i<SENDER_SLOTS; i++)
+	{
+		Sender& sender = senders[i];
+		if(sender.used && !strcmp(sender.stats.name, name)) return &sender;
+		if(named && sender.used && !strncmp(sender.stats.name, name, peerLength+1)) names++;
+
+		// Reuse a free slot, or the sender that was seen least recently and has nothing waiting
+		if(sender.count == 0 && (replace == NULL || (replace->used && (!sender.used || sender.seen < replace->seen)))) replace = &sender;
+	}
+
+	// A process making up names shares the limit of the process once it used up its names
+	if(names >= SENDER_NAMES_PER_PEER)
+	{
+		char peer[SENDER_NAME_BUFSIZE];
+		memcpy(peer, name, peerLength);
+		peer[peerLength] = '\0';
+		return Find(peer, now);
+	}
+
+	// Every slot has messages waiting, which SENDER_MAX_WAITING prevents
+	if(replace == NULL) return NULL;
+
+	memset(replace, 0, sizeof(Sender));
+	replace->used = true;
+	_strcpy(replace->stats.name, SENDER_NAME_BUFSIZE, name);
+	replace->tokens = burst;
+	replace->refilled = now;
+	return replace;
+}
+
+void SenderTable::Refill(Sender& sender, uint64 now)
+{
+	if(rate > 0.0 && now > sender.refilled)
+	{
+		sender.tokens += (double)(now - sender.refilled) * rate / 1000000.0;
+		if(sender.tokens > burst) sender.tokens = burst;
+	}
+	sender.refilled = now;
+}
+
+bool SenderTable::Admit(Message* message, const char* name, uint64 now)
+{
+	Sender* sender = Find(name, now);
+	if(sender == NULL) return false;
+	sender->seen = now;
+	Refill(*sender, now);
+
+	// Messages beyond the tokens of the sender have to wait for the rate limit
+	bool throttled = rate > 0.0 && (double)(sender->count + 1) > sender->tokens;
+	unsigned int backlog = throttled ? sender->count + 1 - (unsigned int)sender->tokens : 0;
+	if(backlog > SENDER_BACKLOG || sender->count >= SENDER_QUEUE_SIZE || waiting >= SENDER_MAX_WAITING)
+	{
+		sender->stats.dropped++;
+		return false;
+	}
+	if(throttled) sender->stats.throttled++;
+
+	sender->queue[(sender->head + sender->count) % SENDER_QUEUE_SIZE] = message;
+	sender->count++;
+	SenderStore(&waiting, waiting + 1);
+	return true;
+}
+
+size_t SenderTable::Schedule(Message** messages, size_t max, uint64 now)
+{
+	size_t count = 0;
+
+	bool progress = true;
+	while(count < max && progress)
+	{
+		// One message from every sender per round
+		progress = false;
+		for(int i=0; i<SENDER_SLOTS && count < max; i++)
+		{
+			Sender& sender = senders[(next + i) % SENDER_SLOTS];
+			if(!sender.used || sender.count == 0) continue;
+
+			Refill(sender, now);
+			if(rate > 0.0)
+			{
+				if(sender.tokens < 1.0) continue;
+				sender.tokens -= 1.0;
+			}
+
+			messages[count++] = sender.queue[sender.head];
+			sender.head = (sender.head + 1) % SENDER_QUEUE_SIZE;
+			sender.count--;
+			sender.stats.accepted++;
+			SenderStore(&waiting, waiting - 1);
+			progress = true;
+		}
+
+		// Start the next round at the next sender
+		next = (next + 1) % SENDER_SLOTS;
+	}
+
+	return count;
+}
+
+uint64 SenderTable::NextRelease(uint64 now)
+{
+	uint64 release = 0;
+
+	for(int i=0; i<SENDER_SLOTS && waiting > 0; i++)
+	{
+		Sender& sender = senders[i];
+		if(!sender.used || sender.count == 0) continue;
+
+		Refill(sender, now);
+		uint64 time = now;
+		if(rate > 0.0 && sender.tokens < 1.0) time = now + (uint64)((1.0 - sender.tokens) * 1000000.0 / rate) + 1;
+		if(release == 0 || time < release) release = time;
+	}
+
+	return release;
+}
+
+bool SenderTable::IsEmpty() const
+{
+	return SenderLoad(&waiting) == 0;
+}
+
+Message* SenderTable::Discard()
+{
+	Message* message = NULL;
+
+	for(int i=0; i<SENDER_SLOTS && message == NULL; i++)
+	{
+		Sender& sender = senders[i];
+		if(sender.count == 0) continue;
+
+		message = sender.queue[sender.head];
+		sender.head = (sender.head + 1) % SENDER_QUEUE_SIZE;
+		sender.count--;
+		SenderStore(&waiting, waiting - 1);
+	}
+
+	return message;
+}
+
+size_t SenderTable::Snapshot(SenderStats* stats, size_t max)
+{
+	size_t count = 0;
+
+	for(int i=0; i<SENDER_SLOTS && count < max; i++)
+		if(senders[i].used) stats[count++] = senders[i].stats;
+
+	return count;
+}
+
+void SenderTable::ResetStats()
+{
+	for(int i=0; i<SENDER_SLOTS; i++)
+	{
+		senders[i].stats.accepted = 0;
+		senders[i].stats.throttled = 0;
+		senders[i].stats.dropped = 0;
+	}
+}
@@ -0,0 +1,100 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef SENDER_H
+#define SENDER_H
+
+#include "public_definitions.h"
+#include "message.h"
+
+#include <stddef.h>
+
+#define SENDER_PREFIX '$'
+#define SENDER_NAME_BUFSIZE MESSAGE_SENDER_BUFSIZE
+#define SENDER_SLOTS 32
+#define SENDER_NAMES_PER_PEER 4                 // Senders a process may name, more names share the limit of the process
+#define SENDER_QUEUE_SIZE MESSAGE_BATCH_SIZE
+#define SENDER_BACKLOG 2                        // Messages a sender may have waiting for the rate limit
+#define SENDER_MAX_WAITING (MESSAGE_POOL_SIZE / 4) // Messages all senders together may have waiting
+
+/*
+ * Names the sender of a message in message->sender. The name starts with the process ID if the endpoint
+ * knows it, or "anonymous" otherwise. A text message may start with SENDER_PREFIX and a name and a binary
+ * frame carries a sender number in its header, these are added after a slash, like "pid 42/$macros".
+ * The sender name is removed from text messages.
+ */
+void IdentifySender(Message* message);
+
+typedef struct
+{
+	char name[SENDER_NAME_BUFSIZE];
+	unsigned long accepted;  // Messages that were run
+	unsigned long throttled; // Messages that had to wait for the rate limit
+	unsigned long dropped;   // Messages that were discarded because the sender was too far over the limit
+} SenderStats;
+
+typedef struct
+{
+	bool used;
+	SenderStats stats;
+	double tokens;
+	uint64 refilled; // Time the tokens were last refilled, in microseconds
+	uint64 seen;     // Time the last message arrived, the least recently seen sender is replaced first
+	Message* queue[SENDER_QUEUE_SIZE];
+	unsigned int head;
+	unsigned int count;
+} Sender;
+
+/*
+ * Rate limits every sender with a token bucket and shares the plugin fairly between them.
+ * Received messages wait in a small queue per sender and are taken from the senders round-robin,
+ * so a sender flooding the endpoint cannot push the messages of another sender back. A sender that
+ * is out of tokens keeps at most SENDER_BACKLOG messages waiting, anything beyond is dropped.
+ * A process gets at most SENDER_NAMES_PER_PEER named senders, so it cannot take every slot by
+ * making up names.
+ *
+ * Owned by the executor, the receive threads post the messages to it. Only IsEmpty may be called
+ * from other threads.
+ */
+class SenderTable
+{
+private:
+	Sender senders[SENDER_SLOTS];
+	unsigned int next;     // Sender that is served first in the next round
+	volatile long waiting; // Messages queued over all senders
+	double rate;          // Messages per second per sender, 0 if unlimited
+	double burst;
+
+	Sender* Find(const char* name, uint64 now);
+	void Refill(Sender& sender, uint64 now);
+public:
+	SenderTable(void);
+	~SenderTable(void);
+
+	void SetLimit(double rate, double burst);
+
+	// Queues a message, returns false if it was dropped and the caller still owns it
+	bool Admit(Message* message, const char* name, uint64 now);
+
+	// Takes the messages that may run now, one sender after the other
+	size_t Schedule(Message** messages, size_t max, uint64 now);
+
+	// Time the next throttled message may run, 0 if no message is waiting
+	uint64 NextRelease(uint64 now);
+
+	// Whether no message is waiting, from any thread
+	bool IsEmpty() const;
+
+	// Takes any waiting message without running it, used at shutdown
+	Message* Discard();
+
+	size_t Snapshot(SenderStats* stats, size_t max);
+	void ResetStats();
+};
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef _WIN32
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "socket_transport.h"
+
+// Tags of the descriptors registered with epoll
+#define SOCKET_TAG_MESSAGE 0
+#define SOCKET_TAG_WAKE 1
+
+SocketTransport::SocketTransport(void) :
+	sock(-1),
+	wakeFd(-1),
+	pollFd(-1)
+{
+	const char* runtimeDir = getenv("XDG_RUNTIME_DIR");
+	int length;
+	if(runtimeDir != NULL && *runtimeDir != '\0') length = snprintf(path, SOCKET_PATH_BUFSIZE, "%s/niftykb.sock", runtimeDir);
+	else length = snprintf(path, SOCKET_PATH_BUFSIZE, "/tmp/niftykb-%u.sock", (unsigned int)getuid());
+
+	// Never bind a truncated path
+	if(length < 0 || length >= SOCKET_PATH_BUFSIZE) path[0] = '\0';
+}
+
+SocketTransport::~SocketTransport(void)
+{
+	Close();
+}
+
+bool SocketTransport::Open()
+{
+	if(path[0] == '\0') return false;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+
+	sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	pollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(sock == -1 || wakeFd == -1 || pollFd == -1)
+	{
+		Close();
+		return false;
+	}
+
+	// A socket left behind by a previous session would make the bind fail
+	unlink(path);
+
+	// Only the user may send commands
+	mode_t mask = umask(0077);
+	int result = bind(sock, (struct sockaddr*)&addr, sizeof(addr));
+	umask(mask);
+	if(result == -1)
+	{
+		Close();
+		return false;
+	}
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u32 = SOCKET_TAG_MESSAGE;
+	if(epoll_ctl(pollFd, EPOLL_CTL_ADD, sock, &event) == -1)
+	{
+		Close();
+		return false;
+	}
+
+	// Have the kernel pass the process ID of the sender with every datagram
+	int passCredentials = 1;
+	setsockopt(sock, SOL_SOCKET, SO_PASSCRED, &passCredentials, sizeof(passCredentials));
+	event.data.u32 = SOCKET_TAG_WAKE;
+	if(epoll_ctl(pollFd, EPOLL_CTL_ADD, wakeFd, &event) == -1)
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void SocketTransport::Close()
+{
+	if(sock != -1)
+	{
+		close(sock);
+		unlink(path);
+	}
+	if(pollFd != -1) close(pollFd);
+	if(wakeFd != -1) close(wakeFd);
+	sock = wakeFd = pollFd = -1;
+}
+
+TransportResult SocketTransport::Receive(Message* message)
+{
+	while(true)
+	{
+		// Block until a datagram arrives or we are woken
+		struct epoll_event event;
+		int count = epoll_wait(pollFd, &event, 1, -1);
+		if(count == -1)
+		{
+			if(errno == EINTR) continue;
+			return TRANSPORT_ERROR;
+		}
+		if(count == 0) continue;
+
+		if(event.data.u32 == SOCKET_TAG_WAKE)
+		{
+			eventfd_t value;
+			eventfd_read(wakeFd, &value);
+			return TRANSPORT_WOKEN;
+		}
+
+		TransportResult result = Poll(message);
+		if(result != TRANSPORT_EMPTY) return result;
+	}
+}
+
+TransportResult SocketTransport::Poll(Message* message)
+{
+	struct iovec vector;
+	vector.iov_base = message->data;
+	vector.iov_len = MESSAGE_BUFSIZE-1;
+
+	union
+	{
+		struct cmsghdr header;
+		char buffer[CMSG_SPACE(sizeof(struct ucred))];
+	} control;
+
+	struct msghdr header;
+	memset(&header, 0, sizeof(header));
+	header.msg_iov = &vector;
+	header.msg_iovlen = 1;
+	header.msg_control = control.buffer;
+	header.msg_controllen = sizeof(control.buffer);
+
+	// Datagrams longer than the buffer are truncated, like the mailslot refuses them
+	ssize_t length;
+	do length = recvmsg(sock, &header, MSG_DONTWAIT);
+	while(length == -1 && errno == EINTR);
+
+	if(length == -1)
+	{
+		if(errno == EAGAIN || errno == EWOULDBLOCK) return TRANSPORT_EMPTY;
+		return TRANSPORT_ERROR;
+	}
+
+	// The sender is not required to include a NULL-terminator
+	message->length = (size_t)length;
+	message->data[message->length] = '\0';
+
+	message->peer = 0;
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header);
+	if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS)
+	{
+		struct ucred credentials;
+		memcpy(&credentials, CMSG_DATA(cmsg), sizeof(credentials));
+		message->peer = (unsigned int)credentials.pid;
+	}
+
+	if(length == 0) return TRANSPORT_WOKEN;
+	return TRANSPORT_MESSAGE;
+}
+
+void SocketTransport::Wake()
+{
+	if(wakeFd != -1) eventfd_write(wakeFd, 1);
+}
+#endif
@@ -0,0 +1,44 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef SOCKET_TRANSPORT_H
+#define SOCKET_TRANSPORT_H
+
+#ifndef _WIN32
+#include "transport.h"
+
+#define SOCKET_PATH_BUFSIZE 108 // Size of sockaddr_un.sun_path
+
+/*
+ * Receives every datagram on a Unix-domain socket as one command message, the counterpart of the
+ * mailslot on Linux. The socket is created at $XDG_RUNTIME_DIR/niftykb.sock, or at
+ * /tmp/niftykb-<uid>.sock if there is no runtime directory, and is only accessible to the user.
+ *
+ * The receive thread blocks in epoll on the socket and an eventfd, Wake signals the eventfd.
+ */
+class SocketTransport : public Transport
+{
+protected:
+	int sock;
+	int wakeFd;
+	int pollFd;
+	char path[SOCKET_PATH_BUFSIZE];
+public:
+	SocketTransport(void);
+	~SocketTransport(void);
+
+	bool Open();
+	void Close();
+	TransportResult Receive(Message* message);
+	TransportResult Poll(Message* message);
+	void Wake();
+	const char* Name() const { return path; }
+};
+#endif
+
+#endif
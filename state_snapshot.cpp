@@ -0,0 +1,307 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "state_snapshot.h"
+
+#define SNAPSHOT_READ_ATTEMPTS 100 // Copies a reader tries before it gives up
+
+#if defined(_WIN32)
+#define SNAPSHOT_PAUSE() YieldProcessor()
+#elif defined(__i386__) || defined(__x86_64__)
+#define SNAPSHOT_PAUSE() __builtin_ia32_pause()
+#else
+#define SNAPSHOT_PAUSE()
+#endif
+
+static inline unsigned int SnapshotLoad(volatile SnapshotWord* word)
+{
+#ifdef _WIN32
+	SnapshotWord value = *word;
+	_ReadWriteBarrier();
+	return (unsigned int)value;
+#else
+	return (unsigned int)__atomic_load_n(word, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void SnapshotStore(volatile SnapshotWord* word, unsigned int value)
+{
+#ifdef _WIN32
+	_ReadWriteBarrier();
+	*word = (SnapshotWord)value;
+#else
+	__atomic_store_n(word, (SnapshotWord)value, __ATOMIC_RELEASE);
+#endif
+}
+
+// Orders the copy of the state against the sequence, the state itself is not read atomically
+static inline void SnapshotReleaseFence()
+{
+#ifdef _WIN32
+	_ReadWriteBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+#endif
+}
+
+static inline void SnapshotAcquireFence()
+{
+#ifdef _WIN32
+	_ReadWriteBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+/*********************************** StatePublisher ************************************/
+
+StatePublisher::StatePublisher(void) :
+	shared(NULL)
+{
+	memset(&state, 0, sizeof(state));
+#ifdef _WIN32
+	hMapping = NULL;
+#else
+	snprintf(name, sizeof(name), SNAPSHOT_SHARED_NAME, (unsigned int)getuid());
+#endif
+}
+
+StatePublisher::~StatePublisher(void)
+{
+	Close();
+}
+
+bool StatePublisher::Open()
+{
+	lock.Lock();
+#ifdef _WIN32
+	hMapping = CreateFileMapping(INVALID_HANDLE_VALUE, (LPSECURITY_ATTRIBUTES)NULL, PAGE_READWRITE, 0, sizeof(SnapshotShared), SNAPSHOT_SHARED_NAME);
+	if(hMapping != NULL) shared = (SnapshotShared*)MapViewOfFile(hMapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(SnapshotShared));
+#else
+	// Only the user may map the snapshot
+	int fd = shm_open(name, O_CREAT | O_RDWR | O_CLOEXEC, 0600);
+	if(fd != -1)
+	{
+		if(ftruncate(fd, sizeof(SnapshotShared)) == 0)
+		{
+			void* memory = mmap(NULL, sizeof(SnapshotShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if(memory != MAP_FAILED) shared = (SnapshotShared*)memory;
+		}
+		close(fd);
+	}
+#endif
+
+	if(shared == NULL)
+	{
+		lock.Unlock();
+		Close();
+		return false;
+	}
+
+	// A reader left over from a previous session keeps failing until the magic is set again
+	SnapshotStore(&shared->magic, 0);
+	shared->version = SNAPSHOT_VERSION;
+	shared->sequence = 0;
+	shared->reserved = 0;
+	memcpy(&shared->state, &state, sizeof(SnapshotState));
+	SnapshotStore(&shared->magic, SNAPSHOT_MAGIC);
+	lock.Unlock();
+
+	return true;
+}
+
+void StatePublisher::Close()
+{
+	lock.Lock();
+	if(shared != NULL)
+	{
+		// Readers stop once the magic is gone
+		SnapshotStore(&shared->magic, 0);
+#ifdef _WIN32
+		UnmapViewOfFile(shared);
+#else
+		munmap(shared, sizeof(SnapshotShared));
+		shm_unlink(name);
+#endif
+		shared = NULL;
+	}
+
+#ifdef _WIN32
+	if(hMapping != NULL) CloseHandle(hMapping);
+	hMapping = NULL;
+#endif
+	lock.Unlock();
+}
+
+SnapshotServer* StatePublisher::FindServer(uint64 scHandlerID, bool add)
+{
+	for(unsigned int i=0; i<state.count; i++)
+	{
+		if(state.servers[i].scHandlerID == scHandlerID) return &state.servers[i];
+	}
+
+	if(!add || scHandlerID == 0 || state.count >= SNAPSHOT_SERVERS) return NULL;
+
+	SnapshotServer* server = &state.servers[state.count++];
+	server->scHandlerID = scHandlerID;
+	return server;
+}
+
+void StatePublisher::Publish()
+{
+	// Readers only see a new sequence when something changed
+	if(shared == NULL || !memcmp(&shared->state, &state, sizeof(SnapshotState))) return;
+
+	// Only the plugin writes the sequence, and only with the lock held
+	unsigned int sequence = (unsigned int)shared->sequence;
+	SnapshotStore(&shared->sequence, sequence + 1);
+	SnapshotReleaseFence();
+	memcpy(&shared->state, &state, sizeof(SnapshotState));
+	SnapshotStore(&shared->sequence, sequence + 2);
+}
+
+void StatePublisher::SetPluginState(uint64 activeServer, unsigned int flags)
+{
+	lock.Lock();
+	state.activeServer = activeServer;
+	state.flags = flags;
+	Publish();
+	lock.Unlock();
+}
+
+void StatePublisher::SetServerState(uint64 scHandlerID, anyID clientID, unsigned int flags)
+{
+	lock.Lock();
+	SnapshotServer* server = FindServer(scHandlerID, true);
+	if(server != NULL)
+	{
+		server->clientID = clientID;
+		server->flags = flags;
+		Publish();
+	}
+	lock.Unlock();
+}
+
+void StatePublisher::SetTalkStatus(uint64 scHandlerID, int talkStatus)
+{
+	lock.Lock();
+	SnapshotServer* server = FindServer(scHandlerID, true);
+	if(server != NULL)
+	{
+		server->talkStatus = talkStatus;
+		Publish();
+	}
+	lock.Unlock();
+}
+
+void StatePublisher::RemoveServer(uint64 scHandlerID)
+{
+	lock.Lock();
+	SnapshotServer* server = FindServer(scHandlerID, false);
+	if(server != NULL)
+	{
+		// Keep the used slots together
+		SnapshotServer* last = &state.servers[state.count-1];
+		if(server != last) *server = *last;
+		memset(last, 0, sizeof(SnapshotServer));
+		state.count--;
+		if(state.activeServer == scHandlerID) state.activeServer = 0;
+		Publish();
+	}
+	lock.Unlock();
+}
+
+/*********************************** SnapshotReader ************************************/
+
+SnapshotReader::SnapshotReader(void) :
+	shared(NULL)
+{
+#ifdef _WIN32
+	hMapping = NULL;
+#endif
+}
+
+SnapshotReader::~SnapshotReader(void)
+{
+	Close();
+}
+
+bool SnapshotReader::Open()
+{
+#ifdef _WIN32
+	hMapping = OpenFileMapping(FILE_MAP_READ, FALSE, SNAPSHOT_SHARED_NAME);
+	if(hMapping != NULL) shared = (SnapshotShared*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, sizeof(SnapshotShared));
+#else
+	char name[64];
+	snprintf(name, sizeof(name), SNAPSHOT_SHARED_NAME, (unsigned int)getuid());
+	int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0600);
+	if(fd != -1)
+	{
+		void* memory = mmap(NULL, sizeof(SnapshotShared), PROT_READ, MAP_SHARED, fd, 0);
+		if(memory != MAP_FAILED) shared = (SnapshotShared*)memory;
+		close(fd);
+	}
+#endif
+
+	if(shared == NULL || SnapshotLoad(&shared->magic) != SNAPSHOT_MAGIC || shared->version != SNAPSHOT_VERSION)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void SnapshotReader::Close()
+{
+	if(shared != NULL)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(shared);
+#else
+		munmap(shared, sizeof(SnapshotShared));
+#endif
+		shared = NULL;
+	}
+
+#ifdef _WIN32
+	if(hMapping != NULL) CloseHandle(hMapping);
+	hMapping = NULL;
+#endif
+}
+
+bool SnapshotReader::Read(SnapshotState* result)
+{
+	if(shared == NULL) return false;
+
+	for(int attempt=0; attempt<SNAPSHOT_READ_ATTEMPTS; attempt++)
+	{
+		if(SnapshotLoad(&shared->magic) != SNAPSHOT_MAGIC) return false;
+
+		// The copy is only valid if no write started before or during it
+		unsigned int before = SnapshotLoad(&shared->sequence);
+		if((before & 1) == 0)
+		{
+			memcpy(result, (const void*)&shared->state, sizeof(SnapshotState));
+			SnapshotAcquireFence();
+			if(SnapshotLoad(&shared->sequence) == before) return true;
+		}
+		SNAPSHOT_PAUSE();
+	}
+	return false;
+}
@@ -0,0 +1,134 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef STATE_SNAPSHOT_H
+#define STATE_SNAPSHOT_H
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "public_definitions.h"
+#include "platform.h"
+
+#define SNAPSHOT_MAGIC 0x4e4b5331 // "NKS1"
+#define SNAPSHOT_VERSION 1        // Changes whenever the layout of SnapshotState changes
+#define SNAPSHOT_SERVERS 8        // Servers beyond this are not published
+
+#ifdef _WIN32
+#define SNAPSHOT_SHARED_NAME "Local\\niftykb_state"
+typedef LONG SnapshotWord;
+#else
+#define SNAPSHOT_SHARED_NAME "/niftykb-state-%u" // Formatted with the user id
+typedef int SnapshotWord;
+#endif
+
+// Modes of the plugin, these apply to whichever server is active
+enum SnapshotPluginFlags
+{
+	SNAPSHOT_PTT = 0x01,         // Push-to-talk is held
+	SNAPSHOT_VAD = 0x02,         // Voice activation was turned on by a command
+	SNAPSHOT_CONTINUOUS = 0x04,  // Continuous transmission was turned on by a command
+	SNAPSHOT_WHISPER = 0x08,     // Whispering to the whisper list
+	SNAPSHOT_REPLY = 0x10        // Whispering to the reply list
+};
+
+// Own client variables on a server
+enum SnapshotServerFlags
+{
+	SNAPSHOT_INPUT_DEACTIVATED = 0x01,
+	SNAPSHOT_INPUT_MUTED = 0x02,
+	SNAPSHOT_OUTPUT_MUTED = 0x04,
+	SNAPSHOT_AWAY = 0x08
+};
+
+typedef struct
+{
+	uint64 scHandlerID;      // 0 for an unused slot
+	unsigned int clientID;   // Own client ID on the server
+	unsigned int flags;      // SnapshotServerFlags
+	int talkStatus;          // TalkStatus of the own client
+} SnapshotServer;
+
+typedef struct
+{
+	uint64 activeServer;     // Server the commands run on, 0 if none
+	unsigned int flags;      // SnapshotPluginFlags
+	unsigned int count;      // Used slots, the unused slots follow them
+	SnapshotServer servers[SNAPSHOT_SERVERS];
+} SnapshotState;
+
+/*
+ * Layout of the shared memory. The state is protected by a sequence lock: the sequence is odd while
+ * the plugin writes, a reader copies the state and retries if the sequence was odd or changed.
+ */
+typedef struct
+{
+	volatile SnapshotWord magic;    // Set by the plugin once the snapshot is ready
+	volatile SnapshotWord version;
+	volatile SnapshotWord sequence;
+	SnapshotWord reserved;
+	SnapshotState state;
+} SnapshotShared;
+
+/*
+ * Publishes the own state on every server in shared memory, so an overlay or the LEDs of a keyboard
+ * can show it without asking the plugin. The state is only written when it changed.
+ *
+ * Thread-safe.
+ */
+class StatePublisher
+{
+private:
+	Mutex lock;
+	SnapshotShared* shared;
+	SnapshotState state;
+#ifdef _WIN32
+	HANDLE hMapping;
+#else
+	char name[64];
+#endif
+
+	SnapshotServer* FindServer(uint64 scHandlerID, bool add);
+	void Publish(); // Called with the lock held
+public:
+	StatePublisher(void);
+	~StatePublisher(void);
+
+	bool Open();
+	void Close();
+
+	void SetPluginState(uint64 activeServer, unsigned int flags);
+	void SetServerState(uint64 scHandlerID, anyID clientID, unsigned int flags);
+	void SetTalkStatus(uint64 scHandlerID, int talkStatus);
+	void RemoveServer(uint64 scHandlerID);
+};
+
+/*
+ * The consumer side of the snapshot. Reading never blocks the plugin and makes no system call.
+ */
+class SnapshotReader
+{
+private:
+	SnapshotShared* shared;
+#ifdef _WIN32
+	HANDLE hMapping;
+#endif
+public:
+	SnapshotReader(void);
+	~SnapshotReader(void);
+
+	// Returns false if the plugin is not running or publishes another version
+	bool Open();
+	void Close();
+
+	// Returns false if the plugin stopped or kept writing while the state was copied
+	bool Read(SnapshotState* result);
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <string.h>
+
+#include "stats.h"
+
+uint64 StatsNow()
+{
+#ifdef _WIN32
+	// The frequency is fixed at boot, racing threads all store the same value
+	static LONGLONG frequency = 0;
+	if(frequency == 0)
+	{
+		LARGE_INTEGER freq;
+		QueryPerformanceFrequency(&freq);
+		frequency = freq.QuadPart;
+	}
+
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	// Split the conversion so the multiplication does not overflow
+	uint64 seconds = counter.QuadPart / frequency;
+	uint64 remainder = counter.QuadPart % frequency;
+	return seconds * 1000000 + remainder * 1000000 / frequency;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+Histogram::Histogram(void)
+{
+	Reset();
+}
+
+Histogram::~Histogram(void)
+{
+}
+
+unsigned int Histogram::BucketIndex(uint64 value)
+{
+	// Small values are counted exactly
+	if(value < SUB_BUCKETS) return (unsigned int)value;
+
+	// Find the magnitude of the value
+	unsigned int magnitude = 0;
+	for(uint64 v = value; v > 1; v >>= 1) magnitude++;
+	if(magnitude > MAX_MAGNITUDE) return BUCKET_COUNT-1;
+
+	// The bits below the leading one select the sub-bucket
+	unsigned int sub = (unsigned int)(value >> (magnitude - SUB_BUCKET_BITS)) - SUB_BUCKETS;
+	return SUB_BUCKETS + (magnitude - SUB_BUCKET_BITS) * SUB_BUCKETS + sub;
+}
+
+uint64 Histogram::BucketValue(unsigned int index)
+{
+	if(index < SUB_BUCKETS) return index;
+
+	// Highest value that falls into the bucket
+	unsigned int shift = (index - SUB_BUCKETS) / SUB_BUCKETS;
+	unsigned int sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+	return ((uint64)(SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void Histogram::Record(uint64 value)
+{
+	counts[BucketIndex(value)]++;
+	total++;
+	if(value > max) max = value;
+}
+
+void Histogram::Reset()
+{
+	memset(counts, 0, sizeof(counts));
+	total = 0;
+	max = 0;
+}
+
+uint64 Histogram::Percentile(double percentile) const
+{
+	if(total == 0) return 0;
+
+	// Number of values at or below the requested percentile, rounded up
+	double exact = percentile / 100.0 * total;
+	unsigned long target = (unsigned long)exact;
+	if(target < exact || target < 1) target++;
+	if(target > total) target = total;
+
+	unsigned long seen = 0;
+	for(unsigned int i=0; i<BUCKET_COUNT; i++)
+	{
+		seen += counts[i];
+		if(seen >= target)
+		{
+			// The last bucket also holds everything above its range
+			if(i == BUCKET_COUNT-1) return max;
+
+			uint64 value = BucketValue(i);
+			return (value < max) ? value : max;
+		}
+	}
+	return max;
+}
+
+StatsTable::StatsTable(void)
+{
+}
+
+StatsTable::~StatsTable(void)
+{
+}
+
+void StatsTable::Init(size_t count)
+{
+	commands.resize(count);
+}
+
+void StatsTable::Record(const CommandTiming& timing)
+{
+	if(timing.command >= commands.size()) return;
+
+	Histogram* stages = commands[timing.command].stages;
+	stages[STATS_STAGE_LOCK].Record(timing.locked - timing.received);
+	stages[STATS_STAGE_RESOLVE].Record(timing.resolved - timing.locked);
+	stages[STATS_STAGE_EXECUTE].Record(timing.returned - timing.resolved);
+	stages[STATS_STAGE_FLUSH].Record(timing.flushed - timing.returned);
+	stages[STATS_STAGE_TOTAL].Record(timing.flushed - timing.received);
+}
+
+void StatsTable::Reset()
+{
+	for(size_t i=0; i<commands.size(); i++)
+		for(int j=0; j<STATS_STAGE_COUNT; j++)
+			commands[i].stages[j].Reset();
+}
+
+const CommandStats* StatsTable::Get(size_t command) const
+{
+	if(command >= commands.size()) return NULL;
+	return &commands[command];
+}
+
+StatsBatch::StatsBatch(void) :
+	count(0)
+{
+}
+
+StatsBatch::~StatsBatch(void)
+{
+}
+
+void StatsBatch::Add(const CommandTiming& timing)
+{
+	// Very long batches are only sampled up to the limit
+	if(count < MAX_TIMINGS) timings[count++] = timing;
+}
+
+void StatsBatch::Commit(StatsTable& table, uint64 flushed)
+{
+	for(unsigned int i=0; i<count; i++)
+	{
+		timings[i].flushed = flushed;
+		table.Record(timings[i]);
+	}
+	count = 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "public_definitions.h"
+
+#include <stddef.h>
+#include <vector>
+
+// Monotonic timestamp in microseconds
+uint64 StatsNow();
+
+// The intervals measured for every command
+enum StatsStage
+{
+	STATS_STAGE_LOCK = 0, // Message received until the executor started on it
+	STATS_STAGE_RESOLVE,  // Executor started until the target was resolved
+	STATS_STAGE_EXECUTE,  // Target resolved until the TeamSpeak call returned
+	STATS_STAGE_FLUSH,    // TeamSpeak call returned until the self updates were flushed
+	STATS_STAGE_TOTAL,    // Message received until the self updates were flushed
+	STATS_STAGE_COUNT
+};
+
+// Timestamps of a single command, in microseconds
+typedef struct
+{
+	size_t command; // Index in the command table
+	uint64 received;
+	uint64 locked;
+	uint64 resolved;
+	uint64 returned;
+	uint64 flushed;
+} CommandTiming;
+
+/*
+ * Log-linear histogram of durations in microseconds, in the style of HdrHistogram.
+ * Every power of two is split into a fixed number of linear sub-buckets, so the relative error
+ * of a reported percentile is at most 1/SUB_BUCKETS no matter the magnitude. Recording is a
+ * few shifts and an increment, no allocations.
+ */
+class Histogram
+{
+private:
+	static const unsigned int SUB_BUCKET_BITS = 3;
+	static const unsigned int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const unsigned int MAX_MAGNITUDE = 24; // Durations above 2^24 us (16.7s) share the last bucket
+	static const unsigned int BUCKET_COUNT = SUB_BUCKETS * (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2);
+
+	unsigned long counts[BUCKET_COUNT];
+	unsigned long total;
+	uint64 max;
+
+	static unsigned int BucketIndex(uint64 value);
+	static uint64 BucketValue(unsigned int index);
+public:
+	Histogram(void);
+	~Histogram(void);
+
+	void Record(uint64 value);
+	void Reset();
+
+	inline unsigned long Count() const { return total; }
+	inline uint64 Max() const { return max; }
+	uint64 Percentile(double percentile) const;
+};
+
+typedef struct
+{
+	Histogram stages[STATS_STAGE_COUNT];
+} CommandStats;
+
+/*
+ * Latency histograms for every command in the command table.
+ * Not thread-safe, only used on the executor thread.
+ */
+class StatsTable
+{
+private:
+	std::vector<CommandStats> commands;
+public:
+	StatsTable(void);
+	~StatsTable(void);
+
+	void Init(size_t count);
+	void Record(const CommandTiming& timing);
+	void Reset();
+
+	const CommandStats* Get(size_t command) const;
+};
+
+/*
+ * Timings of the commands in one message. The flush happens after the last command,
+ * so the timings are held back until the flush time is known.
+ */
+class StatsBatch
+{
+public:
+	static const unsigned int MAX_TIMINGS = 64;
+private:
+	CommandTiming timings[MAX_TIMINGS];
+	unsigned int count;
+public:
+	StatsBatch(void);
+	~StatsBatch(void);
+
+	void Add(const CommandTiming& timing);
+	void Commit(StatsTable& table, uint64 flushed);
+};
+
+#endif
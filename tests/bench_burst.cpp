@@ -0,0 +1,173 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "message.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Sends push-to-talk toggles to the command socket of the loaded plugin at 1 kHz, once a message every
+ * millisecond and once in bursts of a batch every 8 milliseconds, and then as fast as the acknowledgements
+ * come back. Every message is acknowledged, which gives its latency. A burst is drained on one wakeup and
+ * run as one batch, so the plugin threads wake up far less often per message than when paced.
+ * Pass the number of messages of every load, 1000 by default.
+ */
+
+#define BURST_SIZE MESSAGE_BATCH_SIZE // Also the most messages in flight
+#define TEST_TIMEOUT 5000000 // Microseconds to wait for the last acknowledgement
+
+static int sock = -1;
+static int ackSock = -1;
+static std::vector<uint64> sent;
+static std::vector<uint64> latencies;
+static unsigned long acknowledged = 0;
+static unsigned long failed = 0;
+
+// Reads the acknowledgements that arrived, waiting for the first one up to the given time
+void ReadAcks(int timeoutMsecs)
+{
+	struct pollfd fd;
+	fd.fd = ackSock;
+	fd.events = POLLIN;
+	if(poll(&fd, 1, timeoutMsecs) <= 0) return;
+
+	char ack[256];
+	ssize_t length;
+	while((length = recv(ackSock, ack, sizeof(ack) - 1, MSG_DONTWAIT)) > 0)
+	{
+		ack[length] = '\0';
+		uint64 now = StatsNow();
+
+		// ACK <Id> <Command> <Result> <Dispatch> <Round-trip>
+		unsigned long id;
+		char result[32];
+		if(sscanf(ack, "ACK %lu %*s %31s", &id, result) != 2 || id >= sent.size() || latencies[id] != 0 || strcmp(result, "ok"))
+		{
+			failed++;
+			continue;
+		}
+		latencies[id] = (now > sent[id]) ? now - sent[id] : 1;
+		acknowledged++;
+	}
+}
+
+typedef struct
+{
+	uint64 elapsed;
+	unsigned long wakeups;
+	std::vector<uint64> latencies;
+} LoadResult;
+
+// Sends the messages in bursts every interval and waits for all of them to be acknowledged
+bool RunLoad(unsigned long messages, unsigned long burst, uint64 interval, LoadResult* result)
+{
+	sent.assign(messages, 0);
+	latencies.assign(messages, 0);
+	acknowledged = failed = 0;
+
+	unsigned long wakeups = StubThreadWakeups();
+	uint64 started = StatsNow();
+	uint64 tick = started;
+	for(unsigned long i=0; i<messages; )
+	{
+		for(unsigned long n=0; n<burst && i<messages; n++, i++)
+		{
+			// The acknowledgement socket only queues a few datagrams, the plugin never waits for it
+			uint64 waiting = StatsNow();
+			while(i - (acknowledged + failed) >= BURST_SIZE)
+			{
+				if(StatsNow() - waiting > TEST_TIMEOUT) return false;
+				ReadAcks(10);
+			}
+
+			char message[64];
+			int length = snprintf(message, sizeof(message), "@%lu TS3_PTT_TOGGLE", i);
+			sent[i] = StatsNow();
+			if(send(sock, message, length, 0) != length) return false;
+		}
+
+		tick += interval;
+		uint64 now;
+		while((now = StatsNow()) < tick)
+			ReadAcks((int)((tick - now + 999) / 1000));
+		ReadAcks(0);
+	}
+
+	uint64 waiting = StatsNow();
+	while(acknowledged + failed < messages && StatsNow() - waiting < TEST_TIMEOUT)
+		ReadAcks(10);
+
+	result->elapsed = StatsNow() - started;
+	result->wakeups = StubThreadWakeups() - wakeups;
+	result->latencies = latencies;
+	return acknowledged == messages && failed == 0;
+}
+
+void Print(const char* label, unsigned long messages, LoadResult& result)
+{
+	std::sort(result.latencies.begin(), result.latencies.end());
+	printf("%s: %.0f messages/s, latency median %lu us, 99th percentile %lu us, %.2f wakeups per message\n", label,
+		messages * 1000000.0 / (result.elapsed > 0 ? result.elapsed : 1), (unsigned long)result.latencies[messages / 2],
+		(unsigned long)result.latencies[messages * 99 / 100], (double)result.wakeups / messages);
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long messages = (argc > 1) ? (unsigned long)atol(argv[1]) : 1000;
+	if(messages < BURST_SIZE) messages = BURST_SIZE;
+	if(access("/proc/self/task", R_OK) != 0) return TEST_SKIPPED;
+
+	if(!StubLoadPlugin(0)) return 1;
+	PluginSettle();
+
+	std::string ackPath;
+	sock = StubConnectSender();
+	ackSock = StubBindAckEndpoint(&ackPath);
+	if(!CHECK(sock != -1 && ackSock != -1)) return TestResult();
+
+	// The endpoint is set before the next message runs
+	std::string endpoint = "TS3_ACK_ENDPOINT " + ackPath;
+	CHECK(send(sock, endpoint.c_str(), endpoint.size(), 0) == (ssize_t)endpoint.size());
+
+	LoadResult paced, burst, flood;
+	CHECK(RunLoad(messages, 1, 1000, &paced));
+	CHECK(RunLoad(messages, BURST_SIZE, BURST_SIZE * 1000, &burst));
+	CHECK(RunLoad(messages, BURST_SIZE, 0, &flood));
+	PluginSettle();
+
+	// Every toggle ran, an even number of them leaves push-to-talk released
+	CHECK(StubInputDeactivated(1) == ((messages % 2 == 0) ? INPUT_DEACTIVATED : INPUT_ACTIVE));
+
+	if(testFailures == 0)
+	{
+		Print("1 kHz, one message every millisecond", messages, paced);
+		Print("1 kHz, 8 messages every 8 milliseconds", messages, burst);
+		Print("As fast as possible", messages, flood);
+	}
+
+	close(sock);
+	close(ackSock);
+	StubUnloadPlugin();
+	return TestResult();
+}
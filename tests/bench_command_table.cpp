@@ -0,0 +1,104 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "commands.h"
+#include "stats.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Cost of looking up every command of the loaded plugin by name. The table finds the first and the last
+ * command alike, next to it a strcmp chain in table order shows what the lookup used to cost.
+ * Pass the number of lookups per command, 20000 by default.
+ */
+
+#define BENCH_PASSES 5
+
+static const CommandInfo* volatile sink;
+
+// The chain ParseCommand used to walk
+const CommandInfo* FindInChain(const std::vector<const CommandInfo*>& commands, const char* name)
+{
+	for(size_t i=0; i<commands.size(); i++)
+		if(!strcmp(commands[i]->name, name)) return commands[i];
+	return NULL;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long rounds = (argc > 1) ? (unsigned long)atol(argv[1]) : 20000;
+	if(rounds == 0) rounds = 1;
+
+	if(!StubLoadPlugin(0)) return 1;
+	const CommandTable& table = PluginCommandTable();
+
+	// The opcodes give the commands in table order
+	std::vector<const CommandInfo*> commands;
+	for(unsigned int opcode=0; opcode<CommandTable::MAX_OPCODES; opcode++)
+		if(table.FindOpcode(opcode) != NULL) commands.push_back(table.FindOpcode(opcode));
+	CHECK(commands.size() > 50);
+
+	// Every command is found by its own name and nothing else is
+	for(size_t i=0; i<commands.size(); i++)
+	{
+		const char* name = commands[i]->name;
+		CHECK(table.Find(name) == commands[i]);
+		CHECK(table.Find(name, strlen(name) - 1) != commands[i]);
+	}
+	CHECK(table.Find("TS3_NOT_A_COMMAND") == NULL);
+	CHECK(table.Find("") == NULL);
+
+	// The best of a few passes per command, the plugin threads are running next to the benchmark
+	std::vector<double> costs(commands.size(), 0);
+	for(int pass=0; pass<BENCH_PASSES; pass++)
+	{
+		for(size_t i=0; i<commands.size(); i++)
+		{
+			const char* name = commands[i]->name;
+			size_t length = strlen(name);
+
+			uint64 started = StatsNow();
+			for(unsigned long n=0; n<rounds; n++)
+				sink = table.Find(name, length);
+			double cost = (StatsNow() - started) * 1000.0 / rounds;
+			if(pass == 0 || cost < costs[i]) costs[i] = cost;
+		}
+	}
+
+	double fastest = costs[0], slowest = costs[0];
+	for(size_t i=1; i<costs.size(); i++)
+	{
+		if(costs[i] < fastest) fastest = costs[i];
+		if(costs[i] > slowest) slowest = costs[i];
+	}
+
+	uint64 started = StatsNow();
+	for(unsigned long n=0; n<rounds; n++)
+		sink = FindInChain(commands, commands.front()->name);
+	double chainFirst = (StatsNow() - started) * 1000.0 / rounds;
+
+	started = StatsNow();
+	for(unsigned long n=0; n<rounds; n++)
+		sink = FindInChain(commands, commands.back()->name);
+	double chainLast = (StatsNow() - started) * 1000.0 / rounds;
+
+	printf("%lu commands: table %.1f to %.1f ns per lookup, first %.1f ns, last %.1f ns\n", (unsigned long)commands.size(),
+		fastest, slowest, costs.front(), costs.back());
+	printf("strcmp chain: first %.1f ns, last %.1f ns\n", chainFirst, chainLast);
+
+	StubUnloadPlugin();
+	return TestResult();
+}
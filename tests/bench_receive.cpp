@@ -0,0 +1,93 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <vector>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Time from sending a push-to-talk command to the command socket until the plugin wrote the input, and the
+ * number of times the plugin threads wake up while nothing is sent. The receive thread blocks on the socket
+ * and the executor on its queue, so an idle plugin does not wake up at all where a polling one would wake
+ * up every few milliseconds. Pass the number of commands to send, 1000 by default.
+ */
+
+#define IDLE_MSECS 500
+#define IDLE_WAKEUPS 10      // Allowed while idle, a 5 ms poll would be a hundred
+#define TEST_TIMEOUT 5000000 // Microseconds to wait for the write of one command
+
+static int sock = -1;
+
+// Sends a command and returns the microseconds until the plugin wrote the input, 0 if it never did
+uint64 Send(const char* command)
+{
+	size_t writes = StubInputWriteCount();
+	uint64 sent = StatsNow();
+	if(send(sock, command, strlen(command), 0) == -1) return 0;
+
+	while(StubInputWriteCount() == writes)
+	{
+		if(StatsNow() - sent > TEST_TIMEOUT) return 0;
+		SleepMsecs(0);
+	}
+	return StatsNow() - sent;
+}
+
+int main(int argc, char** argv)
+{
+	int commands = (argc > 1) ? atoi(argv[1]) : 1000;
+	if(commands < 2) commands = 2;
+	if(access("/proc/self/task", R_OK) != 0) return TEST_SKIPPED;
+
+	if(!StubLoadPlugin(0)) return 1;
+	PluginSettle();
+	sock = StubConnectSender();
+	if(!CHECK(sock != -1)) return TestResult();
+
+	std::vector<uint64> latencies;
+	for(int i=0; i<commands; i++)
+	{
+		uint64 latency = Send((i % 2 == 0) ? "TS3_PTT_ACTIVATE" : "TS3_PTT_DEACTIVATE");
+		if(!CHECK(latency != 0)) break;
+		latencies.push_back(latency);
+		SleepMsecs(1);
+	}
+	PluginSettle();
+	CHECK(StubInputDeactivated(1) == ((commands % 2 == 0) ? INPUT_DEACTIVATED : INPUT_ACTIVE));
+
+	// Nothing is sent, nothing is due, a blocked thread that wakes up makes a context switch
+	unsigned long before = StubThreadWakeups();
+	SleepMsecs(IDLE_MSECS);
+	unsigned long idle = StubThreadWakeups() - before;
+	CHECK(idle <= IDLE_WAKEUPS);
+
+	if(!latencies.empty())
+	{
+		std::sort(latencies.begin(), latencies.end());
+		printf("%lu commands: latency median %lu us, 99th percentile %lu us, slowest %lu us\n", (unsigned long)latencies.size(),
+			(unsigned long)latencies[latencies.size() / 2], (unsigned long)latencies[latencies.size() * 99 / 100],
+			(unsigned long)latencies.back());
+	}
+	printf("%lu wakeups of the plugin threads in %d ms idle\n", idle, IDLE_MSECS);
+
+	close(sock);
+	StubUnloadPlugin();
+	return TestResult();
+}
@@ -0,0 +1,170 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <vector>
+
+#include "ring_transport.h"
+#include "message.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+
+/*
+ * Latency and throughput of the shared memory ring between a writer and a receiving thread, and how the
+ * ring recovers once a second writer corrupted it. The latency is measured right after the previous
+ * message, while the receiver still spins, and after a pause, when it sleeps on the futex. With a core to
+ * spare for the receiver both stay below 10 us. Pass the number of messages for the throughput, 200000 by default.
+ */
+
+#define LATENCY_MESSAGES 1000
+#define TEST_TIMEOUT 5000000 // Microseconds to wait for the receiver
+
+static RingTransport transport;
+static std::vector<uint64> latencies;
+static volatile long received = 0;  // Messages the receiver has taken, in order
+static volatile long outOfOrder = 0;
+static volatile long stopping = 0;
+
+unsigned long ReceiverThread(void*)
+{
+	Message message;
+	while(!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+	{
+		TransportResult result = transport.Receive(&message);
+		if(result == TRANSPORT_ERROR) break;
+		if(result != TRANSPORT_MESSAGE) continue;
+
+		// The sequence number and the time it was sent
+		unsigned long sequence;
+		unsigned long long sent;
+		long count = __atomic_load_n(&received, __ATOMIC_RELAXED);
+		if(sscanf(message.data, "%lu %llu", &sequence, &sent) != 2 || sequence != (unsigned long)count) outOfOrder++;
+		else if(sent != 0 && sequence < latencies.size()) latencies[sequence] = StatsNow() - sent;
+		__atomic_store_n(&received, count + 1, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+bool WaitForReceiver(long count)
+{
+	uint64 started = StatsNow();
+	while(__atomic_load_n(&received, __ATOMIC_ACQUIRE) < count)
+	{
+		if(StatsNow() - started > TEST_TIMEOUT) return false;
+		SleepMsecs(0);
+	}
+	return true;
+}
+
+bool Send(RingWriter& writer, unsigned long sequence, bool stamped)
+{
+	char text[64];
+	int length = snprintf(text, sizeof(text), "%lu %llu", sequence, stamped ? (unsigned long long)StatsNow() : 0ULL);
+
+	// A full ring is retried once the receiver caught up
+	uint64 started = StatsNow();
+	while(!writer.Write(text, length))
+	{
+		if(StatsNow() - started > TEST_TIMEOUT) return false;
+		SleepMsecs(0);
+	}
+	return true;
+}
+
+// Writes a record that no writer could have written, the way a second writer running at the same time would
+bool Corrupt(unsigned int length)
+{
+	char name[64];
+	snprintf(name, sizeof(name), RING_SHARED_NAME, (unsigned int)getuid());
+	int fd = shm_open(name, O_RDWR, 0600);
+	if(fd == -1) return false;
+	RingShared* ring = (RingShared*)mmap(NULL, sizeof(RingShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(ring == MAP_FAILED) return false;
+
+	unsigned int head = (unsigned int)ring->head;
+	memcpy(ring->data + (head & (RING_CAPACITY-1)), &length, sizeof(length));
+	__atomic_store_n(&ring->head, (RingWord)(head + 16), __ATOMIC_RELEASE);
+	munmap(ring, sizeof(RingShared));
+	return true;
+}
+
+void Percentiles(const char* label, std::vector<uint64> values)
+{
+	if(values.empty()) return;
+	std::sort(values.begin(), values.end());
+	printf("%s: median %lu us, 99th percentile %lu us, slowest %lu us\n", label, (unsigned long)values[values.size() / 2],
+		(unsigned long)values[values.size() * 99 / 100], (unsigned long)values.back());
+}
+
+int main(int argc, char** argv)
+{
+	long messages = (argc > 1) ? atol(argv[1]) : 200000;
+	if(messages < 1) messages = 1;
+
+	if(!CHECK(transport.Open())) return TestResult();
+	RingWriter writer;
+	if(!CHECK(writer.Open())) return TestResult();
+
+	// A corrupt record is dropped with everything up to the head, the next message arrives intact
+	Message message;
+	CHECK(Corrupt(RING_CAPACITY * 2));
+	CHECK(transport.Poll(&message) == TRANSPORT_EMPTY);
+	CHECK(Corrupt(100)); // Longer than what was written
+	CHECK(transport.Poll(&message) == TRANSPORT_EMPTY);
+	CHECK(writer.Write("TS3_PTT_TOGGLE", 14));
+	if(CHECK(transport.Poll(&message) == TRANSPORT_MESSAGE))
+		CHECK(message.length == 14 && !strcmp(message.data, "TS3_PTT_TOGGLE"));
+	CHECK(transport.Poll(&message) == TRANSPORT_EMPTY);
+
+	latencies.resize(2 * LATENCY_MESSAGES, 0);
+	Thread receiver;
+	if(!CHECK(receiver.Start(ReceiverThread, NULL))) return TestResult();
+
+	// Back to back, then with the receiver asleep
+	unsigned long sequence = 0;
+	bool delivered = true;
+	for(int i=0; i<LATENCY_MESSAGES && delivered; i++)
+		delivered = Send(writer, sequence++, true) && WaitForReceiver(sequence);
+	for(int i=0; i<LATENCY_MESSAGES && delivered; i++)
+	{
+		SleepMsecs(1);
+		delivered = Send(writer, sequence++, true) && WaitForReceiver(sequence);
+	}
+	CHECK(delivered);
+
+	uint64 started = StatsNow();
+	for(long i=0; i<messages && delivered; i++)
+		delivered = Send(writer, sequence++, false);
+	delivered = delivered && WaitForReceiver(sequence);
+	uint64 elapsed = StatsNow() - started;
+	CHECK(delivered);
+
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	transport.Wake();
+	CHECK(receiver.Join(PLATFORM_INFINITE));
+	CHECK(outOfOrder == 0);
+	CHECK(received == (long)sequence);
+
+	Percentiles("Receiver spinning", std::vector<uint64>(latencies.begin(), latencies.begin() + LATENCY_MESSAGES));
+	Percentiles("Receiver asleep", std::vector<uint64>(latencies.begin() + LATENCY_MESSAGES, latencies.end()));
+	printf("%ld messages in %lu ms, %.0f messages/s\n", messages, (unsigned long)(elapsed / 1000),
+		messages * 1000000.0 / (elapsed > 0 ? elapsed : 1));
+
+	writer.Close();
+	transport.Close();
+	return TestResult();
+}
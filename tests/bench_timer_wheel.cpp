@@ -0,0 +1,79 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "timer_wheel.h"
+#include "stats.h"
+#include "test.h"
+
+/*
+ * Cost per timer of arming, moving, cancelling and running out the wheel with ever more timers armed,
+ * it stays flat as the wheel fills up. Pass the largest number of timers to measure, 100000 by default.
+ */
+
+static unsigned int seed = 1;
+
+unsigned int Random()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+void Nop(WheelTimer*)
+{
+}
+
+// Delays up to an hour
+uint64 Delay()
+{
+	return ((uint64)Random() * 1009) % 3600000000ULL;
+}
+
+int main(int argc, char** argv)
+{
+	size_t largest = (argc > 1) ? (size_t)atol(argv[1]) : 100000;
+
+	for(size_t n=1000; n<=largest; n*=10)
+	{
+		TimerWheel wheel;
+		std::vector<WheelTimer> timers(n, WheelTimer(Nop));
+		uint64 now = 1000000000ULL;
+
+		uint64 started = StatsNow();
+		for(size_t i=0; i<n; i++)
+			wheel.Start(&timers[i], now, Delay());
+		uint64 armed = StatsNow();
+		for(size_t i=0; i<n; i++)
+			wheel.Start(&timers[i], now, Delay());
+		uint64 moved = StatsNow();
+		for(size_t i=0; i<n; i+=2)
+			wheel.Cancel(&timers[i]);
+		uint64 cancelled = StatsNow();
+
+		size_t fired = 0;
+		while(wheel.Count() > 0)
+		{
+			uint64 next = wheel.NextExpiry();
+			if(next > now) now = next;
+			fired += wheel.Advance(now);
+		}
+		uint64 finished = StatsNow();
+		CHECK(fired == n/2);
+
+		printf("%7lu timers: start %.0f ns, move %.0f ns, cancel %.0f ns, run out %.0f ns per timer\n", (unsigned long)n,
+			(armed - started) * 1000.0 / n, (moved - armed) * 1000.0 / n,
+			(cancelled - moved) * 1000.0 / (n/2), (finished - cancelled) * 1000.0 / (fired > 0 ? fired : 1));
+	}
+
+	return TestResult();
+}
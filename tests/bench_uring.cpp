@@ -0,0 +1,190 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <vector>
+
+#include "socket_transport.h"
+#include "uring_transport.h"
+#include "message.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+
+/*
+ * Throughput and latency of the command socket received through io_uring next to the same socket received
+ * through epoll. The latency is measured one message at a time, the throughput with the sender keeping the
+ * socket full. Skipped if the kernel does not support io_uring with multishot recvmsg.
+ * Pass the number of messages for the throughput, 100000 by default.
+ */
+
+#define LATENCY_MESSAGES 1000
+#define TEST_TIMEOUT 5000000 // Microseconds to wait for the receiver
+
+static Transport* transport = NULL;
+static std::vector<uint64> latencies;
+static volatile long received = 0;  // Messages the receiver has taken, in order
+static volatile long outOfOrder = 0;
+static volatile long stopping = 0;
+
+typedef struct
+{
+	double rate;
+	uint64 median;
+	uint64 p99;
+} TransportResults;
+
+unsigned long ReceiverThread(void*)
+{
+	Message message;
+	while(!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE))
+	{
+		TransportResult result = transport->Receive(&message);
+		if(result == TRANSPORT_ERROR) break;
+		if(result != TRANSPORT_MESSAGE) continue;
+
+		// The sequence number and the time it was sent
+		unsigned long sequence;
+		unsigned long long sent;
+		long count = __atomic_load_n(&received, __ATOMIC_RELAXED);
+		if(sscanf(message.data, "%lu %llu", &sequence, &sent) != 2 || sequence != (unsigned long)count) outOfOrder++;
+		else if(sent != 0 && sequence < latencies.size()) latencies[sequence] = StatsNow() - sent;
+		__atomic_store_n(&received, count + 1, __ATOMIC_RELEASE);
+	}
+	return 0;
+}
+
+bool WaitForReceiver(long count)
+{
+	uint64 started = StatsNow();
+	while(__atomic_load_n(&received, __ATOMIC_ACQUIRE) < count)
+	{
+		if(StatsNow() - started > TEST_TIMEOUT) return false;
+		SleepMsecs(0);
+	}
+	return true;
+}
+
+bool Send(int sock, unsigned long sequence, bool stamped)
+{
+	char text[64];
+	int length = snprintf(text, sizeof(text), "%lu %llu", sequence, stamped ? (unsigned long long)StatsNow() : 0ULL);
+
+	// Blocks while the socket is full
+	return send(sock, text, length, 0) == length;
+}
+
+int Connect(const char* path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if(sock != -1 && connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+	{
+		close(sock);
+		sock = -1;
+	}
+	return sock;
+}
+
+// Sends the messages through an opened transport and measures how fast they are received
+bool Measure(long messages, TransportResults* results)
+{
+	int sock = Connect(transport->Name());
+	if(!CHECK(sock != -1)) return false;
+
+	received = outOfOrder = stopping = 0;
+	latencies.assign(LATENCY_MESSAGES, 0);
+	Thread receiver;
+	if(!CHECK(receiver.Start(ReceiverThread, NULL)))
+	{
+		close(sock);
+		return false;
+	}
+
+	unsigned long sequence = 0;
+	bool delivered = true;
+	for(int i=0; i<LATENCY_MESSAGES && delivered; i++)
+		delivered = Send(sock, sequence++, true) && WaitForReceiver(sequence);
+	CHECK(delivered);
+
+	uint64 started = StatsNow();
+	for(long i=0; i<messages && delivered; i++)
+		delivered = Send(sock, sequence++, false);
+	delivered = delivered && WaitForReceiver(sequence);
+	uint64 elapsed = StatsNow() - started;
+	CHECK(delivered);
+
+	__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+	transport->Wake();
+	CHECK(receiver.Join(PLATFORM_INFINITE));
+	CHECK(outOfOrder == 0);
+	CHECK(received == (long)sequence);
+	close(sock);
+
+	std::sort(latencies.begin(), latencies.end());
+	results->rate = messages * 1000000.0 / (elapsed > 0 ? elapsed : 1);
+	results->median = latencies[latencies.size() / 2];
+	results->p99 = latencies[latencies.size() * 99 / 100];
+	return delivered;
+}
+
+void Print(const char* label, long messages, const TransportResults& results)
+{
+	printf("%s: %ld messages at %.0f messages/s, latency median %lu us, 99th percentile %lu us\n", label, messages,
+		results.rate, (unsigned long)results.median, (unsigned long)results.p99);
+}
+
+int main(int argc, char** argv)
+{
+	long messages = (argc > 1) ? atol(argv[1]) : 100000;
+	if(messages < 1) messages = 1;
+
+	// The ring is set up when the socket is opened, multishot recvmsg is only known to work once a datagram arrived
+	UringTransport uring;
+	if(!CHECK(uring.Open())) return TestResult();
+	if(!uring.IsUring())
+	{
+		printf("io_uring is not available\n");
+		return TEST_SKIPPED;
+	}
+	transport = &uring;
+	TransportResults uringResults;
+	bool measured = Measure(messages, &uringResults);
+	bool supported = uring.IsUring();
+	uring.Close();
+	if(!supported)
+	{
+		printf("multishot recvmsg is not supported by the kernel\n");
+		return TEST_SKIPPED;
+	}
+
+	SocketTransport epoll;
+	if(!CHECK(epoll.Open())) return TestResult();
+	transport = &epoll;
+	TransportResults epollResults;
+	measured = Measure(messages, &epollResults) && measured;
+	epoll.Close();
+
+	if(measured)
+	{
+		Print("io_uring", messages, uringResults);
+		Print("epoll", messages, epollResults);
+	}
+	return TestResult();
+}
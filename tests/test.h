@@ -0,0 +1,41 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Exit code ctest reports a test as skipped with, see SKIP_RETURN_CODE in tests/CMakeLists.txt
+#define TEST_SKIPPED 77
+
+/*
+ * A failed check is reported and the test carries on, so one run shows every check that failed.
+ * Return TestResult() from main.
+ */
+#define CHECK(condition) TestCheck((condition), #condition, __FILE__, __LINE__)
+
+static int testFailures = 0;
+
+inline bool TestCheck(bool passed, const char* condition, const char* file, int line)
+{
+	if(!passed)
+	{
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+		testFailures++;
+	}
+	return passed;
+}
+
+inline int TestResult()
+{
+	if(testFailures > 0) fprintf(stderr, "%d check(s) failed\n", testFailures);
+	return (testFailures > 0) ? 1 : 0;
+}
+
+#endif
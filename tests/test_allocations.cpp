@@ -0,0 +1,178 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Presses and releases push-to-talk on the loaded plugin, once through the command socket and once through
+ * the /niftykb command of the client, while every heap allocation of the process is counted. Once the
+ * plugin is warmed up a press and release cycle allocates nothing on any of the plugin threads. The lists
+ * the client hands out, such as the server list the active server is looked up in, are the client's own.
+ */
+
+#define WARMUP_CYCLES 100
+#define TEST_CYCLES 1000
+#define TEST_TIMEOUT 5000000 // Microseconds to wait for the writes of one command
+
+static volatile long counting = 0;
+static volatile long allocations = 0;
+
+static inline void CountAllocation()
+{
+	if(__atomic_load_n(&counting, __ATOMIC_RELAXED)) __sync_fetch_and_add(&allocations, 1);
+}
+
+void* operator new(size_t size)
+{
+	CountAllocation();
+	void* p = malloc(size ? size : 1);
+	if(p == NULL) throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* p) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p) throw()
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) throw()
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) throw()
+{
+	free(p);
+}
+
+// The plugin calls malloc as well, it can only be counted on glibc without a sanitizer replacing it
+#if defined(__GLIBC__) && !defined(__SANITIZE_THREAD__) && !defined(__SANITIZE_ADDRESS__)
+#define COUNT_MALLOC
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* p, size_t size);
+
+extern "C" void* malloc(size_t size)
+{
+	CountAllocation();
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+	CountAllocation();
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* p, size_t size)
+{
+	CountAllocation();
+	return __libc_realloc(p, size);
+}
+#endif
+
+static int sock = -1;
+
+void SendToSocket(const char* command)
+{
+	send(sock, command, strlen(command), 0);
+}
+
+void SendToClient(const char* command)
+{
+	ts3plugin_processCommand(StubActiveServer(), command);
+}
+
+// Runs a command and waits until the plugin wrote the input and settled
+bool Command(void (*send)(const char*), const char* command)
+{
+	size_t writes = StubInputWriteCount();
+	send(command);
+
+	uint64 started = StatsNow();
+	while(StubInputWriteCount() == writes)
+	{
+		if(StatsNow() - started > TEST_TIMEOUT) return false;
+		SleepMsecs(0);
+	}
+	PluginSettle();
+	return true;
+}
+
+// Returns the allocations the plugin made during the cycles, or -1 if a command was not run
+long CountCycles(void (*send)(const char*), int cycles, long* clientAllocations)
+{
+	long client = StubClientAllocations();
+	long before = __atomic_load_n(&allocations, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&counting, 1, __ATOMIC_SEQ_CST);
+
+	bool ran = true;
+	for(int i=0; i<cycles && ran; i++)
+		ran = Command(send, "TS3_PTT_ACTIVATE") && Command(send, "TS3_PTT_DEACTIVATE");
+
+	__atomic_store_n(&counting, 0, __ATOMIC_SEQ_CST);
+	long made = __atomic_load_n(&allocations, __ATOMIC_SEQ_CST) - before;
+	client = StubClientAllocations() - client;
+
+	if(clientAllocations != NULL) *clientAllocations = client;
+	return ran ? made - client : -1;
+}
+
+int main()
+{
+#ifndef COUNT_MALLOC
+	printf("malloc cannot be counted in this build\n");
+	return TEST_SKIPPED;
+#endif
+
+	if(!StubLoadPlugin(0)) return 1;
+	PluginSettle();
+	sock = StubConnectSender();
+	if(!CHECK(sock != -1)) return TestResult();
+
+	// Fills the pools, the stub's records and the lazily created state of every thread
+	CHECK(CountCycles(SendToSocket, WARMUP_CYCLES, NULL) >= 0);
+	CHECK(CountCycles(SendToClient, WARMUP_CYCLES, NULL) >= 0);
+
+	long socketClient, commandClient;
+	long socketAllocations = CountCycles(SendToSocket, TEST_CYCLES, &socketClient);
+	long commandAllocations = CountCycles(SendToClient, TEST_CYCLES, &commandClient);
+	CHECK(socketAllocations == 0);
+	CHECK(commandAllocations == 0);
+	CHECK(StubInputDeactivated(1) == INPUT_DEACTIVATED);
+
+	printf("%d push-to-talk cycles: %ld allocations through the socket, %ld through the client command, "
+		"the client handed out %ld and %ld lists\n", TEST_CYCLES, socketAllocations, commandAllocations, socketClient, commandClient);
+
+	close(sock);
+	StubUnloadPlugin();
+	return TestResult();
+}
@@ -0,0 +1,60 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Runs a bound command that looks up its server on the high priority lane. The server is looked up the
+ * first time the slot runs and remembered after that, also for a slot that was bound before.
+ */
+
+void Command(const char* command)
+{
+	ts3plugin_processCommand(StubActiveServer(), command);
+	PluginSettle();
+}
+
+int main()
+{
+	if(!StubLoadPlugin(0)) return 1;
+	PluginSettle();
+
+	// Rebinding the slot makes its binding a later version than the first
+	Command("TS3_BIND 1 TS3_ACTIVATE_SERVER Alpha");
+	Command("TS3_BIND 1 TS3_ACTIVATE_SERVER Bravo");
+
+	int reads = StubServerVariableReads();
+	Command("#1");
+	CHECK(StubActiveServer() == 2);
+	int lookup = StubServerVariableReads() - reads;
+	CHECK(lookup > 0);
+
+	// The second run reuses the server it found
+	Command("TS3_SERVER_PREV");
+	CHECK(StubActiveServer() == 1);
+	reads = StubServerVariableReads();
+	Command("#1");
+	CHECK(StubActiveServer() == 2);
+	CHECK(StubServerVariableReads() == reads);
+
+	// A rebound slot looks its server up again
+	Command("TS3_BIND 1 TS3_ACTIVATE_SERVER Alpha");
+	reads = StubServerVariableReads();
+	Command("#1");
+	CHECK(StubActiveServer() == 1);
+	CHECK(StubServerVariableReads() > reads);
+
+	StubUnloadPlugin();
+	return TestResult();
+}
@@ -0,0 +1,151 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+
+#include "public_definitions.h"
+#include "clientlib_publicdefinitions.h"
+#include "public_errors.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Floods the loaded plugin with TeamSpeak callbacks from several threads, whispers that fill the reply
+ * list, own client updates, connections that come and go and server errors, while commands change the
+ * same state. Every command still has to run, and the plugin has to settle and unload afterwards.
+ * Build with -DNIFTYKB_TSAN=ON to have ThreadSanitizer look for races between the two paths.
+ */
+
+#define TEST_COMMANDS 300
+#define TEST_TIMEOUT 1000000 // Microseconds a command may take under the flood
+
+static Mutex floodMutex;
+static bool flooding = true;
+static unsigned long callbacks[4];
+
+bool Flooding()
+{
+	floodMutex.Lock();
+	bool running = flooding;
+	floodMutex.Unlock();
+	return running;
+}
+
+unsigned long WhisperThread(void*)
+{
+	unsigned long n = 0;
+	while(Flooding())
+	{
+		ts3plugin_onTalkStatusChangeEvent(1, STATUS_TALKING, 1, (anyID)(2 + n % 50));
+		if(++n % 64 == 0) SleepMsecs(0);
+	}
+	callbacks[0] = n;
+	return 0;
+}
+
+unsigned long OwnClientThread(void*)
+{
+	unsigned long n = 0;
+	while(Flooding())
+	{
+		ts3plugin_onTalkStatusChangeEvent(1 + n % 2, (int)(n & 1), 0, 1);
+		ts3plugin_onUpdateClientEvent(1 + n % 2, 1, 0, "", "");
+		if(++n % 64 == 0) SleepMsecs(0);
+	}
+	callbacks[1] = n;
+	return 0;
+}
+
+// Server 2 connects and disconnects, the commands run on server 1
+unsigned long ConnectionThread(void*)
+{
+	unsigned long n = 0;
+	while(Flooding())
+	{
+		ts3plugin_onConnectStatusChangeEvent(2, STATUS_DISCONNECTED, ERROR_ok);
+		ts3plugin_onTalkStatusChangeEvent(2, STATUS_TALKING, 1, 9);
+		ts3plugin_onConnectStatusChangeEvent(2, STATUS_CONNECTION_ESTABLISHED, ERROR_ok);
+		n++;
+		SleepMsecs(0);
+	}
+	callbacks[2] = n;
+	return 0;
+}
+
+unsigned long ServerErrorThread(void*)
+{
+	unsigned long n = 0;
+	while(Flooding())
+	{
+		ts3plugin_onServerErrorEvent(1, "ok", ERROR_ok, "", "");
+		ts3plugin_onServerUpdatedEvent(1);
+		n++;
+		SleepMsecs(1);
+	}
+	callbacks[3] = n;
+	return 0;
+}
+
+// Waits for the input writes of the commands, the flood never lets the plugin settle
+bool WaitForWrites(size_t count)
+{
+	uint64 started = StatsNow();
+	while(StubInputWrites().size() < count)
+	{
+		if(StatsNow() - started > TEST_TIMEOUT) return false;
+		SleepMsecs(0);
+	}
+	return true;
+}
+
+int main()
+{
+	if(!StubLoadPlugin(0)) return 1;
+	PluginSettle();
+
+	ThreadProc procs[4] = { WhisperThread, OwnClientThread, ConnectionThread, ServerErrorThread };
+	Thread threads[4];
+	for(int i=0; i<4; i++)
+		CHECK(threads[i].Start(procs[i], NULL));
+
+	uint64 slowest = 0;
+	size_t answered = 0;
+	for(int i=0; i<TEST_COMMANDS; i++)
+	{
+		size_t writes = StubInputWrites().size();
+		uint64 sent = StatsNow();
+		ts3plugin_processCommand(1, (i % 3 == 0) ? "TS3_REPLY_TOGGLE\nTS3_PTT_TOGGLE" : "TS3_PTT_TOGGLE");
+		if(!WaitForWrites(writes + 1)) break;
+
+		answered++;
+		if(StatsNow() - sent > slowest) slowest = StatsNow() - sent;
+		if(i % 5 == 0) ts3plugin_processCommand(1, "TS3_WHISPER_CLEAR\nTS3_WHISPER_TOGGLE");
+	}
+
+	floodMutex.Lock();
+	flooding = false;
+	floodMutex.Unlock();
+	for(int i=0; i<4; i++)
+		CHECK(threads[i].Join(PLATFORM_INFINITE));
+
+	CHECK(answered == TEST_COMMANDS);
+	PluginSettle();
+	CHECK(StubInputDeactivated(1) == ((TEST_COMMANDS % 2 == 0) ? INPUT_DEACTIVATED : INPUT_ACTIVE));
+
+	printf("%lu/%d commands answered under %lu callbacks, slowest %lu us\n", (unsigned long)answered, TEST_COMMANDS,
+		callbacks[0] + callbacks[1] + 3 * callbacks[2] + 2 * callbacks[3], (unsigned long)slowest);
+
+	uint64 stopping = StatsNow();
+	StubUnloadPlugin();
+	CHECK(StatsNow() - stopping < TEST_TIMEOUT);
+	return TestResult();
+}
@@ -0,0 +1,78 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+
+#include "executor.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+
+/*
+ * Posts tasks from several threads at once, half of them as events, while the executor thread runs
+ * them. Every task has to run exactly once and the tasks of one producer in the order they were posted.
+ * Build with -DNIFTYKB_TSAN=ON to have ThreadSanitizer check the queue as well.
+ */
+
+#define TEST_PRODUCERS 4
+#define TEST_TASKS 100000 // Per producer
+
+static Executor executor;
+static unsigned int received[TEST_PRODUCERS]; // Only touched by the executor thread
+static unsigned long outOfOrder = 0;
+static unsigned long total = 0;
+
+void CountTask(const ExecutorTask& task)
+{
+	if(task.scHandlerID >= TEST_PRODUCERS || task.value != received[task.scHandlerID]) outOfOrder++;
+	else received[task.scHandlerID]++;
+	total++;
+}
+
+unsigned long ProducerThread(void* arg)
+{
+	uint64 producer = (uint64)(size_t)arg;
+	bool events = (producer % 2) != 0;
+
+	// A full queue is retried, the executor catches up
+	for(unsigned int i=0; i<TEST_TASKS; i++)
+	{
+		while(!(events ? executor.PostEvent(CountTask, producer, i) : executor.Post(CountTask, producer, i)))
+			SleepMsecs(0);
+	}
+	return 0;
+}
+
+int main()
+{
+	Thread producers[TEST_PRODUCERS];
+	for(size_t i=0; i<TEST_PRODUCERS; i++)
+		CHECK(producers[i].Start(ProducerThread, (void*)i));
+
+	// This thread is the executor, a lost wakeup shows up as a stall rather than a hang
+	uint64 started = StatsNow();
+	while(total < (unsigned long)TEST_PRODUCERS * TEST_TASKS && StatsNow() - started < 30000000)
+	{
+		executor.RunPending();
+		if(!executor.HasPending()) executor.Wait(StatsNow() + 100000);
+	}
+	uint64 elapsed = StatsNow() - started;
+
+	for(size_t i=0; i<TEST_PRODUCERS; i++)
+		CHECK(producers[i].Join(PLATFORM_INFINITE));
+	executor.RunPending();
+	executor.TakeDroppedEvents();
+
+	CHECK(outOfOrder == 0);
+	CHECK(total == (unsigned long)TEST_PRODUCERS * TEST_TASKS);
+	for(size_t i=0; i<TEST_PRODUCERS; i++)
+		CHECK(received[i] == TEST_TASKS);
+
+	printf("%lu tasks from %d threads in %lu ms\n", total, TEST_PRODUCERS, (unsigned long)(elapsed / 1000));
+	return TestResult();
+}
@@ -0,0 +1,74 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Records push-to-talk toggles and replays them against the stand-in while push-to-talk is held on the
+ * real client. The real client is released before the stand-in takes over, and nothing the replay does
+ * reaches it.
+ */
+
+#define TEST_TIMEOUT 5000000 // Microseconds to wait for the replay
+
+void Command(const char* command)
+{
+	ts3plugin_processCommand(StubActiveServer(), command);
+	PluginSettle();
+}
+
+bool WaitForPrinted(const char* prefix)
+{
+	uint64 started = StatsNow();
+	while(!StubPrinted(prefix))
+	{
+		if(StatsNow() - started > TEST_TIMEOUT) return false;
+		SleepMsecs(1);
+	}
+	return true;
+}
+
+int main()
+{
+	const char* dir = getenv("XDG_RUNTIME_DIR");
+	std::string path = std::string((dir != NULL && *dir != '\0') ? dir : ".") + "/traffic.log";
+
+	if(!StubLoadPlugin(0)) return 1;
+	PluginSettle();
+
+	Command(("record " + path).c_str());
+	CHECK(StubPrinted("NiftyKb recording started"));
+	Command("TS3_PTT_TOGGLE");
+	Command("TS3_PTT_TOGGLE");
+	Command("TS3_PTT_TOGGLE");
+	Command("record stop");
+	CHECK(StubPrinted("NiftyKb recording stopped"));
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+
+	// Still held when the replay starts, it is released once and the toggles only reach the stand-in.
+	// The replay drives the plugin until it is done, only one thread may settle it at a time.
+	size_t writes = StubInputWriteCount();
+	ts3plugin_processCommand(StubActiveServer(), ("replay " + path + " virtual").c_str());
+	CHECK(WaitForPrinted("NiftyKb replayed"));
+	PluginSettle();
+	CHECK(StubInputDeactivated(1) == INPUT_DEACTIVATED);
+	CHECK(StubInputWriteCount() == writes + 1);
+
+	StubUnloadPlugin();
+	return TestResult();
+}
@@ -0,0 +1,142 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+
+#include "public_definitions.h"
+#include "public_rare_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "clock.h"
+#include "platform.h"
+#include "stats.h"
+#include "timer_wheel.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Runs delayed, named and repeating commands of the loaded plugin on a virtual clock: every command runs
+ * at exactly the time it was due, commands due together share one update to the server, a repeat stops
+ * when it is cancelled and a named command is replaced by the next one with its name. On the system clock
+ * ten commands due in the same tick wake the executor once.
+ */
+
+#define MSECS 1000
+#define SETTLE_MSECS 10 // Time for the executor to go back to sleep
+
+static VirtualClock virtualClock(1000 * MSECS);
+
+void Command(const char* command)
+{
+	ts3plugin_processCommand(StubActiveServer(), command);
+	PluginSettle();
+}
+
+bool LastWrite(uint64 server, int value, uint64 time)
+{
+	std::vector<StubInputWrite> writes = StubInputWrites();
+	if(writes.empty()) return false;
+
+	const StubInputWrite& last = writes.back();
+	return last.server == server && last.value == value && last.time == time;
+}
+
+int main()
+{
+	if(!StubLoadPlugin(0)) return 1;
+	StubSetClock(&virtualClock);
+	PluginUseClock(&virtualClock);
+	PluginSettle();
+
+	// A delayed command runs once, when it is due
+	uint64 start = virtualClock.Now();
+	Command("TS3_DELAY 250 TS3_PTT_ACTIVATE");
+	CHECK(StubInputWrites().empty());
+	PluginAdvance(&virtualClock, start + 249 * MSECS);
+	CHECK(StubInputWrites().empty());
+	PluginAdvance(&virtualClock, start + 1000 * MSECS);
+	CHECK(StubInputWrites().size() == 1);
+	CHECK(LastWrite(1, INPUT_ACTIVE, start + 250 * MSECS));
+
+	// Commands due in the same tick run in one batch with a single flush
+	start = virtualClock.Now();
+	int flushes = StubFlushes(1);
+	Command("TS3_DELAY 100 TS3_PTT_DEACTIVATE\nTS3_DELAY 100 TS3_INPUT_MUTE\nTS3_DELAY 100 TS3_OUTPUT_MUTE");
+	PluginAdvance(&virtualClock, start + 200 * MSECS);
+	CHECK(LastWrite(1, INPUT_DEACTIVATED, start + 100 * MSECS));
+	CHECK(StubSelfVariable(1, CLIENT_INPUT_MUTED) == MUTEINPUT_MUTED);
+	CHECK(StubSelfVariable(1, CLIENT_OUTPUT_MUTED) == MUTEOUTPUT_MUTED);
+	CHECK(StubFlushes(1) == flushes + 1);
+
+	// Ten volume steps due together all run
+	start = virtualClock.Now();
+	Command("TS3_DELAY 100 TS3_VOLUME_UP 0.5\nTS3_DELAY 100 TS3_VOLUME_UP 0.5\nTS3_DELAY 100 TS3_VOLUME_UP 0.5\n"
+		"TS3_DELAY 100 TS3_VOLUME_UP 0.5\nTS3_DELAY 100 TS3_VOLUME_UP 0.5\nTS3_DELAY 100 TS3_VOLUME_UP 0.5\n"
+		"TS3_DELAY 100 TS3_VOLUME_UP 0.5\nTS3_DELAY 100 TS3_VOLUME_UP 0.5\nTS3_DELAY 100 TS3_VOLUME_UP 0.5\n"
+		"TS3_DELAY 100 TS3_VOLUME_UP 0.5");
+	PluginAdvance(&virtualClock, start + 200 * MSECS);
+	CHECK(StubVolume() == 5.0f);
+	std::vector<StubVolumeWrite> volumes = StubVolumeWrites();
+	CHECK(!volumes.empty());
+	for(size_t i=0; i<volumes.size(); i++)
+		CHECK(volumes[i].time == start + 100 * MSECS);
+
+	// A repeat runs every interval, starting one interval from now, until it is cancelled
+	start = virtualClock.Now();
+	size_t steps = StubVolumeWrites().size();
+	Command("TS3_REPEAT volume 50 TS3_VOLUME_DOWN");
+	PluginAdvance(&virtualClock, start + 520 * MSECS);
+	Command("TS3_CANCEL volume");
+	PluginAdvance(&virtualClock, start + 1000 * MSECS);
+	volumes = StubVolumeWrites();
+	CHECK(volumes.size() == steps + 10);
+	for(size_t i=steps; i<volumes.size(); i++)
+		CHECK(volumes[i].time == start + (i - steps + 1) * 50 * MSECS);
+	CHECK(StubVolume() == -5.0f);
+
+	// A named command is cancelled before it is due
+	start = virtualClock.Now();
+	size_t writes = StubInputWrites().size();
+	Command("TS3_SCHEDULE press 100 TS3_PTT_TOGGLE");
+	PluginAdvance(&virtualClock, start + 20 * MSECS);
+	Command("TS3_CANCEL press");
+	PluginAdvance(&virtualClock, start + 1000 * MSECS);
+	CHECK(StubInputWrites().size() == writes);
+
+	// and replaced by the next command with its name
+	start = virtualClock.Now();
+	Command("TS3_SCHEDULE press 100 TS3_PTT_TOGGLE");
+	PluginAdvance(&virtualClock, start + 20 * MSECS);
+	Command("TS3_SCHEDULE press 150 TS3_PTT_TOGGLE");
+	PluginAdvance(&virtualClock, start + 1000 * MSECS);
+	CHECK(StubInputWrites().size() == writes + 1);
+	CHECK(LastWrite(1, INPUT_ACTIVE, start + 170 * MSECS));
+
+	// Nothing is left behind
+	CHECK(PluginSettle() == 0);
+
+	PluginUseClock(NULL);
+	StubSetClock(NULL);
+
+	// Schedule the ten lines right after a tick starts, so they all fall into the same tick
+	float volume = StubVolume();
+	while(StatsNow() % TIMER_WHEEL_TICK > TIMER_WHEEL_TICK / 10)
+		;
+	Command("TS3_DELAY 50 TS3_VOLUME_UP 0.5\nTS3_DELAY 50 TS3_VOLUME_UP 0.5\nTS3_DELAY 50 TS3_VOLUME_UP 0.5\n"
+		"TS3_DELAY 50 TS3_VOLUME_UP 0.5\nTS3_DELAY 50 TS3_VOLUME_UP 0.5\nTS3_DELAY 50 TS3_VOLUME_UP 0.5\n"
+		"TS3_DELAY 50 TS3_VOLUME_UP 0.5\nTS3_DELAY 50 TS3_VOLUME_UP 0.5\nTS3_DELAY 50 TS3_VOLUME_UP 0.5\n"
+		"TS3_DELAY 50 TS3_VOLUME_UP 0.5");
+	SleepMsecs(SETTLE_MSECS);
+	unsigned long wakeups = PluginWakeups();
+	SleepMsecs(100);
+	CHECK(PluginWakeups() == wakeups + 1);
+	CHECK(StubVolume() == volume + 5.0f);
+
+	StubUnloadPlugin();
+	return TestResult();
+}
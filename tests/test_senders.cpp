@@ -0,0 +1,93 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sender.h"
+#include "test.h"
+
+/*
+ * Names senders by the process that sent the message and the name it gave itself. A process that makes up
+ * a new name for every message only gets SENDER_NAMES_PER_PEER limits of its own, then shares the limit of
+ * the process, and it never uses up the limit of another process.
+ */
+
+#define TEST_NAMES 10
+
+static Message messages[MESSAGE_POOL_SIZE];
+static size_t used = 0;
+
+Message* MakeMessage(unsigned int peer, const char* text)
+{
+	Message* message = &messages[used++ % MESSAGE_POOL_SIZE];
+	strcpy(message->data, text);
+	message->length = strlen(text);
+	message->received = 0;
+	message->peer = peer;
+	IdentifySender(message);
+	return message;
+}
+
+bool HasSender(SenderStats* stats, size_t count, const char* name)
+{
+	for(size_t i=0; i<count; i++)
+		if(!strcmp(stats[i].name, name)) return true;
+	return false;
+}
+
+int main()
+{
+	// The name is added to the process, the rest of the line is left to the parser
+	Message* message = MakeMessage(42, "$macros TS3_PTT_TOGGLE");
+	CHECK(!strcmp(message->sender, "pid 42/$macros"));
+	CHECK(!strncmp(message->data + strspn(message->data, " "), "TS3_PTT_TOGGLE", 14));
+	CHECK(!strcmp(MakeMessage(42, "TS3_PTT_TOGGLE")->sender, "pid 42"));
+	CHECK(!strcmp(MakeMessage(0, "$macros TS3_PTT_TOGGLE")->sender, "anonymous/$macros"));
+	CHECK(!strcmp(MakeMessage(0, "TS3_PTT_TOGGLE")->sender, "anonymous"));
+
+	// One message per second without a burst
+	SenderTable senders;
+	senders.SetLimit(1.0, 1.0);
+	uint64 now = 1000000;
+
+	// Every message of the first process has a name of its own
+	size_t admitted = 0;
+	for(int i=0; i<TEST_NAMES; i++)
+	{
+		char text[32];
+		sprintf(text, "$name%d TS3_PTT_TOGGLE", i);
+		message = MakeMessage(42, text);
+		if(senders.Admit(message, message->sender, now)) admitted++;
+	}
+
+	// The named limits and the limit of the process, the last one holding its backlog
+	CHECK(admitted == SENDER_NAMES_PER_PEER + 1 + SENDER_BACKLOG);
+
+	SenderStats stats[SENDER_SLOTS];
+	size_t count = senders.Snapshot(stats, SENDER_SLOTS);
+	CHECK(count == SENDER_NAMES_PER_PEER + 1);
+	CHECK(HasSender(stats, count, "pid 42/$name0"));
+	CHECK(!HasSender(stats, count, "pid 42/$name9"));
+	CHECK(HasSender(stats, count, "pid 42"));
+
+	// Another process still gets its own limit
+	message = MakeMessage(43, "$name9 TS3_PTT_TOGGLE");
+	CHECK(senders.Admit(message, message->sender, now));
+
+	Message* batch[SENDER_SLOTS];
+	CHECK(senders.Schedule(batch, SENDER_SLOTS, now) == SENDER_NAMES_PER_PEER + 2);
+	CHECK(!senders.IsEmpty());
+	CHECK(senders.NextRelease(now) > now);
+
+	while(senders.Discard() != NULL);
+	CHECK(senders.IsEmpty());
+
+	return TestResult();
+}
@@ -0,0 +1,95 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Keeps push-to-talk apart on two server connections of the loaded plugin. A press reads the baseline once
+ * and a release reads nothing, so an input setting the user changed in the client is followed. Switching
+ * servers while push-to-talk is held releases it on the server that is left before it is pressed on the
+ * next one.
+ */
+
+#define PTT_PRESSES 100
+#define PRESS_READS 2 // The voice activation and the input setting
+
+void Command(const char* command)
+{
+	ts3plugin_processCommand(StubActiveServer(), command);
+	PluginSettle();
+}
+
+bool Write(const StubInputWrite& write, uint64 server, int value)
+{
+	return write.server == server && write.value == value;
+}
+
+int main()
+{
+	if(!StubLoadPlugin(0)) return 1;
+	PluginSettle();
+
+	// Every press and release writes the input, only the press reads the baseline
+	int reads = StubBaselineReads();
+	for(int i=0; i<PTT_PRESSES; i++)
+	{
+		Command("TS3_PTT_ACTIVATE");
+		Command("TS3_PTT_DEACTIVATE");
+	}
+	CHECK(StubBaselineReads() == reads + PRESS_READS * PTT_PRESSES);
+	CHECK(StubInputWrites().size() == 2 * PTT_PRESSES);
+	CHECK(StubInputDeactivated(1) == INPUT_DEACTIVATED);
+
+	// The user turns on continuous transmission in the client, a release leaves it on
+	size_t before = StubInputWrites().size();
+	StubSetSelfVariable(1, CLIENT_INPUT_DEACTIVATED, INPUT_ACTIVE);
+	Command("TS3_PTT_ACTIVATE");
+	Command("TS3_PTT_DEACTIVATE");
+	CHECK(StubInputWrites().size() == before);
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+
+	// and off again, the next press still activates the input
+	StubSetSelfVariable(1, CLIENT_INPUT_DEACTIVATED, INPUT_DEACTIVATED);
+	Command("TS3_PTT_ACTIVATE");
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+	Command("TS3_PTT_DEACTIVATE");
+	CHECK(StubInputDeactivated(1) == INPUT_DEACTIVATED);
+
+	// Held on server 1, switch to server 2 and press there
+	size_t first = StubInputWrites().size();
+	Command("TS3_PTT_ACTIVATE");
+	Command("TS3_SERVER_NEXT");
+	CHECK(StubActiveServer() == 2);
+	Command("TS3_PTT_ACTIVATE");
+
+	std::vector<StubInputWrite> writes = StubInputWrites();
+	if(CHECK(writes.size() == first + 3))
+	{
+		CHECK(Write(writes[first], 1, INPUT_ACTIVE));
+		CHECK(Write(writes[first + 1], 1, INPUT_DEACTIVATED));
+		CHECK(Write(writes[first + 2], 2, INPUT_ACTIVE));
+	}
+
+	// Server 1 was released, so a toggle there presses again rather than releasing
+	Command("TS3_SERVER_PREV");
+	CHECK(StubActiveServer() == 1);
+	CHECK(StubInputDeactivated(2) == INPUT_DEACTIVATED);
+	Command("TS3_PTT_TOGGLE");
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+	Command("TS3_PTT_TOGGLE");
+	CHECK(StubInputDeactivated(1) == INPUT_DEACTIVATED);
+
+	StubUnloadPlugin();
+	return TestResult();
+}
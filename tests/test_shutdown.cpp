@@ -0,0 +1,138 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <dirent.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "platform.h"
+#include "stats.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Loads and unloads the plugin over and over, the way the client reloads it, and measures how long the
+ * unload takes. Every other time the plugin is idle, with its threads blocked, otherwise it still has
+ * messages arriving, a delayed command and a repeating command pending. Every thread is woken and joined
+ * at once, none of them is left running and nothing that was pending runs after the unload. A command socket
+ * that cannot be bound is reported once a server connects, the plugin keeps running on the ring.
+ * Pass the number of reloads, 20 by default.
+ */
+
+#define SHUTDOWN_LIMIT 50000 // Microseconds an unload may take, far below the timeout of a stuck thread
+#define SETTLE_MSECS 50      // Time for anything pending to run after the unload
+
+// Counts the threads of the process, a sanitizer may start one of its own along with the first plugin thread
+int ThreadCount()
+{
+	DIR* dir = opendir("/proc/self/task");
+	if(dir == NULL) return -1;
+
+	int count = 0;
+	struct dirent* entry;
+	while((entry = readdir(dir)) != NULL)
+		if(entry->d_name[0] != '.') count++;
+	closedir(dir);
+	return count;
+}
+
+// Gives the plugin work that is still pending when it is unloaded
+bool MakeBusy()
+{
+	int sock = StubConnectSender();
+	if(sock == -1) return false;
+
+	const char* commands[] =
+	{
+		"TS3_REPEAT nudge 10 TS3_VOLUME_UP 0.1",
+		"TS3_DELAY 20 TS3_PTT_ACTIVATE",
+		"TS3_PTT_TOGGLE",
+		"TS3_PTT_TOGGLE"
+	};
+	bool sent = true;
+	for(size_t i=0; i<sizeof(commands)/sizeof(commands[0]); i++)
+		sent = send(sock, commands[i], strlen(commands[i]), 0) == (ssize_t)strlen(commands[i]) && sent;
+
+	// Wait for the timers to be armed, the toggles may still be on their way
+	SleepMsecs(1);
+	PluginSettle();
+	for(int i=0; i<4; i++)
+		sent = send(sock, commands[2], strlen(commands[2]), 0) == (ssize_t)strlen(commands[2]) && sent;
+	close(sock);
+	return sent;
+}
+
+int main(int argc, char** argv)
+{
+	int reloads = (argc > 1) ? atoi(argv[1]) : 20;
+	if(reloads < 2) reloads = 2;
+
+	int threads = ThreadCount();
+	if(threads == -1) return TEST_SKIPPED;
+	int unloaded = -1; // Threads left after the first unload
+
+	std::vector<uint64> idle, busy;
+	for(int i=0; i<reloads; i++)
+	{
+		if(!CHECK(StubLoadPlugin(0))) break;
+		PluginSettle();
+		CHECK(ThreadCount() > threads);
+
+		bool pending = (i % 2 == 1);
+		if(pending) CHECK(MakeBusy());
+
+		uint64 started = StatsNow();
+		StubUnloadPlugin();
+		uint64 elapsed = StatsNow() - started;
+		CHECK(elapsed < SHUTDOWN_LIMIT);
+		(pending ? busy : idle).push_back(elapsed);
+
+		// Nothing is left running, the threads of the plugin do not pile up from reload to reload
+		if(unloaded == -1) unloaded = ThreadCount();
+		CHECK(ThreadCount() == unloaded);
+		size_t writes = StubInputWriteCount();
+		SleepMsecs(SETTLE_MSECS);
+		CHECK(StubInputWriteCount() == writes);
+	}
+
+	// A directory in the way of the command socket
+	const char* dir = getenv("XDG_RUNTIME_DIR");
+	std::string socketPath = std::string((dir != NULL && *dir != '\0') ? dir : ".") + "/niftykb.sock";
+	if(CHECK(mkdir(socketPath.c_str(), 0700) == 0))
+	{
+		if(CHECK(StubLoadPlugin(0)))
+		{
+			PluginSettle();
+			CHECK(StubPrinted("[color=red]Could not create command endpoint."));
+			StubUnloadPlugin();
+			CHECK(ThreadCount() == unloaded);
+		}
+		rmdir(socketPath.c_str());
+	}
+
+	if(testFailures == 0)
+	{
+		std::sort(idle.begin(), idle.end());
+		std::sort(busy.begin(), busy.end());
+		printf("%d reloads: unload median %lu us idle, %lu us with work pending, slowest %lu us\n", reloads,
+			(unsigned long)idle[idle.size() / 2], (unsigned long)busy[busy.size() / 2],
+			(unsigned long)std::max(idle.back(), busy.back()));
+	}
+	return TestResult();
+}
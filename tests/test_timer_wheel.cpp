@@ -0,0 +1,157 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+#include <vector>
+
+#include "timer_wheel.h"
+#include "test.h"
+
+/*
+ * Runs the wheel against a brute force list of expiry times on a virtual clock. Timers are armed with
+ * delays from nothing to many hours, moved, cancelled, armed again from the procedures of other timers
+ * and carried over to other clocks. No timer may fire early, be missed by an advance past its expiry or
+ * fire late when the clock jumps to the expiry the wheel reports.
+ */
+
+#define TEST_TIMERS 2000
+#define TEST_ROUNDS 100000
+
+typedef struct
+{
+	WheelTimer* timer;
+	bool armed;
+	uint64 expires;
+} Expected;
+
+static TimerWheel wheel;
+static std::vector<Expected> expected(TEST_TIMERS);
+static size_t armed = 0;
+static uint64 now = 123456789012ULL;
+static uint64 latest = 0; // Most a timer fired after its expiry
+
+static unsigned int seed = 1;
+
+unsigned int Random()
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+void Arm(Expected* entry, uint64 delay)
+{
+	wheel.Start(entry->timer, now, delay);
+	if(!entry->armed) armed++;
+	entry->armed = true;
+	entry->expires = now + delay;
+}
+
+void Disarm(Expected* entry)
+{
+	wheel.Cancel(entry->timer);
+	if(entry->armed) armed--;
+	entry->armed = false;
+}
+
+void Fire(WheelTimer* timer)
+{
+	Expected* entry = (Expected*)timer->data;
+	CHECK(entry->armed);
+	CHECK(now >= entry->expires);
+	if(now - entry->expires > latest) latest = now - entry->expires;
+	entry->armed = false;
+	armed--;
+
+	// A procedure arms other timers
+	if(Random() % 4 == 0) Arm(&expected[Random() % TEST_TIMERS], 1 + Random() % 100000);
+}
+
+uint64 EarliestExpiry()
+{
+	uint64 earliest = 0;
+	for(size_t i=0; i<TEST_TIMERS; i++)
+		if(expected[i].armed && (earliest == 0 || expected[i].expires < earliest)) earliest = expected[i].expires;
+	return earliest;
+}
+
+bool Missed()
+{
+	for(size_t i=0; i<TEST_TIMERS; i++)
+		if(expected[i].armed && expected[i].expires <= now) return true;
+	return false;
+}
+
+void Advance(uint64 time)
+{
+	now = time;
+	wheel.Advance(now);
+	CHECK(!Missed());
+	CHECK(wheel.Count() == armed);
+}
+
+int main()
+{
+	std::vector<WheelTimer> timers(TEST_TIMERS);
+	for(size_t i=0; i<TEST_TIMERS; i++)
+	{
+		timers[i].proc = Fire;
+		timers[i].data = &expected[i];
+		expected[i].timer = &timers[i];
+		expected[i].armed = false;
+		expected[i].expires = 0;
+	}
+
+	for(int round=0; round<TEST_ROUNDS && testFailures == 0; round++)
+	{
+		Expected* entry = &expected[Random() % TEST_TIMERS];
+		unsigned int op = Random() % 20;
+		if(op < 8)
+		{
+			// Delays up to eight hours, most of them short
+			uint64 delay = (Random() % 3 == 0) ? ((uint64)Random() * 7919) % 30000000000ULL : Random() % 2000000;
+			Arm(entry, delay);
+		}
+		else if(op < 12) Disarm(entry);
+		else if(op < 19)
+		{
+			// The next expiry is never later than the earliest timer
+			uint64 next = wheel.NextExpiry();
+			uint64 earliest = EarliestExpiry();
+			CHECK((next == 0) == (earliest == 0));
+			CHECK(next <= earliest);
+
+			// Jump to the reported expiry or step the clock
+			if(next > now && Random() % 2 == 0) Advance(next);
+			else Advance(now + Random() % 5000);
+		}
+		else
+		{
+			// Carry the timers over to a clock that may be behind, the time they have left stays
+			uint64 base = (uint64)(Random() % 1000000) * 1000;
+			for(size_t i=0; i<TEST_TIMERS; i++)
+				if(expected[i].armed) expected[i].expires = base + expected[i].expires - now;
+			now = base;
+			wheel.Rebase(now);
+			CHECK(wheel.Count() == armed);
+		}
+	}
+
+	// Run everything out jumping from one reported expiry to the next, every timer fires right on time
+	latest = 0;
+	while(wheel.Count() > 0 && testFailures == 0)
+	{
+		uint64 next = wheel.NextExpiry();
+		Advance((next > now) ? next : now);
+	}
+	CHECK(latest == 0);
+	CHECK(armed == 0);
+
+	return TestResult();
+}
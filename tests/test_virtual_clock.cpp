@@ -0,0 +1,91 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <stddef.h>
+
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "plugin.h"
+#include "clock.h"
+#include "test.h"
+#include "ts3_stub.h"
+
+/*
+ * Drives the timer wheel, the scheduler and the executor of the loaded plugin with a virtual clock through
+ * a push-to-talk release delay, a press that cancels it and a server switch while it is pending. Every
+ * input write is stamped with the virtual time, so the test checks exactly when it happened.
+ */
+
+#define PTT_DELAY_MSECS 300
+#define MSECS 1000
+
+static VirtualClock clock(1000 * MSECS);
+
+void Command(const char* command)
+{
+	ts3plugin_processCommand(StubActiveServer(), command);
+	PluginSettle();
+}
+
+bool LastWrite(uint64 server, int value, uint64 time)
+{
+	std::vector<StubInputWrite> writes = StubInputWrites();
+	if(writes.empty()) return false;
+
+	const StubInputWrite& last = writes.back();
+	return last.server == server && last.value == value && last.time == time;
+}
+
+int main()
+{
+	if(!StubLoadPlugin(PTT_DELAY_MSECS)) return 1;
+	StubSetClock(&clock);
+	PluginUseClock(&clock);
+	PluginSettle();
+
+	// The release is held back for the delay and happens exactly when it ran out
+	uint64 start = clock.Now();
+	Command("TS3_PTT_ACTIVATE");
+	CHECK(LastWrite(1, INPUT_ACTIVE, start));
+	Command("TS3_PTT_DEACTIVATE");
+	uint64 next = PluginSettle();
+	CHECK(next > start && next <= start + PTT_DELAY_MSECS * MSECS);
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+	PluginAdvance(&clock, start + 2 * PTT_DELAY_MSECS * MSECS);
+	CHECK(LastWrite(1, INPUT_DEACTIVATED, start + PTT_DELAY_MSECS * MSECS));
+
+	// Pressing again before the delay ran out cancels the release
+	start = clock.Now();
+	Command("TS3_PTT_ACTIVATE");
+	Command("TS3_PTT_DEACTIVATE");
+	PluginAdvance(&clock, start + 200 * MSECS);
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+	size_t writes = StubInputWrites().size();
+	Command("TS3_PTT_ACTIVATE");
+	PluginAdvance(&clock, start + 3 * PTT_DELAY_MSECS * MSECS);
+	CHECK(StubInputWrites().size() == writes);
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+
+	// Switching servers while the release is pending releases right away, the timer no longer fires
+	start = clock.Now();
+	Command("TS3_PTT_DEACTIVATE");
+	PluginAdvance(&clock, start + 100 * MSECS);
+	CHECK(StubInputDeactivated(1) == INPUT_ACTIVE);
+	Command("TS3_ACTIVATE_SERVER Bravo");
+	CHECK(StubActiveServer() == 2);
+	CHECK(LastWrite(1, INPUT_DEACTIVATED, start + 100 * MSECS));
+	writes = StubInputWrites().size();
+	PluginAdvance(&clock, start + 3 * PTT_DELAY_MSECS * MSECS);
+	CHECK(StubInputWrites().size() == writes);
+	CHECK(StubInputDeactivated(2) == INPUT_DEACTIVATED);
+
+	PluginUseClock(NULL);
+	StubSetClock(NULL);
+	StubUnloadPlugin();
+	return TestResult();
+}
@@ -0,0 +1,547 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+#include <map>
+
+#include "public_errors.h"
+#include "public_definitions.h"
+#include "plugin_definitions.h"
+#include "ts3_functions.h"
+#include "plugin.h"
+#include "clock.h"
+#include "platform.h"
+#include "sqlite3.h"
+#include "ts3_stub.h"
+
+#define STUB_PROFILE "Default"
+#define STUB_RESERVED_WRITES 65536 // Recording a write does not allocate until this many were made
+
+static Mutex stubLock;
+static Clock* stubClock = NULL;
+static uint64 activeServer = 1;
+static std::map<size_t, int> selfVariables[STUB_SERVERS+1];
+static std::vector<StubInputWrite> inputWrites;
+static int flushes[STUB_SERVERS+1];
+static int baselineReads = 0;
+static int serverVariableReads = 0;
+static float volume = 0.0f;
+static std::vector<StubVolumeWrite> volumeWrites;
+static std::vector<std::string> printedMessages;
+static long clientAllocations = 0;
+
+static const char* serverNames[STUB_SERVERS+1] = { "", "Alpha", "Bravo" };
+
+/*********************************** Settings ************************************/
+
+std::string StubDirectory()
+{
+	const char* dir = getenv("XDG_RUNTIME_DIR");
+	std::string path = (dir != NULL && *dir != '\0') ? dir : ".";
+	path.append("/");
+	return path;
+}
+
+// The plugin reads the push-to-talk delay from the capture profile in the client's settings
+bool WriteSettings(int pttDelayMsecs)
+{
+	std::string path = StubDirectory() + "settings.db";
+	remove(path.c_str());
+
+	sqlite3* db;
+	if(sqlite3_open(path.c_str(), &db) != SQLITE_OK)
+	{
+		sqlite3_close(db);
+		return false;
+	}
+
+	char sql[512];
+	snprintf(sql, sizeof(sql),
+		"CREATE TABLE Profiles(key TEXT, value TEXT);"
+		"CREATE TABLE Plugins(key TEXT, value TEXT);"
+		"CREATE TABLE Application(key TEXT, value TEXT);"
+		"CREATE TABLE Notifications(key TEXT, value TEXT);"
+		"INSERT INTO Profiles VALUES('Capture/" STUB_PROFILE "/PreProcessing', 'delay_ptt=%s\ndelay_ptt_msecs=%d\n');",
+		(pttDelayMsecs > 0) ? "true" : "false", pttDelayMsecs);
+	bool result = sqlite3_exec(db, sql, NULL, NULL, NULL) == SQLITE_OK;
+	sqlite3_close(db);
+	return result;
+}
+
+/*********************************** Client functions ************************************/
+
+bool IsStubServer(uint64 scHandlerID)
+{
+	return scHandlerID >= 1 && scHandlerID <= STUB_SERVERS;
+}
+
+unsigned int StubFail()
+{
+	return ERROR_not_implemented;
+}
+
+unsigned int StubLogMessage(const char* logMessage, enum LogLevel severity, const char*, uint64)
+{
+	if(severity <= LogLevel_WARNING) fprintf(stderr, "plugin: %s\n", logMessage);
+	return ERROR_ok;
+}
+
+void StubPrintMessageToCurrentTab(const char* message)
+{
+	fprintf(stderr, "plugin: %s\n", message);
+	stubLock.Lock();
+	printedMessages.push_back(message);
+	stubLock.Unlock();
+}
+
+void StubGetPath(char* path, size_t maxLen)
+{
+	snprintf(path, maxLen, "%s", StubDirectory().c_str());
+}
+
+// Memory the client hands to the plugin, the plugin releases it with freeMemory
+void* ClientAllocate(size_t size)
+{
+	stubLock.Lock();
+	clientAllocations++;
+	stubLock.Unlock();
+	return malloc(size);
+}
+
+char* ClientString(const char* value)
+{
+	char* result = (char*)ClientAllocate(strlen(value) + 1);
+	strcpy(result, value);
+	return result;
+}
+
+unsigned int StubGetErrorMessage(unsigned int, char** error)
+{
+	*error = ClientString("stub error");
+	return ERROR_ok;
+}
+
+unsigned int StubFreeMemory(void* pointer)
+{
+	free(pointer);
+	return ERROR_ok;
+}
+
+uint64 StubTime()
+{
+	return (stubClock != NULL) ? stubClock->Now() : 0;
+}
+
+// The plugin reads the push-to-talk baseline of a server from these
+void CountBaselineRead()
+{
+	stubLock.Lock();
+	baselineReads++;
+	stubLock.Unlock();
+}
+
+uint64 StubGetCurrentServerConnectionHandlerID()
+{
+	return StubActiveServer();
+}
+
+unsigned int StubGetServerConnectionHandlerList(uint64** result)
+{
+	*result = (uint64*)ClientAllocate((STUB_SERVERS+1) * sizeof(uint64));
+	for(uint64 i=0; i<STUB_SERVERS; i++)
+		(*result)[i] = i+1;
+	(*result)[STUB_SERVERS] = 0;
+	return ERROR_ok;
+}
+
+unsigned int StubGetConnectionStatus(uint64 scHandlerID, int* result)
+{
+	*result = IsStubServer(scHandlerID) ? STATUS_CONNECTION_ESTABLISHED : STATUS_DISCONNECTED;
+	return ERROR_ok;
+}
+
+unsigned int StubGetServerVariableAsString(uint64 scHandlerID, size_t flag, char** result)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+	stubLock.Lock();
+	serverVariableReads++;
+	stubLock.Unlock();
+	*result = ClientString((flag == VIRTUALSERVER_NAME) ? serverNames[scHandlerID] : "");
+	return ERROR_ok;
+}
+
+unsigned int StubActivateCaptureDevice(uint64 scHandlerID)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+	stubLock.Lock();
+	activeServer = scHandlerID;
+	stubLock.Unlock();
+	return ERROR_ok;
+}
+
+unsigned int StubGetClientID(uint64, anyID* result)
+{
+	*result = 1;
+	return ERROR_ok;
+}
+
+unsigned int StubGetClientSelfVariableAsInt(uint64 scHandlerID, size_t flag, int* result)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+	if(flag == CLIENT_INPUT_DEACTIVATED) CountBaselineRead();
+	if(flag == CLIENT_INPUT_HARDWARE) *result = (StubActiveServer() == scHandlerID) ? 1 : 0;
+	else *result = StubSelfVariable(scHandlerID, flag);
+	return ERROR_ok;
+}
+
+unsigned int StubGetClientSelfVariableAsString(uint64 scHandlerID, size_t, char** result)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+	*result = ClientString("");
+	return ERROR_ok;
+}
+
+unsigned int StubSetClientSelfVariableAsInt(uint64 scHandlerID, size_t flag, int value)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+
+	stubLock.Lock();
+	selfVariables[scHandlerID][flag] = value;
+	if(flag == CLIENT_INPUT_DEACTIVATED)
+	{
+		StubInputWrite write;
+		write.server = scHandlerID;
+		write.value = value;
+		write.time = StubTime();
+		inputWrites.push_back(write);
+	}
+	stubLock.Unlock();
+	return ERROR_ok;
+}
+
+unsigned int StubFlushClientSelfUpdates(uint64 scHandlerID, const char*)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+	stubLock.Lock();
+	flushes[scHandlerID]++;
+	stubLock.Unlock();
+	return ERROR_ok;
+}
+
+unsigned int StubGetPreProcessorConfigValue(uint64, const char* ident, char** result)
+{
+	if(!strcmp(ident, "vad")) CountBaselineRead();
+	*result = ClientString("false");
+	return ERROR_ok;
+}
+
+unsigned int StubSetPreProcessorConfigValue(uint64, const char*, const char*)
+{
+	return ERROR_ok;
+}
+
+unsigned int StubGetPlaybackConfigValueAsFloat(uint64 scHandlerID, const char*, float* result)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+	*result = StubVolume();
+	return ERROR_ok;
+}
+
+// Only the master volume is kept, it is the same on every server
+unsigned int StubSetPlaybackConfigValue(uint64 scHandlerID, const char* ident, const char* value)
+{
+	if(!IsStubServer(scHandlerID)) return ERROR_server_invalid_id;
+	if(strcmp(ident, "volume_modifier")) return ERROR_ok;
+
+	StubVolumeWrite write;
+	write.value = (float)atof(value);
+
+	stubLock.Lock();
+	write.time = StubTime();
+	volume = write.value;
+	volumeWrites.push_back(write);
+	stubLock.Unlock();
+	return ERROR_ok;
+}
+
+unsigned int StubRequestClientSetWhisperList(uint64 scHandlerID, anyID, const uint64*, const anyID*, const char*)
+{
+	return IsStubServer(scHandlerID) ? ERROR_ok : ERROR_server_invalid_id;
+}
+
+// The plugin releases the list with a single freeMemory, so the names go into the same block
+unsigned int StubGetProfileList(enum PluginGuiProfile, int* defaultProfileIdx, char*** result)
+{
+	char** list = (char**)ClientAllocate(2 * sizeof(char*) + sizeof(STUB_PROFILE));
+	char* name = (char*)(list + 2);
+	memcpy(name, STUB_PROFILE, sizeof(STUB_PROFILE));
+	list[0] = name;
+	list[1] = NULL;
+
+	*defaultProfileIdx = 0;
+	*result = list;
+	return ERROR_ok;
+}
+
+/*********************************** Stub ************************************/
+
+bool StubLoadPlugin(int pttDelayMsecs)
+{
+	if(!WriteSettings(pttDelayMsecs))
+	{
+		fprintf(stderr, "Failed to write the settings database\n");
+		return false;
+	}
+
+	for(int i=0; i<=STUB_SERVERS; i++)
+	{
+		selfVariables[i].clear();
+		selfVariables[i][CLIENT_INPUT_DEACTIVATED] = INPUT_DEACTIVATED;
+		flushes[i] = 0;
+	}
+	baselineReads = 0;
+	serverVariableReads = 0;
+	activeServer = 1;
+	volume = 0.0f;
+	inputWrites.clear();
+	inputWrites.reserve(STUB_RESERVED_WRITES);
+	volumeWrites.clear();
+	printedMessages.clear();
+
+	// Everything the stub does not implement fails
+	struct TS3Functions funcs;
+	void** entries = (void**)&funcs;
+	for(size_t i=0; i<sizeof(funcs)/sizeof(void*); i++)
+		entries[i] = (void*)StubFail;
+
+	funcs.logMessage = StubLogMessage;
+	funcs.printMessageToCurrentTab = StubPrintMessageToCurrentTab;
+	funcs.getConfigPath = StubGetPath;
+	funcs.getPluginPath = StubGetPath;
+	funcs.getResourcesPath = StubGetPath;
+	funcs.getErrorMessage = StubGetErrorMessage;
+	funcs.freeMemory = StubFreeMemory;
+	funcs.getCurrentServerConnectionHandlerID = StubGetCurrentServerConnectionHandlerID;
+	funcs.getServerConnectionHandlerList = StubGetServerConnectionHandlerList;
+	funcs.getConnectionStatus = StubGetConnectionStatus;
+	funcs.getServerVariableAsString = StubGetServerVariableAsString;
+	funcs.activateCaptureDevice = StubActivateCaptureDevice;
+	funcs.getClientID = StubGetClientID;
+	funcs.getClientSelfVariableAsInt = StubGetClientSelfVariableAsInt;
+	funcs.getClientSelfVariableAsString = StubGetClientSelfVariableAsString;
+	funcs.setClientSelfVariableAsInt = StubSetClientSelfVariableAsInt;
+	funcs.flushClientSelfUpdates = StubFlushClientSelfUpdates;
+	funcs.getPreProcessorConfigValue = StubGetPreProcessorConfigValue;
+	funcs.setPreProcessorConfigValue = StubSetPreProcessorConfigValue;
+	funcs.getPlaybackConfigValueAsFloat = StubGetPlaybackConfigValueAsFloat;
+	funcs.setPlaybackConfigValue = StubSetPlaybackConfigValue;
+	funcs.requestClientSetWhisperList = StubRequestClientSetWhisperList;
+	funcs.getProfileList = StubGetProfileList;
+
+	ts3plugin_setFunctionPointers(funcs);
+	if(ts3plugin_init() != 0) return false;
+
+	for(uint64 i=1; i<=STUB_SERVERS; i++)
+		ts3plugin_onConnectStatusChangeEvent(i, STATUS_CONNECTION_ESTABLISHED, ERROR_ok);
+	return true;
+}
+
+void StubUnloadPlugin()
+{
+	ts3plugin_shutdown();
+}
+
+void StubSetClock(Clock* clock)
+{
+	stubLock.Lock();
+	stubClock = clock;
+	stubLock.Unlock();
+}
+
+uint64 StubActiveServer()
+{
+	stubLock.Lock();
+	uint64 result = activeServer;
+	stubLock.Unlock();
+	return result;
+}
+
+int StubSelfVariable(uint64 scHandlerID, size_t flag)
+{
+	if(!IsStubServer(scHandlerID)) return 0;
+	stubLock.Lock();
+	std::map<size_t, int>::iterator it = selfVariables[scHandlerID].find(flag);
+	int result = (it != selfVariables[scHandlerID].end()) ? it->second : 0;
+	stubLock.Unlock();
+	return result;
+}
+
+void StubSetSelfVariable(uint64 scHandlerID, size_t flag, int value)
+{
+	if(!IsStubServer(scHandlerID)) return;
+	stubLock.Lock();
+	selfVariables[scHandlerID][flag] = value;
+	stubLock.Unlock();
+}
+
+int StubInputDeactivated(uint64 scHandlerID)
+{
+	return StubSelfVariable(scHandlerID, CLIENT_INPUT_DEACTIVATED);
+}
+
+int StubFlushes(uint64 scHandlerID)
+{
+	if(!IsStubServer(scHandlerID)) return 0;
+	stubLock.Lock();
+	int result = flushes[scHandlerID];
+	stubLock.Unlock();
+	return result;
+}
+
+std::vector<StubInputWrite> StubInputWrites()
+{
+	stubLock.Lock();
+	std::vector<StubInputWrite> result = inputWrites;
+	stubLock.Unlock();
+	return result;
+}
+
+long StubClientAllocations()
+{
+	stubLock.Lock();
+	long result = clientAllocations;
+	stubLock.Unlock();
+	return result;
+}
+
+size_t StubInputWriteCount()
+{
+	stubLock.Lock();
+	size_t result = inputWrites.size();
+	stubLock.Unlock();
+	return result;
+}
+
+int StubBaselineReads()
+{
+	stubLock.Lock();
+	int result = baselineReads;
+	stubLock.Unlock();
+	return result;
+}
+
+int StubServerVariableReads()
+{
+	stubLock.Lock();
+	int result = serverVariableReads;
+	stubLock.Unlock();
+	return result;
+}
+
+bool StubPrinted(const char* prefix)
+{
+	bool result = false;
+	stubLock.Lock();
+	for(size_t i=0; i<printedMessages.size() && !result; i++)
+		result = printedMessages[i].compare(0, strlen(prefix), prefix) == 0;
+	stubLock.Unlock();
+	return result;
+}
+
+float StubVolume()
+{
+	stubLock.Lock();
+	float result = volume;
+	stubLock.Unlock();
+	return result;
+}
+
+std::vector<StubVolumeWrite> StubVolumeWrites()
+{
+	stubLock.Lock();
+	std::vector<StubVolumeWrite> result = volumeWrites;
+	stubLock.Unlock();
+	return result;
+}
+
+/*********************************** Senders ************************************/
+
+int StubConnectSender()
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%sniftykb.sock", StubDirectory().c_str());
+
+	int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if(sock == -1) return -1;
+
+	// The receive thread binds the socket once it started
+	for(int i=0; connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1; i++)
+	{
+		if(i == STUB_CONNECT_ATTEMPTS)
+		{
+			close(sock);
+			return -1;
+		}
+		SleepMsecs(1);
+	}
+	return sock;
+}
+
+int StubBindAckEndpoint(std::string* path)
+{
+	*path = StubDirectory() + "ack.sock";
+	unlink(path->c_str());
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path->c_str());
+
+	int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if(sock != -1 && bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+	{
+		close(sock);
+		sock = -1;
+	}
+	return sock;
+}
+
+unsigned long StubThreadWakeups()
+{
+	unsigned long wakeups = 0;
+	DIR* tasks = opendir("/proc/self/task");
+	if(tasks == NULL) return 0;
+
+	struct dirent* task;
+	while((task = readdir(tasks)) != NULL)
+	{
+		if(task->d_name[0] == '.' || atol(task->d_name) == (long)getpid()) continue;
+
+		char path[300];
+		snprintf(path, sizeof(path), "/proc/self/task/%s/status", task->d_name);
+		FILE* status = fopen(path, "r");
+		if(status == NULL) continue;
+
+		char line[128];
+		unsigned long switches;
+		while(fgets(line, sizeof(line), status) != NULL)
+			if(sscanf(line, "voluntary_ctxt_switches: %lu", &switches) == 1) wakeups += switches;
+		fclose(status);
+	}
+	closedir(tasks);
+	return wakeups;
+}
@@ -0,0 +1,77 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef TS3_STUB_H
+#define TS3_STUB_H
+
+#include "public_definitions.h"
+
+#include <string>
+#include <vector>
+
+class Clock;
+
+// The stub client is connected to servers 1 and 2, named Alpha and Bravo, server 1 has the capture device
+#define STUB_SERVERS 2
+
+// A write of CLIENT_INPUT_DEACTIVATED, the time is read from the clock passed to StubSetClock
+typedef struct
+{
+	uint64 server;
+	int value;
+	uint64 time;
+} StubInputWrite;
+
+// A write of the master volume
+typedef struct
+{
+	float value;
+	uint64 time;
+} StubVolumeWrite;
+
+/*
+ * A TeamSpeak client the tests load the plugin into. Every function the stub does not implement fails,
+ * so the plugin never changes anything a test does not look at. The plugin calls the stub on its own
+ * threads, the accessors take a lock.
+ *
+ * The settings database and the command socket go into $XDG_RUNTIME_DIR, ctest gives every test its own.
+ */
+
+// Loads the plugin with the given push-to-talk delay in the default capture profile, 0 for none,
+// and connects both servers
+bool StubLoadPlugin(int pttDelayMsecs);
+void StubUnloadPlugin();
+
+void StubSetClock(Clock* clock);
+
+uint64 StubActiveServer();
+int StubSelfVariable(uint64 scHandlerID, size_t flag);
+void StubSetSelfVariable(uint64 scHandlerID, size_t flag, int value); // Changed by the user, the plugin is not told
+int StubInputDeactivated(uint64 scHandlerID);
+int StubFlushes(uint64 scHandlerID); // Calls to flushClientSelfUpdates
+int StubBaselineReads();             // Reads of the voice activation and input settings
+int StubServerVariableReads();       // Server names, unique IDs and addresses the plugin looked up
+// A message starting with the prefix was printed to the current tab
+bool StubPrinted(const char* prefix);
+std::vector<StubInputWrite> StubInputWrites();
+size_t StubInputWriteCount();        // Never allocates
+float StubVolume();
+std::vector<StubVolumeWrite> StubVolumeWrites();
+long StubClientAllocations();        // Lists and strings the client handed to the plugin
+
+/*
+ * Applications that send commands to the plugin's command socket. The sender socket is connected, messages
+ * are sent with send, and acknowledgements arrive on a socket of their own.
+ */
+#define STUB_CONNECT_ATTEMPTS 5000 // Milliseconds to wait for the plugin to bind its socket
+
+int StubConnectSender();                    // -1 if the plugin did not bind its socket
+int StubBindAckEndpoint(std::string* path); // Send "TS3_ACK_ENDPOINT <path>" to have commands acknowledged
+unsigned long StubThreadWakeups();          // Voluntary context switches of every thread but the main thread
+
+#endif
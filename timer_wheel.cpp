@@ -0,0 +1,236 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <string.h>
+
+#include "timer_wheel.h"
+
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Ticks covered by a single slot of the level above the given number of levels
+#define TIMER_WHEEL_RANGE(levels) ((uint64)1 << (TIMER_WHEEL_BITS * (levels)))
+
+/*********************************** WheelTimer ************************************/
+
+WheelTimer::WheelTimer(TimerProc proc, void* data) :
+	next(NULL),
+	link(NULL),
+	level(0),
+	proc(proc),
+	data(data),
+	expires(0)
+{
+}
+
+WheelTimer::~WheelTimer(void)
+{
+}
+
+/*********************************** TimerWheel ************************************/
+
+TimerWheel::TimerWheel(void) :
+	current(0),
+	now(0),
+	count(0)
+{
+	memset(slots, 0, sizeof(slots));
+	memset(counts, 0, sizeof(counts));
+}
+
+TimerWheel::~TimerWheel(void)
+{
+}
+
+void TimerWheel::Insert(WheelTimer* timer)
+{
+	// Timers that are already due go in the slot of the current tick
+	uint64 tick = timer->expires / TIMER_WHEEL_TICK;
+	if(tick < current) tick = current;
+
+	// Timers beyond the last level are filed at its end and filed again once they cascade
+	uint64 delta = tick - current;
+	if(delta >= TIMER_WHEEL_RANGE(TIMER_WHEEL_LEVELS))
+	{
+		delta = TIMER_WHEEL_RANGE(TIMER_WHEEL_LEVELS) - 1;
+		tick = current + delta;
+	}
+
+	int level = 0;
+	while(delta >= TIMER_WHEEL_RANGE(level + 1)) level++;
+
+	WheelTimer** slot = &slots[level][(tick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	timer->next = *slot;
+	if(*slot != NULL) (*slot)->link = &timer->next;
+	*slot = timer;
+	timer->link = slot;
+	timer->level = level;
+
+	count++;
+	counts[level]++;
+}
+
+void TimerWheel::Unlink(WheelTimer* timer)
+{
+	*timer->link = timer->next;
+	if(timer->next != NULL) timer->next->link = timer->link;
+	timer->next = NULL;
+	timer->link = NULL;
+
+	count--;
+	counts[timer->level]--;
+}
+
+void TimerWheel::Cascade(int level)
+{
+	// The wheel reached the start of this slot's range, its timers now fit in the levels below
+	WheelTimer** slot = &slots[level][(current >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK];
+	WheelTimer* timer;
+	while((timer = *slot) != NULL)
+	{
+		Unlink(timer);
+		Insert(timer);
+	}
+}
+
+size_t TimerWheel::Expire(uint64 now)
+{
+	WheelTimer** slot = &slots[0][current & TIMER_WHEEL_MASK];
+	WheelTimer* pending = *slot;
+	if(pending == NULL) return 0;
+
+	// Take the whole slot first, so timers armed by the procedures wait for the next advance
+	*slot = NULL;
+	pending->link = &pending;
+
+	size_t fired = 0;
+	WheelTimer* timer;
+	while((timer = pending) != NULL)
+	{
+		// The procedure may cancel the timers that are still pending
+		Unlink(timer);
+		if(timer->expires <= now)
+		{
+			timer->proc(timer);
+			fired++;
+		}
+		else Insert(timer);
+	}
+	return fired;
+}
+
+void TimerWheel::Start(WheelTimer* timer, uint64 now, uint64 delay)
+{
+	if(timer->IsArmed()) Unlink(timer);
+
+	// The wheel is not advanced while it is empty, catch up without walking the ticks in between
+	if(count == 0 && now / TIMER_WHEEL_TICK > current) current = now / TIMER_WHEEL_TICK;
+
+	timer->expires = now + delay;
+	Insert(timer);
+}
+
+void TimerWheel::Cancel(WheelTimer* timer)
+{
+	if(timer->IsArmed()) Unlink(timer);
+}
+
+void TimerWheel::Rebase(uint64 now)
+{
+	// Take every armed timer off the wheel, the list is linked through the timers themselves
+	WheelTimer* armed = NULL;
+	for(int level=0; level<TIMER_WHEEL_LEVELS; level++)
+	{
+		for(int i=0; i<TIMER_WHEEL_SLOTS; i++)
+		{
+			WheelTimer* timer;
+			while((timer = slots[level][i]) != NULL)
+			{
+				Unlink(timer);
+				timer->expires = now + ((timer->expires > this->now) ? timer->expires - this->now : 0);
+				timer->next = armed;
+				armed = timer;
+			}
+		}
+	}
+
+	this->now = now;
+	current = now / TIMER_WHEEL_TICK;
+	while(armed != NULL)
+	{
+		WheelTimer* timer = armed;
+		armed = timer->next;
+		Insert(timer);
+	}
+}
+
+size_t TimerWheel::Advance(uint64 now)
+{
+	this->now = now;
+	uint64 target = now / TIMER_WHEEL_TICK;
+	size_t fired = Expire(now);
+	while(current < target)
+	{
+		// Jump over the ticks of the empty levels, there is nothing to run or cascade in them
+		int empty = 0;
+		while(empty < TIMER_WHEEL_LEVELS && counts[empty] == 0) empty++;
+		if(empty > 0)
+		{
+			uint64 last = current | (TIMER_WHEEL_RANGE(empty) - 1);
+			if(last >= target)
+			{
+				current = target;
+				break;
+			}
+			current = last;
+		}
+
+		current++;
+		for(int level=1; level<TIMER_WHEEL_LEVELS && (current & (TIMER_WHEEL_RANGE(level) - 1)) == 0; level++)
+			Cascade(level);
+		fired += Expire(now);
+	}
+	return fired;
+}
+
+uint64 TimerWheel::NextExpiry() const
+{
+	if(count == 0) return 0;
+
+	// The first level is filed by tick, the first timer found is in the earliest slot
+	uint64 next = 0;
+	if(counts[0] > 0)
+	{
+		for(uint64 k=0; k<TIMER_WHEEL_SLOTS; k++)
+		{
+			WheelTimer* timer = slots[0][(current + k) & TIMER_WHEEL_MASK];
+			if(timer == NULL) continue;
+
+			next = timer->expires;
+			for(timer = timer->next; timer != NULL; timer = timer->next)
+				if(timer->expires < next) next = timer->expires;
+			break;
+		}
+	}
+
+	// The upper levels are reported when their first slot cascades, a slot may hold a timer a whole lap ahead
+	for(int level=1; level<TIMER_WHEEL_LEVELS; level++)
+	{
+		if(counts[level] == 0) continue;
+
+		for(uint64 k=1; k<=TIMER_WHEEL_SLOTS; k++)
+		{
+			uint64 range = (current >> (TIMER_WHEEL_BITS * level)) + k;
+			if(slots[level][range & TIMER_WHEEL_MASK] == NULL) continue;
+
+			uint64 at = (range << (TIMER_WHEEL_BITS * level)) * TIMER_WHEEL_TICK;
+			if(next == 0 || at < next) next = at;
+			break;
+		}
+	}
+	return next;
+}
@@ -0,0 +1,93 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "public_definitions.h"
+
+#include <stddef.h>
+
+#define TIMER_WHEEL_TICK 1000   // Microseconds per slot of the first level
+#define TIMER_WHEEL_BITS 6      // Slots per level as a power of two
+#define TIMER_WHEEL_LEVELS 4    // Covers 2^24 ticks, about four and a half hours, later timers are cascaded again
+
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+class WheelTimer;
+typedef void (*TimerProc)(WheelTimer* timer);
+
+/*
+ * A timer owned by the caller, the wheel only links it into a slot while it is armed.
+ */
+class WheelTimer
+{
+	friend class TimerWheel;
+private:
+	WheelTimer* next;
+	WheelTimer** link; // Points at the pointer to this timer, NULL if the timer is not armed
+	int level;
+public:
+	TimerProc proc;
+	void* data;
+	uint64 expires;    // Microseconds on the clock passed to the wheel
+
+	WheelTimer(TimerProc proc = NULL, void* data = NULL);
+	~WheelTimer(void);
+
+	inline bool IsArmed() const { return link != NULL; }
+};
+
+/*
+ * Hierarchical timing wheel, arming and cancelling a timer is constant time no matter how many are armed.
+ * Timers are filed by tick in the first level and by ever coarser ranges in the next levels, they move
+ * down a level whenever the wheel passes the start of their range.
+ *
+ * The wheel does not read a clock itself, every time is passed in by the caller. Not thread-safe.
+ */
+class TimerWheel
+{
+private:
+	WheelTimer* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+	uint64 current; // Tick the wheel is at
+	uint64 now;     // Time of the last advance
+	size_t count;   // Armed timers
+	size_t counts[TIMER_WHEEL_LEVELS];
+
+	void Insert(WheelTimer* timer);
+	void Unlink(WheelTimer* timer);
+	void Cascade(int level);
+	size_t Expire(uint64 now);
+public:
+	TimerWheel(void);
+	~TimerWheel(void);
+
+	// Arms the timer to expire delay microseconds after now, a timer that is already armed is moved
+	void Start(WheelTimer* timer, uint64 now, uint64 delay);
+
+	// Timers that are not armed are skipped
+	void Cancel(WheelTimer* timer);
+
+	// Moves the wheel to another clock, now is the time on the new one. Armed timers keep the time
+	// they had left since the last advance, the new clock may be behind the old one.
+	void Rebase(uint64 now);
+
+	// Runs the timers that expired by now, their procedures may arm and cancel timers. Returns how many ran.
+	size_t Advance(uint64 now);
+
+	// Time the wheel has to be advanced at to run the next timer, 0 if none is armed. Timers in the upper
+	// levels are reported at the start of their range, which is never later than when they expire.
+	uint64 NextExpiry() const;
+
+	inline size_t Count() const { return count; }
+
+	// Time the wheel was last advanced to, for procedures that arm their timer again
+	inline uint64 Now() const { return now; }
+};
+
+#endif
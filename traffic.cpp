@@ -0,0 +1,204 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#include <string.h>
+
+#include "public_errors.h"
+#include "public_definitions.h"
+#include "public_rare_definitions.h"
+#include "traffic.h"
+
+void CaptureClientState(const TS3Functions& funcs, uint64 scHandlerID, ClientState* state)
+{
+	// Values that cannot be retrieved, for example while not connected, stay 0
+	memset(state, 0, sizeof(ClientState));
+	funcs.getClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_DEACTIVATED, &state->inputDeactivated);
+	funcs.getClientSelfVariableAsInt(scHandlerID, CLIENT_INPUT_MUTED, &state->inputMuted);
+	funcs.getClientSelfVariableAsInt(scHandlerID, CLIENT_OUTPUT_MUTED, &state->outputMuted);
+	funcs.getClientSelfVariableAsInt(scHandlerID, CLIENT_AWAY, &state->away);
+	funcs.getPlaybackConfigValueAsFloat(scHandlerID, "volume_modifier", &state->volume);
+
+	char* vad;
+	if(funcs.getPreProcessorConfigValue(scHandlerID, "vad", &vad) == ERROR_ok)
+	{
+		state->vad = !strcmp(vad, "true");
+		funcs.freeMemory(vad);
+	}
+}
+
+/*********************************** Recorder ************************************/
+
+TrafficRecorder::TrafficRecorder(void) :
+	file(NULL),
+	started(0),
+	recording(false)
+{
+}
+
+TrafficRecorder::~TrafficRecorder(void)
+{
+	if(file != NULL) fclose(file);
+}
+
+bool TrafficRecorder::Start(const char* path, uint64 now, const ClientState& state)
+{
+	lock.Lock();
+	if(file != NULL)
+	{
+		lock.Unlock();
+		return false;
+	}
+
+	file = fopen(path, "wb");
+	if(file == NULL)
+	{
+		lock.Unlock();
+		return false;
+	}
+
+	unsigned char header[TRAFFIC_HEADER_SIZE] = { 0 };
+	memcpy(header, TRAFFIC_MAGIC, 4);
+	header[4] = TRAFFIC_VERSION;
+	fwrite(header, sizeof(header), 1, file);
+
+	started = now;
+	WriteState(now, state);
+	recording = true;
+	lock.Unlock();
+	return true;
+}
+
+void TrafficRecorder::Stop(uint64 now, const ClientState& state)
+{
+	lock.Lock();
+	if(file != NULL)
+	{
+		WriteState(now, state);
+		fclose(file);
+		file = NULL;
+	}
+	recording = false;
+	lock.Unlock();
+}
+
+void TrafficRecorder::WriteRecord(TrafficRecordType type, uint64 now)
+{
+	// Called with the lock held
+	unsigned char recordType = (unsigned char)type;
+	uint64 time = (now > started) ? now - started : 0;
+	fwrite(&recordType, sizeof(recordType), 1, file);
+	fwrite(&time, sizeof(time), 1, file);
+}
+
+void TrafficRecorder::WriteState(uint64 now, const ClientState& state)
+{
+	// Called with the lock held
+	WriteRecord(TRAFFIC_STATE, now);
+	fwrite(&state.inputDeactivated, sizeof(state.inputDeactivated), 1, file);
+	fwrite(&state.inputMuted, sizeof(state.inputMuted), 1, file);
+	fwrite(&state.outputMuted, sizeof(state.outputMuted), 1, file);
+	fwrite(&state.away, sizeof(state.away), 1, file);
+	fwrite(&state.vad, sizeof(state.vad), 1, file);
+	fwrite(&state.volume, sizeof(state.volume), 1, file);
+}
+
+void TrafficRecorder::Write(const Message* message, const char* sender, uint64 now)
+{
+	// Don't take the lock while no recording is running
+	if(!recording) return;
+
+	lock.Lock();
+	if(file != NULL)
+	{
+		unsigned char senderLength = (unsigned char)strlen(sender);
+		unsigned int length = (unsigned int)message->length;
+		WriteRecord(TRAFFIC_MESSAGE, now);
+		fwrite(&senderLength, sizeof(senderLength), 1, file);
+		fwrite(sender, senderLength, 1, file);
+		fwrite(&length, sizeof(length), 1, file);
+		fwrite(message->data, length, 1, file);
+	}
+	lock.Unlock();
+}
+
+/*********************************** Reader ************************************/
+
+TrafficLog::TrafficLog(void) :
+	file(NULL)
+{
+}
+
+TrafficLog::~TrafficLog(void)
+{
+	Close();
+}
+
+bool TrafficLog::Open(const char* path)
+{
+	file = fopen(path, "rb");
+	if(file == NULL) return false;
+
+	unsigned char header[TRAFFIC_HEADER_SIZE];
+	if(!Read(header, sizeof(header)) || memcmp(header, TRAFFIC_MAGIC, 4) || header[4] != TRAFFIC_VERSION)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void TrafficLog::Close()
+{
+	if(file != NULL) fclose(file);
+	file = NULL;
+}
+
+bool TrafficLog::Read(void* value, size_t size)
+{
+	return size == 0 || fread(value, size, 1, file) == 1;
+}
+
+bool TrafficLog::Next(TrafficRecord* record, Message* message)
+{
+	if(file == NULL) return false;
+
+	unsigned char type;
+	if(!Read(&type, sizeof(type)) || !Read(&record->time, sizeof(record->time))) return false;
+	record->type = (TrafficRecordType)type;
+
+	switch(record->type)
+	{
+	case TRAFFIC_MESSAGE:
+	{
+		unsigned char senderLength;
+		unsigned int length;
+		if(!Read(&senderLength, sizeof(senderLength)) || senderLength >= SENDER_NAME_BUFSIZE) return false;
+		if(!Read(record->sender, senderLength)) return false;
+		record->sender[senderLength] = '\0';
+
+		// A truncated recording ends at the last complete record
+		if(!Read(&length, sizeof(length)) || length >= MESSAGE_BUFSIZE) return false;
+		if(!Read(message->data, length)) return false;
+		message->data[length] = '\0';
+		message->length = length;
+		return true;
+	}
+	case TRAFFIC_STATE:
+	{
+		ClientState& state = record->state;
+		return Read(&state.inputDeactivated, sizeof(state.inputDeactivated)) &&
+			Read(&state.inputMuted, sizeof(state.inputMuted)) &&
+			Read(&state.outputMuted, sizeof(state.outputMuted)) &&
+			Read(&state.away, sizeof(state.away)) &&
+			Read(&state.vad, sizeof(state.vad)) &&
+			Read(&state.volume, sizeof(state.volume));
+	}
+	default:
+		return false;
+	}
+}
@@ -0,0 +1,109 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "public_definitions.h"
+#include "ts3_functions.h"
+#include "message.h"
+#include "sender.h"
+#include "platform.h"
+
+/*
+ * Recording of the messages received on the command endpoints, so a latency complaint can be
+ * replayed. All values are little-endian.
+ *
+ * File:    4 bytes "NKBR", u8 version, 3 bytes reserved (0)
+ * Record:  u8 type, u64 microseconds since the recording started, then
+ *          for TRAFFIC_MESSAGE: u8 sender length, sender, u32 length, message
+ *          for TRAFFIC_STATE:   i32 input deactivated, i32 input muted, i32 output muted, i32 away,
+ *                               i32 voice activation, f32 volume
+ *
+ * A recording starts and ends with the state of the client on the active server.
+ */
+#define TRAFFIC_MAGIC "NKBR"
+#define TRAFFIC_VERSION 1
+#define TRAFFIC_HEADER_SIZE 8
+
+enum TrafficRecordType
+{
+	TRAFFIC_MESSAGE = 1,
+	TRAFFIC_STATE
+};
+
+// Own status on a server, the part of the client state commands change
+typedef struct
+{
+	int inputDeactivated;
+	int inputMuted;
+	int outputMuted;
+	int away;
+	int vad;
+	float volume;
+} ClientState;
+
+void CaptureClientState(const TS3Functions& funcs, uint64 scHandlerID, ClientState* state);
+
+typedef struct
+{
+	TrafficRecordType type;
+	uint64 time;
+	char sender[SENDER_NAME_BUFSIZE]; // Only for TRAFFIC_MESSAGE
+	ClientState state;                // Only for TRAFFIC_STATE
+} TrafficRecord;
+
+/*
+ * Appends received messages to a recording. Thread-safe, messages are written by every thread
+ * that receives them. The file is buffered, it is complete once the recording is stopped.
+ */
+class TrafficRecorder
+{
+private:
+	Mutex lock;
+	FILE* file;
+	uint64 started;
+	volatile bool recording;
+
+	void WriteRecord(TrafficRecordType type, uint64 now);
+	void WriteState(uint64 now, const ClientState& state);
+public:
+	TrafficRecorder(void);
+	~TrafficRecorder(void);
+
+	bool Start(const char* path, uint64 now, const ClientState& state);
+	void Stop(uint64 now, const ClientState& state);
+	inline bool IsRecording() const { return recording; }
+
+	void Write(const Message* message, const char* sender, uint64 now);
+};
+
+/*
+ * Reads a recording back one record at a time.
+ */
+class TrafficLog
+{
+private:
+	FILE* file;
+
+	bool Read(void* value, size_t size);
+public:
+	TrafficLog(void);
+	~TrafficLog(void);
+
+	bool Open(const char* path);
+	void Close();
+
+	// The data of a message record is read into the message, returns false at the end of the recording
+	bool Next(TrafficRecord* record, Message* message);
+};
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "message.h"
+
+enum TransportResult
+{
+	TRANSPORT_MESSAGE = 0, // A message was received
+	TRANSPORT_EMPTY,       // No message was waiting
+	TRANSPORT_WOKEN,       // Wake was called, no message was received
+	TRANSPORT_ERROR        // The endpoint failed, it must be closed
+};
+
+/*
+ * Endpoint that command messages are received on. Only Wake may be called while another thread
+ * is receiving, the transport is closed once the receiving thread has stopped.
+ */
+class Transport
+{
+public:
+	virtual ~Transport(void) {}
+
+	virtual bool Open() = 0;
+	virtual void Close() = 0;
+
+	// Blocks until a message arrives or Wake is called, the message is NULL-terminated
+	virtual TransportResult Receive(Message* message) = 0;
+
+	// Receives a message that is already waiting without blocking, used to drain the endpoint after Receive
+	virtual TransportResult Poll(Message* message) = 0;
+
+	// Returns a blocked Receive call
+	virtual void Wake() = 0;
+
+	// Name of the endpoint for the log
+	virtual const char* Name() const = 0;
+};
+
+#endif
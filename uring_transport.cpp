@@ -0,0 +1,338 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring_transport.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#endif
+
+// Without the multishot recvmsg definitions (Linux 6.0 headers) only the epoll receiver is built
+#ifdef IORING_RECV_MULTISHOT
+#define URING_SUPPORTED
+
+// Older C libraries do not name the system calls, their numbers are the same on every architecture
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#define __NR_io_uring_enter 426
+#define __NR_io_uring_register 427
+#endif
+#endif
+
+// Tags of the requests, returned with their completions
+#define URING_TAG_MESSAGE 0
+#define URING_TAG_WAKE 1
+
+#define URING_BUFFER_GROUP 0
+
+UringTransport::UringTransport(void) :
+	uring(false),
+	received(false),
+	ringFd(-1),
+	pending(0),
+	sqRing(MAP_FAILED),
+	sqRingSize(0),
+	cqRing(MAP_FAILED),
+	cqRingSize(0),
+	sqes(MAP_FAILED),
+	sqesSize(0),
+	bufRing(MAP_FAILED),
+	buffers((char*)MAP_FAILED)
+{
+	memset(&header, 0, sizeof(header));
+}
+
+UringTransport::~UringTransport(void)
+{
+	Close();
+}
+
+bool UringTransport::Open()
+{
+	if(!SocketTransport::Open()) return false;
+
+	// Keep the epoll receiver if the ring cannot be set up
+	uring = SetupRing();
+	if(!uring) CloseRing();
+	return true;
+}
+
+void UringTransport::Close()
+{
+	CloseRing();
+	SocketTransport::Close();
+}
+
+#ifdef URING_SUPPORTED
+bool UringTransport::SetupRing()
+{
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = URING_CQ_ENTRIES;
+
+	ringFd = (int)syscall(__NR_io_uring_setup, URING_SQ_ENTRIES, &params);
+	if(ringFd == -1) return false;
+
+	// Map the submission and completion rings, recent kernels share one mapping between them
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(cqRingSize > sqRingSize) sqRingSize = cqRingSize;
+		sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+		if(sqRing == MAP_FAILED) return false;
+	}
+	else
+	{
+		sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+		cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if(sqRing == MAP_FAILED || cqRing == MAP_FAILED) return false;
+	}
+	char* sq = (char*)sqRing;
+	char* cq = (char*)((cqRing != MAP_FAILED) ? cqRing : sqRing);
+
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if(sqes == MAP_FAILED) return false;
+
+	sqTail = (unsigned int*)(sq + params.sq_off.tail);
+	sqMask = (unsigned int*)(sq + params.sq_off.ring_mask);
+	sqArray = (unsigned int*)(sq + params.sq_off.array);
+	cqHead = (unsigned int*)(cq + params.cq_off.head);
+	cqTail = (unsigned int*)(cq + params.cq_off.tail);
+	cqMask = (unsigned int*)(cq + params.cq_off.ring_mask);
+	cqes = cq + params.cq_off.cqes;
+
+	// Register the receive buffers, the kernel picks a free one for every datagram
+	bufRing = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	buffers = (char*)mmap(NULL, URING_BUFFERS * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(bufRing == MAP_FAILED || buffers == (char*)MAP_FAILED) return false;
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long long)(size_t)bufRing;
+	reg.ring_entries = URING_BUFFERS;
+	reg.bgid = URING_BUFFER_GROUP;
+	if(syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) return false;
+
+	for(unsigned int i=0; i<URING_BUFFERS; i++)
+		ReturnBuffer(i);
+
+	// Every buffer starts with the recvmsg header, the credentials and then the datagram
+	header.msg_namelen = 0;
+	header.msg_controllen = CMSG_SPACE(sizeof(struct ucred));
+
+	received = false;
+	ArmReceive();
+	ArmWake();
+	return Submit(0);
+}
+
+void UringTransport::CloseRing()
+{
+	if(sqes != MAP_FAILED) munmap(sqes, sqesSize);
+	if(cqRing != MAP_FAILED) munmap(cqRing, cqRingSize);
+	if(sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+	if(ringFd != -1) close(ringFd);
+	if(bufRing != MAP_FAILED) munmap(bufRing, URING_BUFFERS * sizeof(struct io_uring_buf));
+	if(buffers != (char*)MAP_FAILED) munmap(buffers, URING_BUFFERS * URING_BUFFER_SIZE);
+
+	sqes = sqRing = cqRing = bufRing = MAP_FAILED;
+	buffers = (char*)MAP_FAILED;
+	ringFd = -1;
+	pending = 0;
+	uring = false;
+}
+
+void* UringTransport::NextRequest()
+{
+	// Only the receive thread submits requests, the tail is ours
+	unsigned int tail = *sqTail;
+	unsigned int index = tail & *sqMask;
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)sqes + index;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqArray[index] = index;
+
+	// The request is filled in before the kernel reads the new tail at the next submission
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	pending++;
+	return sqe;
+}
+
+bool UringTransport::Submit(unsigned int wait)
+{
+	while(true)
+	{
+		int result = (int)syscall(__NR_io_uring_enter, ringFd, pending, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+		if(result >= 0)
+		{
+			pending -= ((unsigned int)result < pending) ? (unsigned int)result : pending;
+			return true;
+		}
+		if(errno != EINTR) return false;
+	}
+}
+
+void UringTransport::ArmReceive()
+{
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)NextRequest();
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = sock;
+	sqe->addr = (unsigned long long)(size_t)&header;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = URING_BUFFER_GROUP;
+	sqe->user_data = URING_TAG_MESSAGE;
+}
+
+void UringTransport::ArmWake()
+{
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)NextRequest();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = wakeFd;
+	sqe->poll32_events = POLLIN;
+	sqe->len = IORING_POLL_ADD_MULTI;
+	sqe->user_data = URING_TAG_WAKE;
+}
+
+void UringTransport::ReturnBuffer(unsigned int id)
+{
+	// The tail overlays the reserved field of the first entry, io_uring_buf_ring is not used because
+	// its flexible array member is placed after a padding byte when compiled as C++
+	struct io_uring_buf* ring = (struct io_uring_buf*)bufRing;
+	unsigned short tail = ring[0].resv;
+	struct io_uring_buf* buf = &ring[tail & (URING_BUFFERS - 1)];
+	buf->addr = (unsigned long long)(size_t)(buffers + id * URING_BUFFER_SIZE);
+	buf->len = URING_BUFFER_SIZE;
+	buf->bid = (unsigned short)id;
+	__atomic_store_n(&ring[0].resv, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
+
+TransportResult UringTransport::Receive(Message* message)
+{
+	while(uring)
+	{
+		TransportResult result = Poll(message);
+		if(result != TRANSPORT_EMPTY) return result;
+
+		// Block until a completion arrives, submitting the re-armed requests on the way
+		if(uring && !Submit(1)) return TRANSPORT_ERROR;
+	}
+	return SocketTransport::Receive(message);
+}
+
+TransportResult UringTransport::Poll(Message* message)
+{
+	if(!uring) return SocketTransport::Poll(message);
+
+	while(true)
+	{
+		unsigned int head = *cqHead;
+		if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+		{
+			// Nothing waiting, hand the kernel the requests that were re-armed
+			if(pending > 0 && !Submit(0)) return TRANSPORT_ERROR;
+			return TRANSPORT_EMPTY;
+		}
+
+		struct io_uring_cqe* cqe = (struct io_uring_cqe*)cqes + (head & *cqMask);
+		unsigned long long tag = cqe->user_data;
+		int result = cqe->res;
+		unsigned int flags = cqe->flags;
+		__atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+		if(tag == URING_TAG_WAKE)
+		{
+			eventfd_t value;
+			eventfd_read(wakeFd, &value);
+			if(!(flags & IORING_CQE_F_MORE)) ArmWake();
+			return TRANSPORT_WOKEN;
+		}
+
+		// A multishot request ends when the buffers run out or it fails, arm it again
+		if(!(flags & IORING_CQE_F_MORE)) ArmReceive();
+
+		if(result < 0)
+		{
+			if(result == -ENOBUFS) continue;
+			if(result == -EINVAL && !received)
+			{
+				// The kernel does not support multishot recvmsg, switch to epoll
+				CloseRing();
+				return SocketTransport::Poll(message);
+			}
+			return TRANSPORT_ERROR;
+		}
+		if(!(flags & IORING_CQE_F_BUFFER)) continue;
+		received = true;
+
+		unsigned int id = flags >> IORING_CQE_BUFFER_SHIFT;
+		char* buffer = buffers + id * URING_BUFFER_SIZE;
+		struct io_uring_recvmsg_out* out = (struct io_uring_recvmsg_out*)buffer;
+		char* control = buffer + sizeof(struct io_uring_recvmsg_out) + header.msg_namelen;
+		char* payload = control + header.msg_controllen;
+
+		// Datagrams longer than the buffer are truncated, like the mailslot refuses them
+		size_t length = (size_t)result - (payload - buffer);
+		if(length > out->payloadlen) length = out->payloadlen;
+		if(length > MESSAGE_BUFSIZE-1) length = MESSAGE_BUFSIZE-1;
+		memcpy(message->data, payload, length);
+		message->data[length] = '\0';
+		message->length = length;
+
+		message->peer = 0;
+		struct msghdr credentialsHeader;
+		memset(&credentialsHeader, 0, sizeof(credentialsHeader));
+		credentialsHeader.msg_control = control;
+		credentialsHeader.msg_controllen = out->controllen;
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&credentialsHeader);
+		if(cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS)
+		{
+			struct ucred credentials;
+			memcpy(&credentials, CMSG_DATA(cmsg), sizeof(credentials));
+			message->peer = (unsigned int)credentials.pid;
+		}
+
+		ReturnBuffer(id);
+		if(length == 0) return TRANSPORT_WOKEN;
+		return TRANSPORT_MESSAGE;
+	}
+}
+#else
+bool UringTransport::SetupRing()
+{
+	return false;
+}
+
+void UringTransport::CloseRing()
+{
+	uring = false;
+}
+
+TransportResult UringTransport::Receive(Message* message)
+{
+	return SocketTransport::Receive(message);
+}
+
+TransportResult UringTransport::Poll(Message* message)
+{
+	return SocketTransport::Poll(message);
+}
+#endif
+#endif
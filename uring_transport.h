@@ -0,0 +1,79 @@
+/*
+ * TeamSpeak 3 NiftyKb plugin
+ * Author: Jules Blok (jules@aerix.nl)
+ *
+ * Copyright (c) 2010-2012 Jules Blok
+ * Copyright (c) 2008-2012 TeamSpeak Systems GmbH
+ */
+
+#ifndef URING_TRANSPORT_H
+#define URING_TRANSPORT_H
+
+#ifndef _WIN32
+#include <sys/socket.h>
+
+#include "socket_transport.h"
+
+#define URING_SQ_ENTRIES 4
+#define URING_CQ_ENTRIES 64
+#define URING_BUFFERS 16 // Must be a power of two
+#define URING_BUFFER_SIZE (MESSAGE_BUFSIZE + 128) // Room for the recvmsg header and the credentials
+
+/*
+ * Receives on the same Unix-domain socket as SocketTransport, but through io_uring. One multishot
+ * recvmsg request receives every datagram into a ring of buffers registered with the kernel, and the
+ * completions are read from shared memory. A burst of datagrams is drained without a system call per
+ * message, the receive thread only enters the kernel to block or to re-arm the request.
+ *
+ * Falls back to epoll if io_uring is unavailable or the kernel does not support multishot recvmsg
+ * (Linux 6.0).
+ */
+class UringTransport : public SocketTransport
+{
+private:
+	bool uring;        // false while the epoll receiver of SocketTransport is used
+	bool received;     // A datagram arrived through io_uring, multishot recvmsg is supported
+	int ringFd;
+	unsigned int pending; // Requests queued but not yet submitted
+
+	// Memory shared with the kernel
+	void* sqRing;
+	size_t sqRingSize;
+	void* cqRing;
+	size_t cqRingSize;
+	void* sqes;
+	size_t sqesSize;
+	void* bufRing;
+	char* buffers;
+
+	// Offsets into the shared rings
+	unsigned int* sqTail;
+	unsigned int* sqMask;
+	unsigned int* sqArray;
+	unsigned int* cqHead;
+	unsigned int* cqTail;
+	unsigned int* cqMask;
+	void* cqes;
+
+	struct msghdr header; // Layout of the received buffers, used by the kernel while the request is armed
+
+	bool SetupRing();
+	void CloseRing();
+	void* NextRequest();
+	bool Submit(unsigned int wait);
+	void ArmReceive();
+	void ArmWake();
+	void ReturnBuffer(unsigned int id);
+public:
+	UringTransport(void);
+	~UringTransport(void);
+
+	bool Open();
+	void Close();
+	TransportResult Receive(Message* message);
+	TransportResult Poll(Message* message);
+	inline bool IsUring() const { return uring; }
+};
+#endif
+
+#endif